@@ -0,0 +1,589 @@
+/** -*- C++ -*- */
+
+/*
+ * Ahead-of-time translation of a saved binary to C++.
+ *
+ * Splits the code space into functions as the GC and Verifier do, and
+ * writes (to stdout) a translation unit with one C++ function per Fith
+ * word, plus the NativeTable that Interpreter::setNative takes.  Link it
+ * with the embedded interpreter (see "make fithen" and "make fithpn").
+ *
+ * A word is translated only if:
+ *   - the Verifier proves it, so its stack depths are fixed and its
+ *     return stack is balanced at every EXIT, meaning a native call and
+ *     return can stand in for the interpreter's;
+ *   - it uses only the opcodes below (no EXECUTE, ROLL etc.);
+ *   - everything it calls is translated too.
+ * Other words are left to the interpreter.
+ *
+ * The generated code makes the same checks as the handlers, in the same
+ * order, and returns the same EXEC_RESULT with the stacks in the same
+ * state.  Syscalls still go through SysCalls.
+ *
+ * usage: fithaot file.fith [ENTRYPOINT] > native.cc
+ */
+
+#include "fithi.h"
+#include "fithfile.h"
+#include "fithverify.h"
+#include "crc.h"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <stdexcept>
+
+using namespace fith;
+using namespace std;
+
+// flag bits and address mask, as per Interpreter
+const fith_cell FLAG_MACHINE=0x80000000;
+const fith_cell FLAG_ADDR=0x1FFFFFFF;
+
+/// preamble for the generated code: stack access and checks
+const char *PREAMBLE=
+    "// top of each stack, as per the interpreter\n"
+    "#define T(n)            m.dstk[m.dsp-(n)]\n"
+    "#define R(n)            m.rstk[m.rsp-(n)]\n"
+    "#define PUSH(x)         m.dstk[m.dsp++]=(x)\n"
+    "\n"
+    "// checks; at is where the interpreter's ip would be\n"
+    "#define FAULT(x, at)    do{ m.ip=(at); return Interpreter::x; }while(0)\n"
+    "#define CHECK(c, x, at) if(c) FAULT(x, at)\n"
+    "#define NEED(n, at)     if(m.dsp < (n)) FAULT(EX_DSTK_UNDER, at)\n"
+    "#define ROOM(n, at)     if(m.dsp+(n) > m.dsz) FAULT(EX_DSTK_OVER, at)\n"
+    "#define RNEED(n, at)    if(m.rsp < (n)) FAULT(EX_RSTK_UNDER, at)\n"
+    "#define RROOM(n, at)    if(m.rsp+(n) > m.rsz) FAULT(EX_RSTK_OVER, at)\n"
+    "#define HEAP(p, at)     if(size_t(p) >= m.heapsz) FAULT(EX_SEGV_DATA, at)\n"
+    "#define HEAPC(p, at)    if(size_t(p) >= m.heapsz*sizeof(fith_cell)) FAULT(EX_SEGV_DATA, at)\n"
+    "\n"
+    "#define BINOP(op, at)   NEED(2, at); T(2)=T(2) op T(1); --m.dsp\n"
+    "#define CMPOP(op, at)   NEED(2, at); T(2)=(T(2) op T(1)) ? 1 : 0; --m.dsp\n"
+    "#define CALL(f, at)     RROOM(1, at); m.rstk[m.rsp++]=(at); if((res=f(m)) != Interpreter::EX_SUCCESS) return res\n";
+
+/**
+ * Can the opcode be translated?
+ */
+static bool supported(fith_cell op)
+{
+    switch(op){
+    case Interpreter::MW_MULDIV:
+    case Interpreter::MW_DIVMOD:
+    case Interpreter::MW_MULMOD:
+    case Interpreter::MW_CALL:
+    case Interpreter::MW_DUPNZ:
+    case Interpreter::MW_ROLL:
+    case Interpreter::MW_MOVE:
+    case Interpreter::MW_MOVEC:
+    case Interpreter::MW_FILL:
+    case Interpreter::MW_FILLC:
+    case Interpreter::MW_COMPARE:
+    case Interpreter::MW_COMPAREC:
+    case Interpreter::MW_SCAN:
+    case Interpreter::MW_SCANC:
+    case Interpreter::MW_STRLEN:
+    case Interpreter::MW_STRREAD:
+    case Interpreter::MW_STRWRITE:
+    case Interpreter::MW_STRCMP:
+    case Interpreter::MW_STRCAT:
+    case Interpreter::MW_EMIT:
+    case Interpreter::MW_TYPE:
+    case Interpreter::MW_TELL:
+    case Interpreter::MW_FLUSH:
+    case Interpreter::MW_BTST:
+    case Interpreter::MW_BSET:
+    case Interpreter::MW_BCLR:
+    case Interpreter::MW_BTGL:
+    case Interpreter::MW_BFX:
+    case Interpreter::MW_BFI:
+    case Interpreter::MW_POPCNT:
+    case Interpreter::MW_FFS:
+    case Interpreter::MW_DPLUS:
+    case Interpreter::MW_DMINUS:
+    case Interpreter::MW_MSTAR:
+    case Interpreter::MW_UMDIVMOD:
+    case Interpreter::MW_DLT:
+    case Interpreter::MW_DEQ:
+    case Interpreter::MW_QMUL:
+    case Interpreter::MW_QDIV:
+    case Interpreter::MW_SQRT:
+    case Interpreter::MW_MIN:
+    case Interpreter::MW_MAX:
+    case Interpreter::MW_CLAMP:
+    case Interpreter::MW_INTERP:
+    case Interpreter::MW_TON:
+    case Interpreter::MW_TOF:
+    case Interpreter::MW_TP:
+    case Interpreter::MW_CTU:
+    case Interpreter::MW_CTD:
+    case Interpreter::MW_RTRIG:
+    case Interpreter::MW_FTRIG:
+    case Interpreter::MW_CASE:
+        return false;
+    default:
+        // nothing from the full system
+        return op < Interpreter::MW_STORECODE;
+    }
+}
+
+class Translator {
+public:
+
+    explicit Translator(const FithImage &_image);
+
+    /**
+     * Choose the functions to translate.
+     * @return how many
+     */
+    size_t select();
+
+    /// write the translation unit
+    void write(ostream &os, const string &source);
+
+private:
+
+    /// scan one function: false if it has untranslatable opcodes
+    bool scan(fith_cell addr, fith_cell len, set<fith_cell> &callees) const;
+
+    /// write one function
+    void function(ostream &os, fith_cell addr, fith_cell len);
+
+    /// write one instruction, return address of the next
+    fith_cell instruction(ostream &os, fith_cell at);
+
+    static string fname(fith_cell addr);
+    fith_cell dest(fith_cell at) const { return at+bin[at+1]; }
+
+    const FithImage &image;
+    const vector<fith_cell> &bin;
+    Verifier verifier;
+    set<fith_cell> chosen;
+};
+
+Translator::Translator(const FithImage &_image)
+    : image(_image), bin(_image.text), verifier(&_image.text[0])
+{
+}
+
+size_t Translator::select()
+{
+    verifier.verify(image.entry);
+    const Interpreter::Proof *proofs=verifier.proofs();
+    const Verifier::extent_map &ext=verifier.functions();
+
+    // proven, with nothing untranslatable
+    map<fith_cell, set<fith_cell> > calls;
+    for(size_t i=0;i<verifier.count();++i){
+        fith_cell addr=proofs[i].addr;
+        set<fith_cell> callees;
+        if(scan(addr, ext.find(addr)->second, callees)){
+            chosen.insert(addr);
+            calls[addr]=callees;
+        }
+    }
+
+    // and calling only translated functions
+    bool changed=true;
+    while(changed){
+        changed=false;
+        for(map<fith_cell, set<fith_cell> >::iterator i=calls.begin();i!=calls.end();++i){
+            if(chosen.count(i->first) == 0){
+                continue;
+            }
+            for(set<fith_cell>::const_iterator j=i->second.begin();j!=i->second.end();++j){
+                if(chosen.count(*j) == 0){
+                    chosen.erase(i->first);
+                    changed=true;
+                    break;
+                }
+            }
+        }
+    }
+
+    return chosen.size();
+}
+
+bool Translator::scan(fith_cell addr, fith_cell len, set<fith_cell> &callees) const
+{
+    set<fith_cell> starts, targets;
+    for(fith_cell at=addr;at<addr+len;++at){
+        starts.insert(at);
+        fith_cell cell=bin[at];
+        if((cell & FLAG_MACHINE) == 0){
+            callees.insert(cell & FLAG_ADDR);
+            continue;
+        }
+        cell &= FLAG_ADDR;
+        if(!supported(cell) || at+Interpreter::opinfo[cell].operands >= addr+len){
+            return false;
+        }
+        if((Interpreter::opinfo[cell].flags & Interpreter::OPF_BRANCH) != 0){
+            targets.insert(dest(at));
+        }
+        at+=Interpreter::opinfo[cell].operands;
+    }
+
+    // every branch, even in dead code, must land on an instruction here
+    for(set<fith_cell>::const_iterator i=targets.begin();i!=targets.end();++i){
+        if(starts.count(*i) == 0){
+            return false;
+        }
+    }
+    return true;
+}
+
+string Translator::fname(fith_cell addr)
+{
+    ostringstream oss;
+    oss << "f_" << addr;
+    return oss.str();
+}
+
+void Translator::write(ostream &os, const string &source)
+{
+    const Verifier::extent_map &ext=verifier.functions();
+
+    CRC32STM crc;
+    crc.insert((const unsigned *) &bin[0], bin[0]);
+
+    os << "/** -*- C++ -*- */" << endl
+       << endl
+       << "/*" << endl
+       << " * Native translation of " << source << ", generated by fithaot: do not edit." << endl
+       << " * " << chosen.size() << " of " << ext.size() << " functions translated." << endl
+       << " */" << endl
+       << endl
+       << "#include \"fithi.h\"" << endl
+       << endl
+       << "using namespace fith;" << endl
+       << endl
+       << PREAMBLE
+       << endl;
+
+    for(set<fith_cell>::const_iterator i=chosen.begin();i!=chosen.end();++i){
+        os << "static Interpreter::EXEC_RESULT " << fname(*i) << "(Interpreter::Machine &m);" << endl;
+    }
+    os << endl;
+
+    for(set<fith_cell>::const_iterator i=chosen.begin();i!=chosen.end();++i){
+        function(os, *i, ext.find(*i)->second);
+    }
+
+    os << hex;
+    if(chosen.empty()){
+        os << "extern const Interpreter::NativeTable fithnative={ 0x" << crc.remainder() << ", 0, NULL };" << endl;
+    }
+    else{
+        os << "static const Interpreter::Native natives[]={" << endl;
+        for(set<fith_cell>::const_iterator i=chosen.begin();i!=chosen.end();++i){
+            os << "    { 0x" << *i << ", " << fname(*i) << " }," << endl;
+        }
+        os << "};" << endl
+           << endl
+           << "extern const Interpreter::NativeTable fithnative={" << endl
+           << "    0x" << crc.remainder() << ", sizeof(natives)/sizeof(natives[0]), natives" << endl
+           << "};" << endl;
+    }
+    os << dec;
+}
+
+void Translator::function(ostream &os, fith_cell addr, fith_cell len)
+{
+    // find branch targets, which need labels, and calls
+    set<fith_cell> targets;
+    bool calls=false;
+    for(fith_cell at=addr;at<addr+len;++at){
+        fith_cell cell=bin[at];
+        if((cell & FLAG_MACHINE) == 0){
+            calls=true;
+            continue;
+        }
+        cell &= FLAG_ADDR;
+        if((Interpreter::opinfo[cell].flags & Interpreter::OPF_BRANCH) != 0){
+            targets.insert(dest(at));
+        }
+        at+=Interpreter::opinfo[cell].operands;
+    }
+
+    FithImage::names_t::const_iterator name=image.names.find(addr);
+    if(name != image.names.end()){
+        os << "/// " << name->second << endl;
+    }
+    os << "static Interpreter::EXEC_RESULT " << fname(addr) << "(Interpreter::Machine &m)" << endl
+       << "{" << endl;
+    if(calls){
+        os << "    Interpreter::EXEC_RESULT res;" << endl
+           << endl;
+    }
+
+    for(fith_cell at=addr;at<addr+len;){
+        if(targets.count(at) != 0){
+            os << "L_" << at << ":" << endl;
+        }
+        at=instruction(os, at);
+    }
+
+    // the Verifier has shown that every path ends in EXIT or a jump
+    os << "    FAULT(EX_SEGV_CODE, " << addr+len << ");" << endl
+       << "}" << endl
+       << endl;
+}
+
+fith_cell Translator::instruction(ostream &os, fith_cell at)
+{
+    fith_cell cell=bin[at];
+    const fith_cell ip=at+1;    // interpreter's ip once the opcode is fetched
+
+    if((cell & FLAG_MACHINE) == 0){
+        os << "    CALL(" << fname(cell & FLAG_ADDR) << ", " << ip << ");" << endl;
+        return ip;
+    }
+
+    cell &= FLAG_ADDR;
+    const fith_cell next=ip+Interpreter::opinfo[cell].operands;
+    const fith_cell v=(next > ip) ? bin[ip] : 0;
+    ostringstream label;
+    if((Interpreter::opinfo[cell].flags & Interpreter::OPF_BRANCH) != 0){
+        label << "goto L_" << dest(at) << ";";
+    }
+
+    os << "    ";
+    switch(cell){
+    case Interpreter::MW_EXIT:
+        os << "if(m.rsp == 0){ m.ip=" << ip << "; return Interpreter::EX_SUCCESS; } --m.rsp; return Interpreter::EX_SUCCESS;";
+        break;
+    case Interpreter::MW_LIT:
+    case Interpreter::MW_TICK:
+        os << "ROOM(1, " << ip << "); PUSH(" << v << ");";
+        break;
+    case Interpreter::MW_PLUS:      os << "BINOP(+, " << ip << ");";  break;
+    case Interpreter::MW_MINUS:     os << "BINOP(-, " << ip << ");";  break;
+    case Interpreter::MW_MUL:       os << "BINOP(*, " << ip << ");";  break;
+    case Interpreter::MW_AND:       os << "BINOP(&, " << ip << ");";  break;
+    case Interpreter::MW_OR:        os << "BINOP(|, " << ip << ");";  break;
+    case Interpreter::MW_XOR:       os << "BINOP(^, " << ip << ");";  break;
+    case Interpreter::MW_SL:        os << "BINOP(<<, " << ip << ");"; break;
+    case Interpreter::MW_SRA:       os << "BINOP(>>, " << ip << ");"; break;
+    case Interpreter::MW_LT:        os << "CMPOP(<, " << ip << ");";  break;
+    case Interpreter::MW_GT:        os << "CMPOP(>, " << ip << ");";  break;
+    case Interpreter::MW_LE:        os << "CMPOP(<=, " << ip << ");"; break;
+    case Interpreter::MW_GE:        os << "CMPOP(>=, " << ip << ");"; break;
+    case Interpreter::MW_EQ:        os << "CMPOP(==, " << ip << ");"; break;
+    case Interpreter::MW_SRL:
+        os << "NEED(2, " << ip << "); T(2)=(fith_cell) (((unsigned long) T(2)) >> T(1)); --m.dsp;";
+        break;
+    case Interpreter::MW_NEG:
+        os << "NEED(1, " << ip << "); T(1)= -T(1);";
+        break;
+    case Interpreter::MW_INVERT:
+        os << "NEED(1, " << ip << "); T(1)= ~T(1);";
+        break;
+    case Interpreter::MW_DIV:
+    case Interpreter::MW_MOD:
+        os << "NEED(2, " << ip << "); CHECK(T(1) == 0, EX_DIV_ZERO, " << ip << "); "
+           << "T(2)=T(2) " << (cell == Interpreter::MW_DIV ? "/" : "%") << " T(1); --m.dsp;";
+        break;
+    case Interpreter::MW_JMP:
+        os << label.str();
+        break;
+    case Interpreter::MW_JZ:
+        os << "NEED(1, " << ip << "); if(m.dstk[--m.dsp] == 0) " << label.str();
+        break;
+    case Interpreter::MW_DUP:
+        os << "NEED(1, " << ip << "); ROOM(1, " << ip << "); m.dstk[m.dsp]=T(1); ++m.dsp;";
+        break;
+    case Interpreter::MW_DROP:
+        os << "NEED(1, " << ip << "); --m.dsp;";
+        break;
+    case Interpreter::MW_SWAP:
+        os << "NEED(2, " << ip << "); { fith_cell t=T(2); T(2)=T(1); T(1)=t; }";
+        break;
+    case Interpreter::MW_ROT:
+        os << "NEED(3, " << ip << "); { fith_cell t=T(3); T(3)=T(2); T(2)=T(1); T(1)=t; }";
+        break;
+    case Interpreter::MW_NROT:
+        os << "NEED(3, " << ip << "); { fith_cell t=T(1); T(1)=T(2); T(2)=T(3); T(3)=t; }";
+        break;
+    case Interpreter::MW_PICK:
+        os << "CHECK(m.dsp < 2 || T(1) < 0 || m.dsp < size_t(T(1)+2), EX_DSTK_UNDER, " << ip << "); "
+           << "T(1)=m.dstk[m.dsp-T(1)-2];";
+        break;
+    case Interpreter::MW_STORE:
+        os << "NEED(2, " << ip << "); HEAP(T(1), " << ip << "); m.heap[T(1)]=T(2); m.dsp-=2;";
+        break;
+    case Interpreter::MW_STOREC:
+        os << "NEED(2, " << ip << "); HEAPC(T(1), " << ip << "); ((char *) m.heap)[T(1)]=T(2) & 0xFF; m.dsp-=2;";
+        break;
+    case Interpreter::MW_READ:
+        os << "NEED(1, " << ip << "); HEAP(T(1), " << ip << "); T(1)=m.heap[T(1)];";
+        break;
+    case Interpreter::MW_READC:
+        os << "NEED(1, " << ip << "); HEAPC(T(1), " << ip << "); T(1)=((char *) m.heap)[T(1)];";
+        break;
+    case Interpreter::MW_TORS:
+        os << "NEED(1, " << ip << "); RROOM(1, " << ip << "); m.rstk[m.rsp++]=m.dstk[--m.dsp];";
+        break;
+    case Interpreter::MW_FROMRS:
+        os << "RNEED(1, " << ip << "); ROOM(1, " << ip << "); PUSH(m.rstk[--m.rsp]);";
+        break;
+    case Interpreter::MW_CPFROMRS:
+        os << "RNEED(1, " << ip << "); ROOM(1, " << ip << "); PUSH(R(1));";
+        break;
+    case Interpreter::MW_RDROP:
+        os << "RNEED(1, " << ip << "); --m.rsp;";
+        break;
+    case Interpreter::MW_RPICK:
+        os << "NEED(1, " << ip << "); CHECK(T(1) < 0 || m.rsp < size_t(1+T(1)), EX_RSTK_UNDER, " << ip << "); "
+           << "T(1)=m.rstk[m.rsp-T(1)-1];";
+        break;
+    case Interpreter::MW_HERE:
+        os << "ROOM(1, " << ip << "); PUSH(0);";
+        break;
+    case Interpreter::MW_SYSCALL1:
+        os << "NEED(1, " << ip << "); T(1)=m.syscalls ? m.syscalls->syscall1(T(1)) : 0;";
+        break;
+    case Interpreter::MW_SYSCALL2:
+        os << "NEED(2, " << ip << "); { fith_cell b=m.dstk[--m.dsp], a=T(1); "
+           << "T(1)=m.syscalls ? m.syscalls->syscall2(a, b) : 0; }";
+        break;
+    case Interpreter::MW_SYSCALL3:
+        os << "NEED(3, " << ip << "); { fith_cell c=m.dstk[--m.dsp], b=m.dstk[--m.dsp], a=T(1); "
+           << "T(1)=m.syscalls ? m.syscalls->syscall3(a, b, c) : 0; }";
+        break;
+    case Interpreter::MW_PLUSLIT:
+        os << "NEED(1, " << ip << "); T(1)+=" << v << ";";
+        break;
+    case Interpreter::MW_ANDLIT:
+        os << "NEED(1, " << ip << "); T(1)&=" << v << ";";
+        break;
+    case Interpreter::MW_ORLIT:
+        os << "NEED(1, " << ip << "); T(1)|=" << v << ";";
+        break;
+    case Interpreter::MW_XORLIT:
+        os << "NEED(1, " << ip << "); T(1)^=" << v << ";";
+        break;
+    case Interpreter::MW_READLIT:
+        os << "ROOM(1, " << ip << "); HEAP(" << v << ", " << next << "); PUSH(m.heap[" << v << "]);";
+        break;
+    case Interpreter::MW_STORELIT:
+        os << "NEED(1, " << ip << "); HEAP(" << v << ", " << next << "); m.heap[" << v << "]=m.dstk[--m.dsp];";
+        break;
+    case Interpreter::MW_READX:
+        os << "NEED(2, " << ip << "); { fith_cell p=T(2)+T(1); HEAP(p, " << ip << "); T(2)=m.heap[p]; --m.dsp; }";
+        break;
+    case Interpreter::MW_STOREX:
+        os << "NEED(3, " << ip << "); { fith_cell p=T(2)+T(1); HEAP(p, " << ip << "); m.heap[p]=T(3); m.dsp-=3; }";
+        break;
+    case Interpreter::MW_READCX:
+        os << "NEED(2, " << ip << "); { fith_cell p=T(2)+T(1); HEAPC(p, " << ip << "); "
+           << "T(2)=((char *) m.heap)[p]; --m.dsp; }";
+        break;
+    case Interpreter::MW_STORECX:
+        os << "NEED(3, " << ip << "); { fith_cell p=T(2)+T(1); HEAPC(p, " << ip << "); "
+           << "((char *) m.heap)[p]=T(3) & 0xFF; m.dsp-=3; }";
+        break;
+    case Interpreter::MW_READINC:
+        os << "NEED(1, " << ip << "); ROOM(1, " << ip << "); HEAP(T(1), " << ip << "); "
+           << "{ fith_cell x=m.heap[T(1)]; ++T(1); PUSH(x); }";
+        break;
+    case Interpreter::MW_STOREINC:
+        os << "NEED(2, " << ip << "); HEAP(T(1), " << ip << "); m.heap[T(1)]=T(2); T(2)=T(1)+1; --m.dsp;";
+        break;
+    case Interpreter::MW_READCINC:
+        os << "NEED(1, " << ip << "); ROOM(1, " << ip << "); HEAPC(T(1), " << ip << "); "
+           << "{ fith_cell x=((char *) m.heap)[T(1)]; ++T(1); PUSH(x); }";
+        break;
+    case Interpreter::MW_STORECINC:
+        os << "NEED(2, " << ip << "); HEAPC(T(1), " << ip << "); ((char *) m.heap)[T(1)]=T(2) & 0xFF; "
+           << "T(2)=T(1)+1; --m.dsp;";
+        break;
+    case Interpreter::MW_FRAME:
+        if(v < 0){
+            os << "FAULT(EX_DSTK_UNDER, " << next << ");";
+            break;
+        }
+        os << "NEED(" << v << ", " << next << "); RROOM(" << v << ", " << next << "); "
+           << "for(int k=" << v << ";k>0;--k) m.rstk[m.rsp++]=T(k); m.dsp-=" << v << ";";
+        break;
+    case Interpreter::MW_UNFRAME:
+        if(v < 0){
+            os << "FAULT(EX_RSTK_UNDER, " << next << ");";
+            break;
+        }
+        os << "RNEED(" << v << ", " << next << "); m.rsp-=" << v << ";";
+        break;
+    case Interpreter::MW_LOCALGET:
+        os << "ROOM(1, " << ip << "); ";
+        if(v < 0){
+            os << "FAULT(EX_RSTK_UNDER, " << next << ");";
+            break;
+        }
+        os << "RNEED(" << v+1 << ", " << next << "); PUSH(R(" << v+1 << "));";
+        break;
+    case Interpreter::MW_LOCALSET:
+        os << "NEED(1, " << ip << "); ";
+        if(v < 0){
+            os << "FAULT(EX_RSTK_UNDER, " << next << ");";
+            break;
+        }
+        os << "RNEED(" << v+1 << ", " << next << "); R(" << v+1 << ")=m.dstk[--m.dsp];";
+        break;
+    case Interpreter::MW_DUPJZ:
+        os << "NEED(1, " << ip << "); if(T(1) == 0) " << label.str();
+        break;
+    case Interpreter::MW_FORTEST:
+        os << "RNEED(2, " << ip << "); ROOM(1, " << ip << "); PUSH((R(1) < R(2)) ? 1 : 0);";
+        break;
+    case Interpreter::MW_RPLUSLIT:
+        os << "RNEED(1, " << ip << "); R(1)+=" << v << ";";
+        break;
+    case Interpreter::MW_DO:
+        os << "NEED(2, " << ip << "); RROOM(2, " << ip << "); "
+           << "m.rstk[m.rsp++]=T(2); m.rstk[m.rsp++]=T(1); m.dsp-=2; if(R(1) >= R(2)) " << label.str();
+        break;
+    case Interpreter::MW_LOOP:
+        os << "RNEED(2, " << ip << "); if(++R(1) < R(2)) " << label.str();
+        break;
+    case Interpreter::MW_PLUSLOOP:
+        os << "NEED(1, " << ip << "); RNEED(2, " << ip << "); R(1)+=m.dstk[--m.dsp]; if(R(1) < R(2)) " << label.str();
+        break;
+    case Interpreter::MW_LOOPI:
+        os << "RNEED(1, " << ip << "); ROOM(1, " << ip << "); PUSH(R(1));";
+        break;
+    case Interpreter::MW_LOOPJ:
+        os << "RNEED(3, " << ip << "); ROOM(1, " << ip << "); PUSH(R(3));";
+        break;
+    default:
+        // select() should not have chosen this function
+        throw logic_error("untranslatable opcode");
+    }
+    os << endl;
+
+    return next;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2){
+        cerr << "usage: " << argv[0] << " file.fith [ENTRYPOINT] > native.cc" << endl;
+        return 1;
+    }
+    string load=argv[1];
+    FithImage image(argc > 2 ? argv[2] : "");
+
+    try{
+        image.read(load);
+    }
+    catch(runtime_error &e){
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    Translator translator(image);
+    translator.select();
+    translator.write(cout, load);
+
+    return 0;
+}
@@ -0,0 +1,239 @@
+/** -*- C++ -*- */
+
+/*
+ * Micro-benchmarks for the interpreter loops.
+ *
+ * Bootstraps a full system, compiles a handful of small loops and times
+ * each of them under every execution mode:
+ *   table      every opcode through the member-function-pointer table
+ *   fast       ip, stack pointers and TOS cached in locals, all checks made
+ *   decoded    as fast, running from the pre-decoded copy of the binary
+ *   proven     as decoded, without stack/IP checks (where the Verifier agrees)
+ *   trusted    as decoded, without stack/IP checks whatever the Verifier says
+ *   sliced     as decoded, but resumed every SLICE backward branches or calls
+ *
+ * Reports the best of several runs, in seconds, since the loops are short
+ * enough to be disturbed by anything else on the machine.
+ *
+ * Then times the compiler itself, which leans on the dictionary: compiling
+ * a large generated program, and DUMPing it (to bindump.txt).
+ *
+ * usage: fithbench [repeats]
+ */
+
+#include "fithi.h"
+#include "fithverify.h"
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <sstream>
+#include <sys/time.h>
+
+using namespace fith;
+using namespace std;
+
+const size_t BINSZ=65536;
+const size_t HEAPSZ=4096;
+const size_t STKSZ=128;
+fith_cell bin[BINSZ];
+Interpreter::Decoded decoded[BINSZ];
+fith_cell heap[HEAPSZ];
+fith_cell dstk[STKSZ], cstk[STKSZ];
+size_t dsp=0, csp=0;
+
+const string BOOTSTRAP_5TH="bootstrap.5th";
+
+/// execution budget for the sliced column
+const size_t SLICE=1000;
+
+/// the benchmarks; each word is ( -- ) and loops about a million times
+const char *BENCH_5TH=
+    ": SQ DUP * ;\n"
+    "VARIABLE X\n"
+    ": B-ARITH 0 1000000 0 FOR I 3 * + 0x55 ^ 1 << 2 SRA ROF DROP ;\n"
+    ": B-STACK 1 2 1000000 0 FOR SWAP DUP ROT + DUP -ROT DROP ROF 2DROP ;\n"
+    ": B-CALL 0 1000000 0 FOR I SQ + ROF DROP ;\n"
+    ": B-WHILE 1000000 BEGIN DUP WHILE 1 - LOOP DROP ;\n"
+    ": B-VAR 0 TO X 1000000 0 FOR X 1 + TO X ROF ;\n"
+    ": B-NEST 0 1000 0 FOR 1000 0 FOR I J + + ROF ROF DROP ;\n"
+    // a 64-bit millisecond clock: tick, time of day, seconds and ms, deadline
+    ": B-TIME 0 0 1000000 0 FOR 40 0 D+ 2DUP 86400000 UM/MOD DROP 1000 /MOD + DROP"
+    " 2DUP 0 1 D< DROP ROF 2DROP ;\n"
+    // running sum over a ring of samples, indexed as base i + @
+    "VARIABLE RING\n"
+    "16 ALLOT TO RING\n"
+    ": B-ARRAY 0 1000000 0 FOR RING I 15 & + @ + I RING I 15 & + ! ROF DROP ;\n";
+
+const char *BENCHES[]={ "B-ARITH", "B-STACK", "B-CALL", "B-WHILE", "B-VAR", "B-NEST", "B-TIME", "B-ARRAY", NULL };
+
+/// words in the generated program
+const int GENWORDS=4000;
+
+/// a program of GENWORDS small words, each calling a couple of earlier ones
+static string generated()
+{
+    ostringstream oss;
+    oss << ": G0 1 + ;\n";
+    for(int i=1;i<GENWORDS;++i){
+        oss << ": G" << i << " DUP G" << i/2 << " SWAP G" << i-1 << " + " << i%7 << " & ;\n";
+    }
+    return oss.str();
+}
+
+/// run QUIT over some source text
+static bool interpret(Interpreter &interp, istream &is)
+{
+    dsp=csp=0;
+    ostringstream discard;
+    Interpreter::Context ctx(interp.find("QUIT"), &dstk[0], &cstk[0], dsp, csp,
+                             STKSZ, STKSZ, interp, &is, &discard);
+    Interpreter::EXEC_RESULT res=ctx.execute();
+    if(res != Interpreter::EX_SUCCESS){
+        ctx.printdump(cerr);
+        return false;
+    }
+    return true;
+}
+
+/// load bootstrap.5th into a fresh system
+static bool bootstrap(Interpreter &interp)
+{
+    ifstream ifs(BOOTSTRAP_5TH.c_str(), ios::in);
+    if(!ifs){
+        cerr << "could not load " << BOOTSTRAP_5TH << endl;
+        return false;
+    }
+    return interpret(interp, ifs);
+}
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec*1e-6;
+}
+
+/**
+ * Time repeated calls of one word.
+ * @param slice execution budget, resuming until done; 0 for none
+ * @return best time in seconds, or negative on failure
+ */
+static double run(Interpreter &interp, fith_cell word, Interpreter::EXEC_MODE mode, int repeats,
+                  size_t slice=0)
+{
+    istringstream none;
+    ostringstream discard;
+    Interpreter::Context ctx(word, &dstk[0], &cstk[0], dsp, csp,
+                             STKSZ, STKSZ, interp, &none, &discard);
+    ctx.set_mode(mode);
+
+    double best=-1;
+    for(int i=0;i<repeats;++i){
+        dsp=csp=0;
+        ctx.set_ip(word);
+
+        double start=now();
+        Interpreter::EXEC_RESULT res;
+        while((res=ctx.execute(slice)) == Interpreter::EX_HALTED){
+        }
+        if(res != Interpreter::EX_SUCCESS){
+            ctx.printdump(cerr);
+            return -1;
+        }
+        double t=now()-start;
+        if(best < 0 || t < best){
+            best=t;
+        }
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    int repeats=argc > 1 ? atoi(argv[1]) : 5;
+
+    Interpreter interp(bin, BINSZ, heap, HEAPSZ);
+
+    istringstream bench(BENCH_5TH);
+    if(!bootstrap(interp) || !interpret(interp, bench)){
+        cerr << "failed to compile benchmarks" << endl;
+        return 1;
+    }
+
+    cout << setw(10) << "word" << setw(10) << "table" << setw(10) << "fast"
+         << setw(10) << "decoded" << setw(10) << "proven" << setw(10) << "trusted"
+         << setw(10) << "sliced" << setw(10) << "speedup" << endl;
+
+    for(const char **b=BENCHES;*b;++b){
+        fith_cell word=interp.find(*b);
+
+        // prove just this word (and whatever it calls)
+        Verifier verifier(bin);
+        verifier.verify(word);
+
+        interp.setProofs(NULL, 0);
+        double table=run(interp, word, Interpreter::EXEC_TABLE, repeats);
+        double fast=run(interp, word, Interpreter::EXEC_FAST, repeats);
+        interp.setDecoded(decoded);
+        double predec=run(interp, word, Interpreter::EXEC_FAST, repeats);
+        interp.setProofs(verifier.proofs(), verifier.count());
+        bool proven=interp.proven(word, 0, STKSZ, STKSZ);
+        double unchecked=proven ? run(interp, word, Interpreter::EXEC_FAST, repeats) : 0;
+        interp.setProofs(NULL, 0);
+        double trusted=run(interp, word, Interpreter::EXEC_TRUSTED, repeats);
+        double sliced=run(interp, word, Interpreter::EXEC_FAST, repeats, SLICE);
+        interp.setDecoded(NULL);
+
+        if(table < 0 || fast < 0 || predec < 0 || unchecked < 0 || trusted < 0 || sliced < 0){
+            return 1;
+        }
+
+        double best=trusted;
+        cout << setw(10) << *b << fixed << setprecision(3)
+             << setw(10) << table << setw(10) << fast << setw(10) << predec;
+        if(proven){
+            cout << setw(10) << unchecked;
+        }
+        else{
+            cout << setw(10) << "-";
+        }
+        cout << setw(10) << trusted << setw(10) << sliced;
+        cout << setw(9) << setprecision(2) << table/best << "x" << endl;
+    }
+
+    // the compiler, from a freshly bootstrapped system each time
+    const string gen=generated();
+    double compile=-1, dump=-1;
+    for(int i=0;i<repeats;++i){
+        Interpreter ci(bin, BINSZ, heap, HEAPSZ);
+        if(!bootstrap(ci)){
+            return 1;
+        }
+        istringstream src(gen), cmd("DUMP\n");
+
+        double start=now();
+        if(!interpret(ci, src)){
+            return 1;
+        }
+        double t=now()-start;
+        if(compile < 0 || t < compile){
+            compile=t;
+        }
+
+        start=now();
+        if(!interpret(ci, cmd)){
+            return 1;
+        }
+        t=now()-start;
+        if(dump < 0 || t < dump){
+            dump=t;
+        }
+    }
+    cout << endl << setprecision(3) << setw(10) << "compile" << setw(10) << compile
+         << "  (" << GENWORDS << " words)" << endl
+         << setw(10) << "DUMP" << setw(10) << dump << endl;
+
+    return 0;
+}
@@ -2,6 +2,8 @@
 #include "fithfile.h"
 #include <stdexcept>
 #include <cassert>
+#include <fstream>
+#include <sstream>
 
 using namespace std;
 
@@ -38,6 +40,16 @@ void FithOutFile::writeConfig(fith_cell *pcell)
 }
 
 void FithOutFile::writeMap(const string &str)
+{
+    writeString(SEG_MAP, str);
+}
+
+void FithOutFile::writeSnapshot(const string &state)
+{
+    writeString(SEG_SNAPSHOT, state);
+}
+
+void FithOutFile::writeString(unsigned kind, const string &str)
 {
     unsigned len=str.length();
 
@@ -47,7 +59,7 @@ void FithOutFile::writeMap(const string &str)
     memset(pstr, 0, words*4);
     memcpy(pstr, str.c_str(), len);
 
-    writeSegment(SEG_MAP, pstr, words+1);
+    writeSegment(kind, pstr, words+1);
     delete[] pstr;
 }
 
@@ -139,4 +151,89 @@ void FithInFile::checkRead(std::istream &is, CRC32STM &crc, unsigned *data, unsi
     crc.insert(data, wordcount);
 }
 
+FithImage::FithImage(const string &entname)
+    : entry(-1), entryname(entname)
+{
+}
+
+void FithImage::read(const string &filename)
+{
+    ifstream ifs(filename.c_str(), ios::in);
+    if(!ifs){
+        throw runtime_error(string("Can't open ")+filename);
+    }
+    FithInFile::readFile(ifs, *this);
+
+    if(text.empty() || data.empty() || entry < 0){
+        throw runtime_error(filename+" is incomplete, or has no such entry-point");
+    }
+}
+
+void FithImage::onHeader(unsigned binver, unsigned iover)
+{
+    if(binver != Interpreter::BINVERSION){
+        throw runtime_error("Invalid BINVERSION");
+    }
+    if(iover != Interpreter::IOVERSION){
+        throw runtime_error("Invalid IOVERSION");
+    }
+}
+
+void FithImage::onSegment(FithOutFile::SEGTYPES kind, fith_cell *pcell, unsigned count)
+{
+    switch(kind){
+    case FithOutFile::SEG_TEXT:
+        load(text, pcell, count);
+        break;
+    case FithOutFile::SEG_DATA:
+        load(data, pcell, count);
+        break;
+    case FithOutFile::SEG_ENTRY:
+        if(entryname.length() == 0 && count == 2){
+            entry=pcell[0];
+        }
+        break;
+    case FithOutFile::SEG_MAP:
+        parseMap(pcell, count);
+        break;
+    case FithOutFile::SEG_SNAPSHOT:
+        snapshot=getString(pcell, count);
+        break;
+    default:
+        break;
+    }
+}
+
+void FithImage::load(vector<fith_cell> &seg, fith_cell *pcell, unsigned count)
+{
+    // first cell is the count, as per the loaders
+    seg.assign(pcell, pcell+count-1);
+    seg.insert(seg.begin(), fith_cell(count));
+}
+
+string FithImage::getString(fith_cell *pcell, unsigned count)
+{
+    // don't want to include the header-size
+    --count;
+
+    char *pstr=(char *) pcell;
+    if(count == 0 || pstr[count*4-1] != '\0'){
+        throw runtime_error("bad string termination in segment");
+    }
+    return string(pstr);
+}
+
+void FithImage::parseMap(fith_cell *pcell, unsigned count)
+{
+    istringstream iss(getString(pcell, count));
+    unsigned long addr;
+    string word;
+    while(iss >> hex >> addr >> word){
+        names[fith_cell(addr)]=word;
+        if(word == entryname){
+            entry=fith_cell(addr);
+        }
+    }
+}
+
 } // namespace fith
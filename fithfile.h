@@ -4,6 +4,8 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
+#include <map>
 #include "crc.h"
 #include "fithi.h"
 
@@ -30,6 +32,8 @@ public:
     void writeMap(const std::string &mapstr);
     /// write a program-entry tag
     void writeEntry(fith_cell root);
+    /// write the compiler state of a bootstrap snapshot (Interpreter::snapshot)
+    void writeSnapshot(const std::string &state);
     /// append a CRC segment
     void writeCrc();
 
@@ -39,6 +43,7 @@ public:
         SEG_CONFIG=0x103,
         SEG_ENTRY=0x104,
         SEG_MAP=0x105,
+        SEG_SNAPSHOT=0x106,
 
         SEG_CRC=0x110,
     };
@@ -47,6 +52,8 @@ private:
 
     /// generic segment
     void writeSegment(unsigned kind, fith_cell *pcell, unsigned count);
+    /// segment holding a NUL-terminated string
+    void writeString(unsigned kind, const std::string &str);
 
     struct header {
         unsigned magic;
@@ -94,6 +101,39 @@ private:
     static void checkRead(std::istream &is, CRC32STM &crc, unsigned *data, unsigned wordcount);
 };
 
+/**
+ * A whole saved program read into memory, for tools that work on the
+ * binary rather than running it.
+ */
+class FithImage : public FithInFile::SegmentHandler {
+public:
+
+    /// @param entname name of the entry-point (looked up in the map), else use the ENTRY segment
+    explicit FithImage(const std::string &entname="");
+
+    /// read a file; throws runtime_error if it's unreadable or incomplete
+    void read(const std::string &filename);
+
+    virtual void onHeader(unsigned binver, unsigned iover);
+    virtual void onSegment(FithOutFile::SEGTYPES kind, fith_cell *pcell, unsigned count);
+
+    typedef std::map<fith_cell, std::string> names_t;
+
+    std::vector<fith_cell> text;    ///< TEXT segment as it would be loaded, first cell is HERE
+    std::vector<fith_cell> data;    ///< DATA segment, likewise
+    fith_cell entry;                ///< entry-point, or -1
+    names_t names;                  ///< function names from the map, by address
+    std::string snapshot;           ///< SNAPSHOT segment, if any
+
+private:
+
+    static void load(std::vector<fith_cell> &seg, fith_cell *pcell, unsigned count);
+    void parseMap(fith_cell *pcell, unsigned count);
+    static std::string getString(fith_cell *pcell, unsigned count);
+
+    std::string entryname;
+};
+
 } // namespace fith
 
 #endif  // _FITHFILE_H_
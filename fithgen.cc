@@ -0,0 +1,184 @@
+/** -*- C++ -*- */
+
+/*
+ * Generate a minimal runtime for one saved binary.
+ *
+ * Reads a .fith file, works out which opcodes its TEXT segment can
+ * execute and writes (to stdout) a C++ translation unit containing:
+ *   - Context::builtin, with only those handlers; every other opcode
+ *     maps to mw_badop, i.e. EX_BAD_OPCODE
+ *   - the TEXT and DATA segments as arrays (fithtext, fithdata), with
+ *     their sizes, and the entry-point (fithmain)
+ *
+ * Compile that with fithi.cc and main.cc under -DFITH_MINIMAL, and link
+ * with --gc-sections, to get an interpreter carrying only the handlers
+ * the program uses (see "make fithmin").
+ *
+ * Opcodes are found by walking the code as the Verifier does.  If the
+ * program uses EXECUTE, any literal or DATA cell that looks like an
+ * opcode is counted too, since it may end up being called.
+ *
+ * usage: fithgen file.fith [ENTRYPOINT] > runtime.cc
+ */
+
+#include "fithi.h"
+#include "fithfile.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+using namespace fith;
+using namespace std;
+
+/// minimum heap for the runtime, as per main.cc
+const size_t HEAPSZ=128;
+
+// flag bits and address mask, as per Interpreter
+const fith_cell FLAG_MACHINE=0x80000000;
+const fith_cell FLAG_ADDR=0x1FFFFFFF;
+
+/// mark a cell that may be an opcode
+static void mark_opcode(vector<bool> &used, fith_cell cell)
+{
+    if((cell & FLAG_MACHINE) != 0 && (cell & FLAG_ADDR) < Interpreter::MW_INTERP_COUNT){
+        used[cell & FLAG_ADDR]=true;
+    }
+}
+
+/**
+ * Find the opcodes that the code could execute.
+ */
+static vector<bool> find_opcodes(const vector<fith_cell> &text, const vector<fith_cell> &data)
+{
+    vector<bool> used(Interpreter::MW_INTERP_COUNT, false);
+    vector<fith_cell> lits;
+    fith_cell here=text[0];
+
+    for(fith_cell i=1;i<here;++i){
+        fith_cell cell=text[i];
+        if((cell & FLAG_MACHINE) == 0){
+            // call
+            continue;
+        }
+
+        cell &= FLAG_ADDR;
+        if(cell >= Interpreter::MW_INTERP_COUNT){
+            continue;
+        }
+        used[cell]=true;
+
+        fith_cell n=Interpreter::operands(&text[i], here-i);
+        if(i+n >= here){
+            break;
+        }
+        if(cell == Interpreter::MW_TICK || cell == Interpreter::MW_LIT){
+            lits.push_back(text[i+1]);
+        }
+        i+=n;
+    }
+
+    if(used[Interpreter::MW_CALL]){
+        // anything that looks like an opcode may be EXECUTEd
+        for(size_t i=0;i<lits.size();++i){
+            mark_opcode(used, lits[i]);
+        }
+        for(size_t i=1;i<data.size();++i){
+            mark_opcode(used, data[i]);
+        }
+    }
+
+    return used;
+}
+
+/// write an array of cells, zero-padded to size
+static void write_cells(ostream &os, const vector<fith_cell> &seg, size_t size)
+{
+    for(size_t i=0;i<size;++i){
+        os << ((i%8 == 0) ? "    " : " ")
+           << setw(11) << (i < seg.size() ? seg[i] : 0)
+           << ((i+1 < size) ? "," : "")
+           << ((i%8 == 7 || i+1 == size) ? "\n" : "");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2){
+        cerr << "usage: " << argv[0] << " file.fith [ENTRYPOINT] > runtime.cc" << endl;
+        return 1;
+    }
+    string load=argv[1];
+    FithImage image(argc > 2 ? argv[2] : "");
+
+    try{
+        image.read(load);
+    }
+    catch(runtime_error &e){
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    vector<bool> used=find_opcodes(image.text, image.data);
+    unsigned count=0;
+    for(fith_cell i=0;i<Interpreter::MW_INTERP_COUNT;++i){
+        if(!used[i]){
+            continue;
+        }
+        if(i >= Interpreter::MW_STORECODE){
+            cerr << load << " uses " << Interpreter::handlers[i]
+                 << ", which the embedded interpreter does not have" << endl;
+            return 1;
+        }
+        ++count;
+    }
+
+    cout << "/** -*- C++ -*- */" << endl
+         << endl
+         << "/*" << endl
+         << " * Minimal runtime for " << load << ", generated by fithgen: do not edit." << endl
+         << " * Uses " << count << " of " << Interpreter::MW_STORECODE << " opcodes." << endl
+         << " */" << endl
+         << endl
+         << "#include \"fithi.h\"" << endl
+         << endl
+         << "namespace fith {" << endl
+         << endl
+         << "const Interpreter::Context::machineword_t Interpreter::Context::builtin[Interpreter::MW_INTERP_COUNT]={" << endl;
+    for(fith_cell i=0;i<Interpreter::MW_STORECODE;++i){
+        string entry="&Interpreter::Context::"+(used[i] ? Interpreter::handlers[i] : string("mw_badop"))
+            +((i+1 < Interpreter::MW_STORECODE) ? "," : "");
+        if(used[i]){
+            cout << "    " << entry << endl;
+        }
+        else{
+            cout << "    " << left << setw(40) << entry << right << "// " << Interpreter::handlers[i] << endl;
+        }
+    }
+    cout << "};" << endl
+         << endl
+         << "} // namespace fith" << endl
+         << endl;
+
+    cout << "/// TEXT segment; the first cell is the number in use" << endl
+         << "extern const fith::fith_cell fithtext[]={" << endl;
+    write_cells(cout, image.text, image.text.size());
+    cout << "};" << endl
+         << "extern const std::size_t fithtextsz=sizeof(fithtext)/sizeof(fithtext[0]);" << endl
+         << endl;
+
+    size_t heapsz=image.data.size() > HEAPSZ ? image.data.size() : HEAPSZ;
+    cout << "/// DATA segment and the rest of the heap; the first cell is the number in use" << endl
+         << "fith::fith_cell fithdata[]={" << endl;
+    write_cells(cout, image.data, heapsz);
+    cout << "};" << endl
+         << "extern const std::size_t fithdatasz=sizeof(fithdata)/sizeof(fithdata[0]);" << endl
+         << endl
+         << "/// entry point" << endl
+         << "extern const fith::fith_cell fithmain=" << image.entry << ";" << endl;
+
+    return 0;
+}
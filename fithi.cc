@@ -17,22 +17,38 @@
 */
 
 #include "fithi.h"
+#include "crc.h"
 #include <cstdlib>
 #ifdef FULLFITH
+#include <cstdio>
 #include <iostream>
 #include <iomanip>
 #include <fstream>
 #include <sstream>
 #include <stdexcept>
 #include <set>
+#include <vector>
+#include <algorithm>
 #include <cassert>
 #include "fithfile.h"
+#include "fithverify.h"
+#include <cctype>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(FITH_MINIMAL) && (defined(FULLFITH) || defined(FITH_THREADED))
+#error "a minimal runtime is embedded-only, and runs only its table of handlers"
 #endif
 
 using namespace std;
 
 namespace fith {
 
+#ifndef FITH_MINIMAL
+// a minimal runtime supplies its own table, as generated by fithgen
 const Interpreter::Context::machineword_t Interpreter::Context::builtin[Interpreter::MW_INTERP_COUNT]={
     &Interpreter::Context::mw_exit,
     &Interpreter::Context::mw_lit,
@@ -82,12 +98,83 @@ const Interpreter::Context::machineword_t Interpreter::Context::builtin[Interpre
     &Interpreter::Context::mw_syscall1,
     &Interpreter::Context::mw_syscall2,
     &Interpreter::Context::mw_syscall3,
+    &Interpreter::Context::mw_pluslit,
+    &Interpreter::Context::mw_readlit,
+    &Interpreter::Context::mw_dupjz,
+    &Interpreter::Context::mw_fortest,
+    &Interpreter::Context::mw_rpluslit,
+    &Interpreter::Context::mw_andlit,
+    &Interpreter::Context::mw_orlit,
+    &Interpreter::Context::mw_xorlit,
+    &Interpreter::Context::mw_do,
+    &Interpreter::Context::mw_loop,
+    &Interpreter::Context::mw_plusloop,
+    &Interpreter::Context::mw_loopi,
+    &Interpreter::Context::mw_loopj,
+    &Interpreter::Context::mw_move,
+    &Interpreter::Context::mw_movec,
+    &Interpreter::Context::mw_fill,
+    &Interpreter::Context::mw_fillc,
+    &Interpreter::Context::mw_compare,
+    &Interpreter::Context::mw_comparec,
+    &Interpreter::Context::mw_scan,
+    &Interpreter::Context::mw_scanc,
+    &Interpreter::Context::mw_strlen,
+    &Interpreter::Context::mw_strread,
+    &Interpreter::Context::mw_strwrite,
+    &Interpreter::Context::mw_strcmp,
+    &Interpreter::Context::mw_strcat,
+    &Interpreter::Context::mw_emit,
+    &Interpreter::Context::mw_type,
+    &Interpreter::Context::mw_tell,
+    &Interpreter::Context::mw_flush,
+    &Interpreter::Context::mw_btst,
+    &Interpreter::Context::mw_bset,
+    &Interpreter::Context::mw_bclr,
+    &Interpreter::Context::mw_btgl,
+    &Interpreter::Context::mw_bfx,
+    &Interpreter::Context::mw_bfi,
+    &Interpreter::Context::mw_popcnt,
+    &Interpreter::Context::mw_ffs,
+    &Interpreter::Context::mw_dplus,
+    &Interpreter::Context::mw_dminus,
+    &Interpreter::Context::mw_mstar,
+    &Interpreter::Context::mw_umdivmod,
+    &Interpreter::Context::mw_dlt,
+    &Interpreter::Context::mw_deq,
+    &Interpreter::Context::mw_qmul,
+    &Interpreter::Context::mw_qdiv,
+    &Interpreter::Context::mw_sqrt,
+    &Interpreter::Context::mw_min,
+    &Interpreter::Context::mw_max,
+    &Interpreter::Context::mw_clamp,
+    &Interpreter::Context::mw_interp,
+    &Interpreter::Context::mw_ton,
+    &Interpreter::Context::mw_tof,
+    &Interpreter::Context::mw_tp,
+    &Interpreter::Context::mw_ctu,
+    &Interpreter::Context::mw_ctd,
+    &Interpreter::Context::mw_rtrig,
+    &Interpreter::Context::mw_ftrig,
+    &Interpreter::Context::mw_case,
+    &Interpreter::Context::mw_storelit,
+    &Interpreter::Context::mw_readx,
+    &Interpreter::Context::mw_storex,
+    &Interpreter::Context::mw_readcx,
+    &Interpreter::Context::mw_storecx,
+    &Interpreter::Context::mw_readinc,
+    &Interpreter::Context::mw_storeinc,
+    &Interpreter::Context::mw_readcinc,
+    &Interpreter::Context::mw_storecinc,
+    &Interpreter::Context::mw_frame,
+    &Interpreter::Context::mw_unframe,
+    &Interpreter::Context::mw_localget,
+    &Interpreter::Context::mw_localset,
 #ifdef FULLFITH
     &Interpreter::Context::mw_storecode,
     &Interpreter::Context::mw_readcode,
     &Interpreter::Context::mw_comma,    
     &Interpreter::Context::mw_key,
-    &Interpreter::Context::mw_emit,
     &Interpreter::Context::mw_word,
     &Interpreter::Context::mw_eof,
     &Interpreter::Context::mw_number,
@@ -104,11 +191,166 @@ const Interpreter::Context::machineword_t Interpreter::Context::builtin[Interpre
     &Interpreter::Context::mw_dump,
     &Interpreter::Context::mw_save,
     &Interpreter::Context::mw_gc,
-    &Interpreter::Context::mw_include
+    &Interpreter::Context::mw_include,
+    &Interpreter::Context::mw_fuse,
+    &Interpreter::Context::mw_local,
+    &Interpreter::Context::mw_findlocal,
+    &Interpreter::Context::mw_endlocals,
+    &Interpreter::Context::mw_depth
 #endif
 };
+#endif
 
 #ifdef FULLFITH
+const string Interpreter::handlers[MW_INTERP_COUNT]={
+    "mw_exit",
+    "mw_lit",
+    "mw_tick",
+    "mw_plus",
+    "mw_minus",
+    "mw_neg",
+    "mw_mul",
+    "mw_div",
+    "mw_mod",
+    "mw_muldiv",
+    "mw_divmod",
+    "mw_mulmod",
+    "mw_jmp",
+    "mw_jz",
+    "mw_call",
+    "mw_lt",
+    "mw_gt",
+    "mw_le",
+    "mw_ge",
+    "mw_eq",
+    "mw_dup",
+    "mw_dupnz",
+    "mw_drop",
+    "mw_swap",
+    "mw_rot",
+    "mw_nrot",
+    "mw_pick",
+    "mw_roll",
+    "mw_and",
+    "mw_or",
+    "mw_xor",
+    "mw_invert",
+    "mw_sl",
+    "mw_sra",
+    "mw_srl",
+    "mw_store",
+    "mw_storec",
+    "mw_read",
+    "mw_readc",
+    "mw_tors",
+    "mw_fromrs",
+    "mw_cpfromrs",
+    "mw_rdrop",
+    "mw_rpick",
+    "mw_here",
+    "mw_syscall1",
+    "mw_syscall2",
+    "mw_syscall3",
+    "mw_pluslit",
+    "mw_readlit",
+    "mw_dupjz",
+    "mw_fortest",
+    "mw_rpluslit",
+    "mw_andlit",
+    "mw_orlit",
+    "mw_xorlit",
+    "mw_do",
+    "mw_loop",
+    "mw_plusloop",
+    "mw_loopi",
+    "mw_loopj",
+    "mw_move",
+    "mw_movec",
+    "mw_fill",
+    "mw_fillc",
+    "mw_compare",
+    "mw_comparec",
+    "mw_scan",
+    "mw_scanc",
+    "mw_strlen",
+    "mw_strread",
+    "mw_strwrite",
+    "mw_strcmp",
+    "mw_strcat",
+    "mw_emit",
+    "mw_type",
+    "mw_tell",
+    "mw_flush",
+    "mw_btst",
+    "mw_bset",
+    "mw_bclr",
+    "mw_btgl",
+    "mw_bfx",
+    "mw_bfi",
+    "mw_popcnt",
+    "mw_ffs",
+    "mw_dplus",
+    "mw_dminus",
+    "mw_mstar",
+    "mw_umdivmod",
+    "mw_dlt",
+    "mw_deq",
+    "mw_qmul",
+    "mw_qdiv",
+    "mw_sqrt",
+    "mw_min",
+    "mw_max",
+    "mw_clamp",
+    "mw_interp",
+    "mw_ton",
+    "mw_tof",
+    "mw_tp",
+    "mw_ctu",
+    "mw_ctd",
+    "mw_rtrig",
+    "mw_ftrig",
+    "mw_case",
+    "mw_storelit",
+    "mw_readx",
+    "mw_storex",
+    "mw_readcx",
+    "mw_storecx",
+    "mw_readinc",
+    "mw_storeinc",
+    "mw_readcinc",
+    "mw_storecinc",
+    "mw_frame",
+    "mw_unframe",
+    "mw_localget",
+    "mw_localset",
+    "mw_storecode",
+    "mw_readcode",
+    "mw_comma",
+    "mw_key",
+    "mw_word",
+    "mw_eof",
+    "mw_number",
+    "mw_dot",
+    "mw_create",
+    "mw_find",
+    "mw_latest",
+    "mw_immediate",
+    "mw_hidden",
+    "mw_lbrac",
+    "mw_rbrac",
+    "mw_state",
+    "mw_interpret",
+    "mw_dump",
+    "mw_save",
+    "mw_gc",
+    "mw_include",
+    "mw_fuse",
+    "mw_local",
+    "mw_findlocal",
+    "mw_endlocals",
+    "mw_depth"
+};
+
 const string Interpreter::opcodes[MW_INTERP_COUNT]={
     "EXIT",
     "LIT",
@@ -158,12 +400,83 @@ const string Interpreter::opcodes[MW_INTERP_COUNT]={
     "SYSCALL1",
     "SYSCALL2",
     "SYSCALL3",
+    "+LIT",
+    "@LIT",
+    "DUPJZ",
+    "(FOR)",
+    "R+LIT",
+    "&LIT",
+    "|LIT",
+    "^LIT",
+    "(DO)",
+    "(LOOP)",
+    "(+LOOP)",
+    "I",
+    "J",
+    "MOVE",
+    "MOVEC",
+    "FILL",
+    "FILLC",
+    "COMPARE",
+    "COMPAREC",
+    "SCAN",
+    "SCANC",
+    "STRLEN",
+    "[@]",
+    "[!]",
+    "STRCMP",
+    "STRCAT",
+    "EMIT",
+    "TYPE",
+    "TELL",
+    "FLUSH",
+    "BTST",
+    "BSET",
+    "BCLR",
+    "BTGL",
+    "BFX",
+    "BFI",
+    "POPCNT",
+    "FFS",
+    "D+",
+    "D-",
+    "M*",
+    "UM/MOD",
+    "D<",
+    "D=",
+    "Q*",
+    "Q/",
+    "SQRT",
+    "MIN",
+    "MAX",
+    "CLAMP",
+    "INTERP",
+    "TON",
+    "TOF",
+    "TP",
+    "CTU",
+    "CTD",
+    "R_TRIG",
+    "F_TRIG",
+    "(CASE)",
+    "!LIT",
+    "@X",
+    "!X",
+    "@CX",
+    "!CX",
+    "@+",
+    "!+",
+    "@C+",
+    "!C+",
+    "(FRAME)",
+    "(UNFRAME)",
+    "(L@)",
+    "(L!)",
 
     "C!",
     "C@",
     ",",
     "KEY",
-    "EMIT",
     "WORD",
     "EOF",
     "NUMBER",
@@ -180,7 +493,12 @@ const string Interpreter::opcodes[MW_INTERP_COUNT]={
     "DUMP",
     "SAVE",
     "GC",
-    "_INCLUDE"
+    "_INCLUDE",
+    "FUSE",
+    "LOCAL",
+    "FINDLOCAL",
+    "ENDLOCALS",
+    "DEPTH"
 };
 
 const string Interpreter::states[EX_INTERP_COUNT]={
@@ -199,10 +517,204 @@ const string Interpreter::states[EX_INTERP_COUNT]={
 
 #endif
 
-Interpreter::Interpreter(fith_cell *_bin, size_t _binsz, fith_cell *_heap, size_t _heapsz, bool bs)
+const Interpreter::OpInfo Interpreter::opinfo[MW_INTERP_COUNT]={
+    // din dout rin rout operands flags
+    { 0, 0, 0, 0, 0, OPF_EXIT },                // EXIT
+    { 0, 1, 0, 0, 1, 0 },                       // LIT
+    { 0, 1, 0, 0, 1, 0 },                       // '
+    { 2, 1, 0, 0, 0, 0 },                       // +
+    { 2, 1, 0, 0, 0, 0 },                       // -
+    { 1, 1, 0, 0, 0, 0 },                       // NEGATE
+    { 2, 1, 0, 0, 0, 0 },                       // *
+    { 2, 1, 0, 0, 0, 0 },                       // /
+    { 2, 1, 0, 0, 0, 0 },                       // MOD
+    { 3, 1, 0, 0, 0, 0 },                       // */
+    { 2, 2, 0, 0, 0, 0 },                       // /MOD
+    { 3, 2, 0, 0, 0, 0 },                       // */MOD
+    { 0, 0, 0, 0, 1, OPF_BRANCH | OPF_JUMP },   // JMP
+    { 1, 0, 0, 0, 1, OPF_BRANCH },              // JZ
+    { 1, 0, 0, 0, 0, OPF_UNSAFE },              // EXECUTE
+    { 2, 1, 0, 0, 0, 0 },                       // <
+    { 2, 1, 0, 0, 0, 0 },                       // >
+    { 2, 1, 0, 0, 0, 0 },                       // <=
+    { 2, 1, 0, 0, 0, 0 },                       // >=
+    { 2, 1, 0, 0, 0, 0 },                       // =
+    { 1, 2, 0, 0, 0, 0 },                       // DUP
+    { 1, 2, 0, 0, 0, OPF_UNSAFE },              // ?DUP (data-dependent depth)
+    { 1, 0, 0, 0, 0, 0 },                       // DROP
+    { 2, 2, 0, 0, 0, 0 },                       // SWAP
+    { 3, 3, 0, 0, 0, 0 },                       // ROT
+    { 3, 3, 0, 0, 0, 0 },                       // -ROT
+    { 1, 1, 0, 0, 0, 0 },                       // PICK
+    { 1, 0, 0, 0, 0, 0 },                       // ROLL
+    { 2, 1, 0, 0, 0, 0 },                       // &
+    { 2, 1, 0, 0, 0, 0 },                       // |
+    { 2, 1, 0, 0, 0, 0 },                       // ^
+    { 1, 1, 0, 0, 0, 0 },                       // ~
+    { 2, 1, 0, 0, 0, 0 },                       // <<
+    { 2, 1, 0, 0, 0, 0 },                       // SRA
+    { 2, 1, 0, 0, 0, 0 },                       // >>
+    { 2, 0, 0, 0, 0, 0 },                       // !
+    { 2, 0, 0, 0, 0, 0 },                       // !C
+    { 1, 1, 0, 0, 0, 0 },                       // @
+    { 1, 1, 0, 0, 0, 0 },                       // @C
+    { 1, 0, 0, 1, 0, 0 },                       // >R
+    { 0, 1, 1, 0, 0, 0 },                       // R>
+    { 0, 1, 1, 1, 0, 0 },                       // R@
+    { 0, 0, 1, 0, 0, 0 },                       // RDROP
+    { 1, 1, 0, 0, 0, 0 },                       // RPICK
+    { 0, 1, 0, 0, 0, 0 },                       // HERE
+    { 1, 1, 0, 0, 0, 0 },                       // SYSCALL1
+    { 2, 1, 0, 0, 0, 0 },                       // SYSCALL2
+    { 3, 1, 0, 0, 0, 0 },                       // SYSCALL3
+    { 1, 1, 0, 0, 1, 0 },                       // +LIT
+    { 0, 1, 0, 0, 1, 0 },                       // @LIT
+    { 1, 1, 0, 0, 1, OPF_BRANCH },              // DUPJZ
+    { 0, 1, 2, 2, 0, 0 },                       // (FOR)
+    { 0, 0, 1, 1, 1, 0 },                       // R+LIT
+    { 1, 1, 0, 0, 1, 0 },                       // &LIT
+    { 1, 1, 0, 0, 1, 0 },                       // |LIT
+    { 1, 1, 0, 0, 1, 0 },                       // ^LIT
+    { 2, 0, 0, 2, 1, OPF_BRANCH },              // (DO)
+    { 0, 0, 2, 2, 1, OPF_BRANCH },              // (LOOP)
+    { 1, 0, 2, 2, 1, OPF_BRANCH },              // (+LOOP)
+    { 0, 1, 1, 1, 0, 0 },                       // I
+    { 0, 1, 3, 3, 0, 0 },                       // J
+    { 3, 0, 0, 0, 0, 0 },                       // MOVE
+    { 3, 0, 0, 0, 0, 0 },                       // MOVEC
+    { 3, 0, 0, 0, 0, 0 },                       // FILL
+    { 3, 0, 0, 0, 0, 0 },                       // FILLC
+    { 3, 1, 0, 0, 0, 0 },                       // COMPARE
+    { 3, 1, 0, 0, 0, 0 },                       // COMPAREC
+    { 3, 1, 0, 0, 0, 0 },                       // SCAN
+    { 3, 1, 0, 0, 0, 0 },                       // SCANC
+    { 1, 1, 0, 0, 0, 0 },                       // STRLEN
+    { 2, 1, 0, 0, 0, 0 },                       // [@]
+    { 3, 0, 0, 0, 0, 0 },                       // [!]
+    { 2, 1, 0, 0, 0, 0 },                       // STRCMP
+    { 2, 1, 0, 0, 0, 0 },                       // STRCAT
+    { 1, 0, 0, 0, 0, 0 },                       // EMIT
+    { 2, 0, 0, 0, 0, 0 },                       // TYPE
+    { 1, 0, 0, 0, 0, 0 },                       // TELL
+    { 0, 0, 0, 0, 0, 0 },                       // FLUSH
+    { 2, 1, 0, 0, 0, 0 },                       // BTST
+    { 2, 1, 0, 0, 0, 0 },                       // BSET
+    { 2, 1, 0, 0, 0, 0 },                       // BCLR
+    { 2, 1, 0, 0, 0, 0 },                       // BTGL
+    { 3, 1, 0, 0, 0, 0 },                       // BFX
+    { 4, 1, 0, 0, 0, 0 },                       // BFI
+    { 1, 1, 0, 0, 0, 0 },                       // POPCNT
+    { 1, 1, 0, 0, 0, 0 },                       // FFS
+    { 4, 2, 0, 0, 0, 0 },                       // D+
+    { 4, 2, 0, 0, 0, 0 },                       // D-
+    { 2, 2, 0, 0, 0, 0 },                       // M*
+    { 3, 2, 0, 0, 0, 0 },                       // UM/MOD
+    { 4, 1, 0, 0, 0, 0 },                       // D<
+    { 4, 1, 0, 0, 0, 0 },                       // D=
+    { 2, 1, 0, 0, 0, 0 },                       // Q*
+    { 2, 1, 0, 0, 0, 0 },                       // Q/
+    { 1, 1, 0, 0, 0, 0 },                       // SQRT
+    { 2, 1, 0, 0, 0, 0 },                       // MIN
+    { 2, 1, 0, 0, 0, 0 },                       // MAX
+    { 3, 1, 0, 0, 0, 0 },                       // CLAMP
+    { 2, 1, 0, 0, 0, 0 },                       // INTERP
+    { 3, 1, 0, 0, 0, 0 },                       // TON
+    { 3, 1, 0, 0, 0, 0 },                       // TOF
+    { 3, 1, 0, 0, 0, 0 },                       // TP
+    { 4, 1, 0, 0, 0, 0 },                       // CTU
+    { 4, 1, 0, 0, 0, 0 },                       // CTD
+    { 2, 1, 0, 0, 0, 0 },                       // R_TRIG
+    { 2, 1, 0, 0, 0, 0 },                       // F_TRIG
+    { 1, 0, 0, 0, 2, OPF_JUMP | OPF_TABLE },    // (CASE)
+    { 1, 0, 0, 0, 1, 0 },                       // !LIT
+    { 2, 1, 0, 0, 0, 0 },                       // @X
+    { 3, 0, 0, 0, 0, 0 },                       // !X
+    { 2, 1, 0, 0, 0, 0 },                       // @CX
+    { 3, 0, 0, 0, 0, 0 },                       // !CX
+    { 1, 2, 0, 0, 0, 0 },                       // @+
+    { 2, 1, 0, 0, 0, 0 },                       // !+
+    { 1, 2, 0, 0, 0, 0 },                       // @C+
+    { 2, 1, 0, 0, 0, 0 },                       // !C+
+    { 1, 0, 0, 1, 1, OPF_COUNT },               // (FRAME)
+    { 0, 0, 1, 0, 1, OPF_COUNT },               // (UNFRAME)
+    { 0, 1, 1, 1, 1, OPF_RINDEX },              // (L@)
+    { 1, 0, 1, 1, 1, OPF_RINDEX },              // (L!)
+#ifdef FULLFITH
+    { 2, 0, 0, 0, 0, OPF_UNSAFE },              // C!
+    { 1, 1, 0, 0, 0, 0 },                       // C@
+    { 1, 0, 0, 0, 0, OPF_UNSAFE },              // ,
+    { 0, 1, 0, 0, 0, 0 },                       // KEY
+    { 0, 1, 0, 0, 0, 0 },                       // WORD
+    { 0, 1, 0, 0, 0, 0 },                       // EOF
+    { 1, 2, 0, 0, 0, 0 },                       // NUMBER
+    { 1, 0, 0, 0, 0, 0 },                       // .
+    { 2, 0, 0, 0, 0, 0 },                       // CREATE
+    { 1, 1, 0, 0, 0, 0 },                       // FIND
+    { 0, 1, 0, 0, 0, 0 },                       // LATEST
+    { 0, 0, 0, 0, 0, 0 },                       // IMMEDIATE
+    { 1, 0, 0, 0, 0, 0 },                       // HIDDEN
+    { 0, 0, 0, 0, 0, 0 },                       // [
+    { 0, 0, 0, 0, 0, 0 },                       // ]
+    { 0, 1, 0, 0, 0, 0 },                       // [COMPILESTATE]
+    { 0, 0, 0, 0, 0, OPF_UNSAFE },              // INTERPRET
+    { 0, 0, 0, 0, 0, 0 },                       // DUMP
+    { 0, 0, 0, 0, 0, 0 },                       // SAVE
+    { 1, 0, 0, 0, 0, OPF_UNSAFE },              // GC
+    { 1, 0, 0, 0, 0, 0 },                       // _INCLUDE
+    { 0, 0, 0, 0, 0, OPF_UNSAFE },              // FUSE
+    { 2, 0, 0, 0, 0, 0 },                       // LOCAL
+    { 1, 1, 0, 0, 0, 0 },                       // FINDLOCAL
+    { 0, 1, 0, 0, 0, 0 },                       // ENDLOCALS
+    { 0, 1, 0, 0, 0, 0 },                       // DEPTH
+#endif
+};
+
+fith_cell Interpreter::operands(const fith_cell *op, fith_cell len)
+{
+    fith_cell cell=*op & FLAG_ADDR;
+    if(cell >= MW_INTERP_COUNT){
+        return 0;
+    }
+    fith_cell n=opinfo[cell].operands;
+    if((opinfo[cell].flags & OPF_TABLE) != 0 && len > 1){
+        fith_cell count=op[1];
+        n=(count < 0 || count > len) ? len : 2+count;
+    }
+    return n;
+}
+
+Interpreter::OpInfo Interpreter::effect(const fith_cell *op, fith_cell len)
+{
+    OpInfo oi=opinfo[*op & FLAG_ADDR];
+    if((oi.flags & (OPF_COUNT | OPF_RINDEX)) != 0 && len > 1){
+        // counts are unsigned char, and the JIT checks them as signed bytes
+        fith_cell n=op[1];
+        if(n < 0 || n >= 127){
+            oi.flags |= OPF_UNSAFE;
+        }
+        else if((oi.flags & OPF_COUNT) != 0){
+            oi.din*=n;
+            oi.rin*=n;
+            oi.rout*=n;
+        }
+        else{
+            oi.rin+=n;
+            oi.rout+=n;
+        }
+    }
+    return oi;
+}
+
+Interpreter::Interpreter(code_t *_bin, size_t _binsz, fith_cell *_heap, size_t _heapsz, bool bs)
     : bin(_bin), heap(_heap), binsz(_binsz), heapsz(_heapsz)
 {
     syscalls=NULL;
+    proofs=NULL;
+    nproofs=0;
+    proofhere=0;
+    decoded=NULL;
+    natives=NULL;
+    compiler=NULL;
     
 #ifdef FULLFITH
     compilestate=false;
@@ -229,22 +741,148 @@ void Interpreter::setSyscalls(SysCalls *sc)
     syscalls=sc;
 }
 
+void Interpreter::setProofs(const Proof *p, size_t n)
+{
+    proofs=p;
+    nproofs=p ? n : 0;
+    proofhere=bin[0];
+}
+
+void Interpreter::setDecoded(Decoded *d)
+{
+    decoded=d;
+    redecode(0, binsz);
+}
+
+void Interpreter::redecode(fith_cell from, fith_cell to)
+{
+    if(!decoded){
+        return;
+    }
+    if(from < 1){
+        from=1;
+    }
+    if(size_t(to) > binsz){
+        to=binsz;
+    }
+
+    // cell 0 is HERE, which moves whenever code is added
+    decode_cell(0);
+    for(fith_cell i=from;i<to;++i){
+        decode_cell(i);
+    }
+}
+
+void Interpreter::decode_cell(fith_cell i)
+{
+    fith_cell cell=bin[i];
+    Decoded &d=decoded[i];
+    if((cell & FLAG_MACHINE) == 0){
+        d.op=DEC_CALL;
+        d.arg=cell & FLAG_ADDR;
+    }
+    else{
+        cell &= FLAG_ADDR;
+        d.op=cell < MW_INTERP_COUNT ? cell : fith_cell(DEC_BAD);
+        d.arg=size_t(i+1) < binsz ? bin[i+1] : 0;
+    }
+}
+
+unsigned Interpreter::crc() const
+{
+    CRC32STM c;
+    c.insert((const unsigned *) bin, bin[0]);
+    return c.remainder();
+}
+
+bool Interpreter::setNative(const NativeTable *t)
+{
+    if(t && t->crc != crc()){
+        natives=NULL;
+        return false;
+    }
+    natives=t;
+    return true;
+}
+
+void Interpreter::setCompiler(Compiler *c)
+{
+    compiler=c;
+}
+
+void Interpreter::drop_native()
+{
+    natives=NULL;
+    if(compiler){
+        compiler->invalidate();
+    }
+}
+
+Interpreter::native_t Interpreter::native(size_t ip) const
+{
+    if(!natives){
+        return compiler ? compiler->enter(ip) : NULL;
+    }
+
+    // binary search, as per proven()
+    size_t lo=0, hi=natives->count;
+    while(lo < hi){
+        size_t mid=(lo+hi)/2;
+        if(size_t(natives->fns[mid].addr) < ip){
+            lo=mid+1;
+        }
+        else{
+            hi=mid;
+        }
+    }
+    if(lo == natives->count || size_t(natives->fns[lo].addr) != ip){
+        return compiler ? compiler->enter(ip) : NULL;
+    }
+    return natives->fns[lo].fn;
+}
+
+bool Interpreter::proven(size_t ip, size_t dsp, size_t dsz, size_t rsz) const
+{
+    const Proof *p=proof(ip);
+    return p && dsp >= size_t(p->need) && dsp+p->grow <= dsz && size_t(p->rgrow) <= rsz;
+}
+
+const Interpreter::Proof *Interpreter::proof(size_t ip) const
+{
+    // binary search, proofs are sorted by address
+    size_t lo=0, hi=nproofs;
+    while(lo < hi){
+        size_t mid=(lo+hi)/2;
+        if(size_t(proofs[mid].addr) < ip){
+            lo=mid+1;
+        }
+        else{
+            hi=mid;
+        }
+    }
+    if(lo == nproofs || size_t(proofs[lo].addr) != ip){
+        return NULL;
+    }
+    return &proofs[lo];
+}
+
 Interpreter::Context::Context(size_t _ip, fith_cell *_dstk, fith_cell *_rstk, size_t &_dsp, size_t &_rsp,
                               size_t _dsz, size_t _rsz, Interpreter &_interp
 #ifdef FULLFITH
                               , istream *_is, ostream *_os
 #endif
                               )
-    : ip(_ip), dsp(_dsp), rsp(_rsp), state(EX_RUNNING), dstk(_dstk), rstk(_rstk), dsz(_dsz), rsz(_rsz),
+    : ip(_ip), dsp(_dsp), rsp(_rsp), state(EX_RUNNING), mode(EXEC_FAST), budget(UNLIMITED), outlen(0), dstk(_dstk), rstk(_rstk), dsz(_dsz), rsz(_rsz),
       interp(_interp)
 #ifdef FULLFITH
-    , is(_is), os(_os)
+    , is(NULL), os(_os)
 #endif
 {
     ip &= FLAG_ADDR;
 #ifdef FULLFITH
-    assert(is);
+    assert(_is);
     assert(os);
+    is=new Source(_is);
 #endif
 }
 
@@ -257,709 +895,3606 @@ Interpreter::Context::~Context()
         is=iostack.top();
         iostack.pop();
     }
+    delete is;
 #endif
 }
 
-Interpreter::EXEC_RESULT Interpreter::Context::execute()
-{
-    state=EX_RUNNING;
-    
-    while(state == EX_RUNNING){
-        if(ip >= interp.binsz){
-            state=EX_SEGV_CODE;
-            break;
-        }
-        fith_cell ins=interp.bin[ip];
+/*
+ * The threaded and unchecked loops use labels-as-values where the
+ * compiler has them, else a switch.
+ */
+#if defined(__GNUC__) && !defined(FITH_NO_COMPUTED_GOTO)
+#define FITH_COMPUTED_GOTO
+#endif
 
-        ++ip;
-        
-        if((ins & FLAG_MACHINE) != 0){
-            // builtin
-            ins &= FLAG_ADDR;
-            if(ins >= MW_INTERP_COUNT){
-                state=EX_BAD_OPCODE;
-                break;
-            }
 #ifndef NDEBUG
-            cerr << ip << ":" << opcodes[ins] << endl;
+#define TRACE_OP(at, x)     trace((at), (x) | FLAG_MACHINE)
+#define TRACE_CALL(at, x)   trace((at), (x))
+#else
+#define TRACE_OP(at, x)
+#define TRACE_CALL(at, x)
 #endif
-            // do it.
-            (this->*builtin[ins])();
-        }
-        else{
-            // word to call
-            ins &= FLAG_ADDR;
-#ifndef NDEBUG
-            cerr << ip << ":" << ins << endl;
+
+// debug builds of the full system trace everything run by the fast loop
+#if !defined(NDEBUG) && defined(FULLFITH)
+static const unsigned XP_DEBUG=Interpreter::XP_TRACE;
+#else
+static const unsigned XP_DEBUG=0;
 #endif
 
-            // push return address and jump
-            if(rsp >= rsz){
-                state=EX_RSTK_OVER;
-                break;
-            }
+/*
+ * Bit numbers and fields, shared by the handlers and the fast loop.  A
+ * position outside the cell selects nothing rather than shifting by an
+ * undefined amount; a field running off the top is cut short.
+ */
 
-            rstk[rsp++]=ip;
-            ip=ins;
-        }
-    }
+/// mask for bit n, or 0
+static inline unsigned bit_mask(fith_cell n)
+{
+    return (n >= 0 && n < 32) ? 1U << n : 0;
+}
 
-    return state;
+/// mask for width bits from pos up, or 0
+static inline unsigned field_mask(fith_cell pos, fith_cell width)
+{
+    if(pos < 0 || pos >= 32 || width <= 0){
+        return 0;
+    }
+    unsigned m=(width >= 32) ? ~0U : (1U << width)-1;
+    return m << pos;
 }
 
-void Interpreter::Context::set_ip(size_t _ip)
+static inline fith_cell bit_extract(fith_cell x, fith_cell pos, fith_cell width)
 {
-    ip=_ip;
+    unsigned m=field_mask(pos, width);
+    return m ? (fith_cell) ((unsigned(x) & m) >> pos) : 0;
 }
 
-#ifdef FULLFITH
+static inline fith_cell bit_insert(fith_cell x, fith_cell f, fith_cell pos, fith_cell width)
+{
+    unsigned m=field_mask(pos, width);
+    return m ? (fith_cell) ((unsigned(x) & ~m) | ((unsigned(f) << pos) & m)) : x;
+}
 
-void Interpreter::Context::printdump(ostream &s)
+static inline fith_cell bit_count(fith_cell x)
 {
-    s << "************************" << endl;
-    s << "context state = " << states[state] << endl;
-    s << "IP = " << ip << endl << "D:";
-    size_t stklen=dsp > 6 ? 6 : dsp;
-    for(size_t i=stklen; i>0; --i){
-        s << " " << dstk[dsp-i];
-    }
-    s << endl << "R:";
-    stklen=rsp > 6 ? 6 : rsp;
-    for(size_t i=stklen; i>0; --i){
-        s << " " << rstk[rsp-i];
-    }
-    s << endl;
-    s << "************************" << endl;
+    unsigned c=unsigned(x);
+    c=c-((c >> 1) & 0x55555555U);
+    c=(c & 0x33333333U)+((c >> 2) & 0x33333333U);
+    c=(c+(c >> 4)) & 0x0F0F0F0FU;
+    return (fith_cell) ((c*0x01010101U) >> 24);
 }
 
-#endif
+static inline fith_cell bit_first(fith_cell x)
+{
+    unsigned c=unsigned(x);
+    // the bits below the lowest set one
+    return c ? bit_count(fith_cell((c & -c)-1)) : -1;
+}
 
 /*
- * Here be the implementations of the builtin words
+ * Double cells are ( lo hi ), high cell on top as in Forth.  The sums are
+ * done unsigned so that overflow wraps rather than being undefined.
  */
 
-void Interpreter::Context::mw_exit()
+static inline unsigned long long dcell(fith_cell lo, fith_cell hi)
 {
-    if(rsp == 0){
-        // returned from top-level function
-        state=Interpreter::EX_SUCCESS;
-    }
-    else{
-        // jump back
-        ip=rstk[--rsp];
-    }
+    return (((unsigned long long) unsigned(hi)) << 32) | unsigned(lo);
 }
 
-void Interpreter::Context::mw_lit()
+static inline fith_cell dcell_lo(unsigned long long d)
 {
-    if(dsp >= dsz){
-        // stack overflow
-        state=Interpreter::EX_DSTK_OVER;
+    return (fith_cell) (d & 0xFFFFFFFFU);
+}
+
+static inline fith_cell dcell_hi(unsigned long long d)
+{
+    return (fith_cell) (d >> 32);
+}
+
+/// the nearest cell to v
+static inline fith_cell saturate(long long v)
+{
+    return v > 0x7FFFFFFFLL ? 0x7FFFFFFF : v < -0x80000000LL ? (fith_cell) 0x80000000 : (fith_cell) v;
+}
+
+/// Q16.16 product
+static inline fith_cell qmul(fith_cell a, fith_cell b)
+{
+    return saturate((((long long) a) * b) >> 16);
+}
+
+Interpreter::EXEC_RESULT Interpreter::Context::execute(size_t _budget)
+{
+    budget=_budget ? _budget : UNLIMITED;
+
+    EXEC_RESULT res=dispatch();
+    flush();
+    return res;
+}
+
+Interpreter::EXEC_RESULT Interpreter::Context::dispatch()
+{
+#ifdef FITH_MINIMAL
+    // the fast loop has every opcode inline; stick to the table
+    return execute_checked();
+#else
+    if(rsp == 0){
+        // native code can't stop part-way, so under a budget it may only
+        // run a word that can't loop, paying up front for the calls it
+        // might make; with less budget than that, interpret it
+        const Proof *p=(budget == UNLIMITED) ? NULL : interp.proof(ip);
+        if(budget == UNLIMITED || (p && p->cost >= 0 && size_t(p->cost) < budget)){
+            native_t fn=interp.native(ip);
+            if(fn){
+                if(p){
+                    budget-=p->cost;
+                }
+                return run_native(fn);
+            }
+        }
     }
-    else if(ip >= interp.binsz){
-        // opcode trails off the end of the binary
-        state=Interpreter::EX_SEGV_CODE;
+
+    switch(mode){
+    case EXEC_PARANOID:
+        return run_policy<XP_CHECKED | XP_DEBUG>();
+    case EXEC_TRUSTED:
+        return run_policy<XP_DEBUG>();
+    default:
+        break;
     }
-    else{
-        // push literal
-        dstk[dsp++]=interp.bin[ip++];
+
+    if(rsp == 0 && interp.proven(ip, dsp, dsz, rsz)){
+        return run_policy<XP_DEBUG>();
+    }
+    if(mode == EXEC_FAST){
+        return run_policy<XP_CHECKED | XP_DEBUG>();
     }
+    return execute_checked();
+#endif
 }
 
-void Interpreter::Context::mw_tick()
+template<unsigned XP>
+Interpreter::EXEC_RESULT Interpreter::Context::run_policy()
 {
-    if(dsp >= dsz){
-        // stack overflow
-        state=Interpreter::EX_DSTK_OVER;
-    }
-    else if(ip >= interp.binsz){
-        // opcode trails off the end of the binary
-        state=Interpreter::EX_SEGV_CODE;
+    if(budget != UNLIMITED){
+        return interp.decoded ? run_fast<XP | XP_DECODED | XP_BUDGET>() : run_fast<XP | XP_BUDGET>();
     }
-    else{
-        // push literal
-        dstk[dsp++]=interp.bin[ip++];
+    if(interp.decoded){
+        return run_fast<XP | XP_DECODED>();
     }
+    return run_fast<XP>();
 }
 
-void Interpreter::Context::mw_plus()
+Interpreter::EXEC_RESULT Interpreter::Context::run_native(native_t fn)
 {
-    if(dsp < 2){
-        state=Interpreter::EX_DSTK_UNDER;
+    Machine m={ dstk, rstk, dsp, rsp, dsz, rsz, interp.heap, interp.heapsz, interp.syscalls, ip };
+    state=fn(m);
+    dsp=m.dsp;
+    rsp=m.rsp;
+    ip=m.ip;
+    return state;
+}
+
+void Interpreter::Context::flush()
+{
+    if(outlen == 0){
+        return;
     }
-    else{
-        --dsp;
-        dstk[dsp-1]=dstk[dsp-1] + dstk[dsp];
+#ifdef FULLFITH
+    os->write(outbuf, outlen);
+#else
+    if(interp.syscalls){
+        interp.syscalls->write(outbuf, outlen);
     }
+#endif
+    outlen=0;
 }
 
-void Interpreter::Context::mw_minus()
+void Interpreter::Context::output(const char *p, size_t n)
 {
-    if(dsp < 2){
-        state=Interpreter::EX_DSTK_UNDER;
+    bool nl=memchr(p, '\n', n) != NULL;
+    while(n > 0){
+        if(outlen == OUTBUFSZ){
+            flush();
+        }
+        size_t k=OUTBUFSZ-outlen;
+        if(k > n){
+            k=n;
+        }
+        memcpy(outbuf+outlen, p, k);
+        outlen+=k;
+        p+=k;
+        n-=k;
     }
-    else{
-        --dsp;
-        dstk[dsp-1]=dstk[dsp-1] - dstk[dsp];
+    if(nl){
+        flush();
     }
 }
 
-void Interpreter::Context::mw_neg()
+void SysCalls::write(const char *buf, size_t len)
 {
-    if(dsp < 1){
-        state=Interpreter::EX_DSTK_UNDER;
-    }
-    else{
-        dstk[dsp-1]= -dstk[dsp-1];
+    for(size_t i=0;i<len;++i){
+        syscall2(buf[i] & 0xFF, SC2_EMIT);
     }
 }
 
-void Interpreter::Context::mw_mul()
+fith_cell SysCalls::msboot()
 {
-    if(dsp < 2){
-        state=Interpreter::EX_DSTK_UNDER;
+    return syscall1(SC1_TIME_MSBOOT);
+}
+
+void Interpreter::Context::trace(size_t at, fith_cell cell)
+{
+#ifdef FULLFITH
+    if((cell & FLAG_MACHINE) != 0){
+        cerr << at << ":" << opcodes[cell & FLAG_ADDR] << endl;
     }
     else{
-        --dsp;
-        dstk[dsp-1]=dstk[dsp-1] * dstk[dsp];
+        cerr << at << ":" << cell << endl;
     }
+#endif
 }
 
-void Interpreter::Context::mw_div()
+inline void Interpreter::Context::charge()
 {
-    if(dsp < 2){
-        state=Interpreter::EX_DSTK_UNDER;
-    }
-    else if(dstk[dsp-1] == 0){
-        state=Interpreter::EX_DIV_ZERO;
-    }
-    else{        
-        --dsp;
-        dstk[dsp-1]=dstk[dsp-1] / dstk[dsp];
+    if(--budget == 0){
+        state=EX_HALTED;
+    }
+}
+
+inline void Interpreter::Context::branch()
+{
+    fith_cell off=interp.bin[ip];
+    ip+=off-1;
+    if(off <= 0){
+        charge();
+    }
+}
+
+#ifndef FITH_THREADED
+
+Interpreter::EXEC_RESULT Interpreter::Context::execute_checked()
+{
+    state=EX_RUNNING;
+    
+    while(state == EX_RUNNING){
+        if(ip >= interp.binsz){
+            state=EX_SEGV_CODE;
+            break;
+        }
+        fith_cell ins=interp.bin[ip];
+
+        ++ip;
+        
+        if((ins & FLAG_MACHINE) != 0){
+            // builtin
+            ins &= FLAG_ADDR;
+            if(ins >= MW_INTERP_COUNT){
+                state=EX_BAD_OPCODE;
+                break;
+            }
+#if !defined(NDEBUG) && defined(FULLFITH)
+            cerr << ip << ":" << opcodes[ins] << endl;
+#endif
+            // do it.
+            (this->*builtin[ins])();
+        }
+        else{
+            // word to call
+            ins &= FLAG_ADDR;
+#if !defined(NDEBUG) && defined(FULLFITH)
+            cerr << ip << ":" << ins << endl;
+#endif
+
+            // push return address and jump
+            if(rsp >= rsz){
+                state=EX_RSTK_OVER;
+                break;
+            }
+
+            rstk[rsp++]=ip;
+            ip=ins;
+            charge();
+        }
+    }
+
+    return state;
+}
+
+#else  // FITH_THREADED
+
+/*
+ * Threaded dispatch: every handler is reached through its own label and
+ * finishes with its own copy of the fetch/decode/dispatch sequence, so
+ * there is one indirect branch per handler rather than a single shared
+ * one, and the handlers are called directly (and may be inlined) rather
+ * than through a member-function pointer.
+ *
+ * Semantics (state, ip, stack contents) are identical to the table loop.
+ */
+
+#ifdef FITH_COMPUTED_GOTO
+
+#define OP(op)          L_##op
+// fetch the next cell and go straight to its handler
+#define NEXT                                    \
+    do{                                         \
+        if(state != EX_RUNNING) goto done;      \
+        if(ip >= interp.binsz){                 \
+            state=EX_SEGV_CODE;                 \
+            goto done;                          \
+        }                                       \
+        ins=interp.bin[ip++];                   \
+        if((ins & FLAG_MACHINE) == 0) goto call;\
+        ins &= FLAG_ADDR;                       \
+        if(ins >= MW_INTERP_COUNT){             \
+            state=EX_BAD_OPCODE;                \
+            goto done;                          \
+        }                                       \
+        TRACE_OP(ip, ins);                      \
+        goto *labels[ins];                      \
+    }while(0)
+
+#else
+
+#define OP(op)          case op
+#define NEXT                                    \
+    do{                                         \
+        if(state != EX_RUNNING) goto done;      \
+        goto fetch;                             \
+    }while(0)
+
+#endif
+
+#define HANDLE(op, fn)  OP(op): fn(); NEXT
+
+Interpreter::EXEC_RESULT Interpreter::Context::execute_checked()
+{
+    fith_cell ins;
+
+#ifdef FITH_COMPUTED_GOTO
+    static void *const labels[MW_INTERP_COUNT]={
+        &&L_MW_EXIT,
+        &&L_MW_LIT,
+        &&L_MW_TICK,
+        &&L_MW_PLUS,
+        &&L_MW_MINUS,
+        &&L_MW_NEG,
+        &&L_MW_MUL,
+        &&L_MW_DIV,
+        &&L_MW_MOD,
+        &&L_MW_MULDIV,
+        &&L_MW_DIVMOD,
+        &&L_MW_MULMOD,
+        &&L_MW_JMP,
+        &&L_MW_JZ,
+        &&L_MW_CALL,
+        &&L_MW_LT,
+        &&L_MW_GT,
+        &&L_MW_LE,
+        &&L_MW_GE,
+        &&L_MW_EQ,
+        &&L_MW_DUP,
+        &&L_MW_DUPNZ,
+        &&L_MW_DROP,
+        &&L_MW_SWAP,
+        &&L_MW_ROT,
+        &&L_MW_NROT,
+        &&L_MW_PICK,
+        &&L_MW_ROLL,
+        &&L_MW_AND,
+        &&L_MW_OR,
+        &&L_MW_XOR,
+        &&L_MW_INVERT,
+        &&L_MW_SL,
+        &&L_MW_SRA,
+        &&L_MW_SRL,
+        &&L_MW_STORE,
+        &&L_MW_STOREC,
+        &&L_MW_READ,
+        &&L_MW_READC,
+        &&L_MW_TORS,
+        &&L_MW_FROMRS,
+        &&L_MW_CPFROMRS,
+        &&L_MW_RDROP,
+        &&L_MW_RPICK,
+        &&L_MW_HERE,
+        &&L_MW_SYSCALL1,
+        &&L_MW_SYSCALL2,
+        &&L_MW_SYSCALL3,
+        &&L_MW_PLUSLIT,
+        &&L_MW_READLIT,
+        &&L_MW_DUPJZ,
+        &&L_MW_FORTEST,
+        &&L_MW_RPLUSLIT,
+        &&L_MW_ANDLIT,
+        &&L_MW_ORLIT,
+        &&L_MW_XORLIT,
+        &&L_MW_DO,
+        &&L_MW_LOOP,
+        &&L_MW_PLUSLOOP,
+        &&L_MW_LOOPI,
+        &&L_MW_LOOPJ,
+        &&L_MW_MOVE,
+        &&L_MW_MOVEC,
+        &&L_MW_FILL,
+        &&L_MW_FILLC,
+        &&L_MW_COMPARE,
+        &&L_MW_COMPAREC,
+        &&L_MW_SCAN,
+        &&L_MW_SCANC,
+        &&L_MW_STRLEN,
+        &&L_MW_STRREAD,
+        &&L_MW_STRWRITE,
+        &&L_MW_STRCMP,
+        &&L_MW_STRCAT,
+        &&L_MW_EMIT,
+        &&L_MW_TYPE,
+        &&L_MW_TELL,
+        &&L_MW_FLUSH,
+        &&L_MW_BTST,
+        &&L_MW_BSET,
+        &&L_MW_BCLR,
+        &&L_MW_BTGL,
+        &&L_MW_BFX,
+        &&L_MW_BFI,
+        &&L_MW_POPCNT,
+        &&L_MW_FFS,
+        &&L_MW_DPLUS,
+        &&L_MW_DMINUS,
+        &&L_MW_MSTAR,
+        &&L_MW_UMDIVMOD,
+        &&L_MW_DLT,
+        &&L_MW_DEQ,
+        &&L_MW_QMUL,
+        &&L_MW_QDIV,
+        &&L_MW_SQRT,
+        &&L_MW_MIN,
+        &&L_MW_MAX,
+        &&L_MW_CLAMP,
+        &&L_MW_INTERP,
+        &&L_MW_TON,
+        &&L_MW_TOF,
+        &&L_MW_TP,
+        &&L_MW_CTU,
+        &&L_MW_CTD,
+        &&L_MW_RTRIG,
+        &&L_MW_FTRIG,
+        &&L_MW_CASE,
+        &&L_MW_STORELIT,
+        &&L_MW_READX,
+        &&L_MW_STOREX,
+        &&L_MW_READCX,
+        &&L_MW_STORECX,
+        &&L_MW_READINC,
+        &&L_MW_STOREINC,
+        &&L_MW_READCINC,
+        &&L_MW_STORECINC,
+        &&L_MW_FRAME,
+        &&L_MW_UNFRAME,
+        &&L_MW_LOCALGET,
+        &&L_MW_LOCALSET,
+#ifdef FULLFITH
+        &&L_MW_STORECODE,
+        &&L_MW_READCODE,
+        &&L_MW_COMMA,
+        &&L_MW_KEY,
+        &&L_MW_WORD,
+        &&L_MW_EOF,
+        &&L_MW_NUMBER,
+        &&L_MW_DOT,
+        &&L_MW_CREATE,
+        &&L_MW_FIND,
+        &&L_MW_LATEST,
+        &&L_MW_IMMEDIATE,
+        &&L_MW_HIDDEN,
+        &&L_MW_LBRAC,
+        &&L_MW_RBRAC,
+        &&L_MW_STATE,
+        &&L_MW_INTERPRET,
+        &&L_MW_DUMP,
+        &&L_MW_SAVE,
+        &&L_MW_GC,
+        &&L_MW_INCLUDE,
+        &&L_MW_FUSE,
+        &&L_MW_LOCAL,
+        &&L_MW_FINDLOCAL,
+        &&L_MW_ENDLOCALS,
+        &&L_MW_DEPTH
+#endif
+    };
+#endif
+
+    state=EX_RUNNING;
+    NEXT;
+
+#ifndef FITH_COMPUTED_GOTO
+fetch:
+    if(ip >= interp.binsz){
+        state=EX_SEGV_CODE;
+        goto done;
+    }
+    ins=interp.bin[ip++];
+    if((ins & FLAG_MACHINE) == 0){
+        goto call;
+    }
+    ins &= FLAG_ADDR;
+    if(ins >= MW_INTERP_COUNT){
+        state=EX_BAD_OPCODE;
+        goto done;
+    }
+    TRACE_OP(ip, ins);
+
+    switch(ins){
+#endif
+
+    HANDLE(MW_EXIT, mw_exit);
+    HANDLE(MW_LIT, mw_lit);
+    HANDLE(MW_TICK, mw_tick);
+    HANDLE(MW_PLUS, mw_plus);
+    HANDLE(MW_MINUS, mw_minus);
+    HANDLE(MW_NEG, mw_neg);
+    HANDLE(MW_MUL, mw_mul);
+    HANDLE(MW_DIV, mw_div);
+    HANDLE(MW_MOD, mw_mod);
+    HANDLE(MW_MULDIV, mw_muldiv);
+    HANDLE(MW_DIVMOD, mw_divmod);
+    HANDLE(MW_MULMOD, mw_mulmod);
+    HANDLE(MW_JMP, mw_jmp);
+    HANDLE(MW_JZ, mw_jz);
+    HANDLE(MW_CALL, mw_call);
+    HANDLE(MW_LT, mw_lt);
+    HANDLE(MW_GT, mw_gt);
+    HANDLE(MW_LE, mw_le);
+    HANDLE(MW_GE, mw_ge);
+    HANDLE(MW_EQ, mw_eq);
+    HANDLE(MW_DUP, mw_dup);
+    HANDLE(MW_DUPNZ, mw_dupnz);
+    HANDLE(MW_DROP, mw_drop);
+    HANDLE(MW_SWAP, mw_swap);
+    HANDLE(MW_ROT, mw_rot);
+    HANDLE(MW_NROT, mw_nrot);
+    HANDLE(MW_PICK, mw_pick);
+    HANDLE(MW_ROLL, mw_roll);
+    HANDLE(MW_AND, mw_and);
+    HANDLE(MW_OR, mw_or);
+    HANDLE(MW_XOR, mw_xor);
+    HANDLE(MW_INVERT, mw_invert);
+    HANDLE(MW_SL, mw_sl);
+    HANDLE(MW_SRA, mw_sra);
+    HANDLE(MW_SRL, mw_srl);
+    HANDLE(MW_STORE, mw_store);
+    HANDLE(MW_STOREC, mw_storec);
+    HANDLE(MW_READ, mw_read);
+    HANDLE(MW_READC, mw_readc);
+    HANDLE(MW_TORS, mw_tors);
+    HANDLE(MW_FROMRS, mw_fromrs);
+    HANDLE(MW_CPFROMRS, mw_cpfromrs);
+    HANDLE(MW_RDROP, mw_rdrop);
+    HANDLE(MW_RPICK, mw_rpick);
+    HANDLE(MW_HERE, mw_here);
+    HANDLE(MW_SYSCALL1, mw_syscall1);
+    HANDLE(MW_SYSCALL2, mw_syscall2);
+    HANDLE(MW_SYSCALL3, mw_syscall3);
+    HANDLE(MW_PLUSLIT, mw_pluslit);
+    HANDLE(MW_READLIT, mw_readlit);
+    HANDLE(MW_DUPJZ, mw_dupjz);
+    HANDLE(MW_FORTEST, mw_fortest);
+    HANDLE(MW_RPLUSLIT, mw_rpluslit);
+    HANDLE(MW_ANDLIT, mw_andlit);
+    HANDLE(MW_ORLIT, mw_orlit);
+    HANDLE(MW_XORLIT, mw_xorlit);
+    HANDLE(MW_DO, mw_do);
+    HANDLE(MW_LOOP, mw_loop);
+    HANDLE(MW_PLUSLOOP, mw_plusloop);
+    HANDLE(MW_LOOPI, mw_loopi);
+    HANDLE(MW_LOOPJ, mw_loopj);
+    HANDLE(MW_MOVE, mw_move);
+    HANDLE(MW_MOVEC, mw_movec);
+    HANDLE(MW_FILL, mw_fill);
+    HANDLE(MW_FILLC, mw_fillc);
+    HANDLE(MW_COMPARE, mw_compare);
+    HANDLE(MW_COMPAREC, mw_comparec);
+    HANDLE(MW_SCAN, mw_scan);
+    HANDLE(MW_SCANC, mw_scanc);
+    HANDLE(MW_STRLEN, mw_strlen);
+    HANDLE(MW_STRREAD, mw_strread);
+    HANDLE(MW_STRWRITE, mw_strwrite);
+    HANDLE(MW_STRCMP, mw_strcmp);
+    HANDLE(MW_STRCAT, mw_strcat);
+    HANDLE(MW_EMIT, mw_emit);
+    HANDLE(MW_TYPE, mw_type);
+    HANDLE(MW_TELL, mw_tell);
+    HANDLE(MW_FLUSH, mw_flush);
+    HANDLE(MW_BTST, mw_btst);
+    HANDLE(MW_BSET, mw_bset);
+    HANDLE(MW_BCLR, mw_bclr);
+    HANDLE(MW_BTGL, mw_btgl);
+    HANDLE(MW_BFX, mw_bfx);
+    HANDLE(MW_BFI, mw_bfi);
+    HANDLE(MW_POPCNT, mw_popcnt);
+    HANDLE(MW_FFS, mw_ffs);
+    HANDLE(MW_DPLUS, mw_dplus);
+    HANDLE(MW_DMINUS, mw_dminus);
+    HANDLE(MW_MSTAR, mw_mstar);
+    HANDLE(MW_UMDIVMOD, mw_umdivmod);
+    HANDLE(MW_DLT, mw_dlt);
+    HANDLE(MW_DEQ, mw_deq);
+    HANDLE(MW_QMUL, mw_qmul);
+    HANDLE(MW_QDIV, mw_qdiv);
+    HANDLE(MW_SQRT, mw_sqrt);
+    HANDLE(MW_MIN, mw_min);
+    HANDLE(MW_MAX, mw_max);
+    HANDLE(MW_CLAMP, mw_clamp);
+    HANDLE(MW_INTERP, mw_interp);
+    HANDLE(MW_TON, mw_ton);
+    HANDLE(MW_TOF, mw_tof);
+    HANDLE(MW_TP, mw_tp);
+    HANDLE(MW_CTU, mw_ctu);
+    HANDLE(MW_CTD, mw_ctd);
+    HANDLE(MW_RTRIG, mw_rtrig);
+    HANDLE(MW_FTRIG, mw_ftrig);
+    HANDLE(MW_CASE, mw_case);
+    HANDLE(MW_STORELIT, mw_storelit);
+    HANDLE(MW_READX, mw_readx);
+    HANDLE(MW_STOREX, mw_storex);
+    HANDLE(MW_READCX, mw_readcx);
+    HANDLE(MW_STORECX, mw_storecx);
+    HANDLE(MW_READINC, mw_readinc);
+    HANDLE(MW_STOREINC, mw_storeinc);
+    HANDLE(MW_READCINC, mw_readcinc);
+    HANDLE(MW_STORECINC, mw_storecinc);
+    HANDLE(MW_FRAME, mw_frame);
+    HANDLE(MW_UNFRAME, mw_unframe);
+    HANDLE(MW_LOCALGET, mw_localget);
+    HANDLE(MW_LOCALSET, mw_localset);
+#ifdef FULLFITH
+    HANDLE(MW_STORECODE, mw_storecode);
+    HANDLE(MW_READCODE, mw_readcode);
+    HANDLE(MW_COMMA, mw_comma);
+    HANDLE(MW_KEY, mw_key);
+    HANDLE(MW_WORD, mw_word);
+    HANDLE(MW_EOF, mw_eof);
+    HANDLE(MW_NUMBER, mw_number);
+    HANDLE(MW_DOT, mw_dot);
+    HANDLE(MW_CREATE, mw_create);
+    HANDLE(MW_FIND, mw_find);
+    HANDLE(MW_LATEST, mw_latest);
+    HANDLE(MW_IMMEDIATE, mw_immediate);
+    HANDLE(MW_HIDDEN, mw_hidden);
+    HANDLE(MW_LBRAC, mw_lbrac);
+    HANDLE(MW_RBRAC, mw_rbrac);
+    HANDLE(MW_STATE, mw_state);
+    HANDLE(MW_INTERPRET, mw_interpret);
+    HANDLE(MW_DUMP, mw_dump);
+    HANDLE(MW_SAVE, mw_save);
+    HANDLE(MW_GC, mw_gc);
+    HANDLE(MW_INCLUDE, mw_include);
+    HANDLE(MW_FUSE, mw_fuse);
+    HANDLE(MW_LOCAL, mw_local);
+    HANDLE(MW_FINDLOCAL, mw_findlocal);
+    HANDLE(MW_ENDLOCALS, mw_endlocals);
+    HANDLE(MW_DEPTH, mw_depth);
+#endif
+
+#ifndef FITH_COMPUTED_GOTO
+    default:
+        // unreachable, opcode was range-checked above
+        state=EX_BAD_OPCODE;
+        goto done;
+    }
+#endif
+
+call:
+    // word to call
+    ins &= FLAG_ADDR;
+    TRACE_CALL(ip, ins);
+
+    // push return address and jump
+    if(rsp >= rsz){
+        state=EX_RSTK_OVER;
+        goto done;
+    }
+    rstk[rsp++]=ip;
+    ip=ins;
+    charge();
+    NEXT;
+
+done:
+    return state;
+}
+
+#undef HANDLE
+#undef NEXT
+#undef OP
+
+#endif // FITH_THREADED
+
+/*
+ * Fast loop: ip, both stack pointers and the top of the data stack are
+ * kept in locals for the duration, rather than going through the dsp/rsp
+ * references (which alias globals, so must be reloaded after every store).
+ * They are written back only around calls to handlers, on faults and on
+ * return.  While running, the data stack is dstk[0 .. sp-2] plus tos.
+ *
+ * With XP_CHECKED, every check the handlers make is made here too, in
+ * the same order, so the results (state, ip, stacks) are identical to the
+ * table loop.  Without, it's for code the Verifier has proven (or that is
+ * trusted): the stack and IP checks are redundant, while heap, divide and
+ * runtime-indexed (PICK, RPICK) checks remain.  Opcodes not handled inline
+ * go through their usual handler.
+ *
+ * With XP_DECODED, instructions and their operands come from the
+ * interpreter's pre-decoded copy of the binary (see setDecoded) instead.
+ */
+
+// write the locals back to the context
+#define SPILL()                                 \
+    do{                                         \
+        if(sp) dstk[sp-1]=tos;                  \
+        dsp=sp;                                 \
+        rsp=rp;                                 \
+        ip=pc;                                  \
+    }while(0)
+// and pick them up again after a handler
+#define RELOAD()                                \
+    do{                                         \
+        sp=dsp;                                 \
+        rp=rsp;                                 \
+        pc=ip;                                  \
+        if(sp) tos=dstk[sp-1];                  \
+    }while(0)
+
+#define FAULT(x)        do{ state=(x); goto done; }while(0)
+#define NEED(n)         if(CHECKED && sp < (n)) FAULT(EX_DSTK_UNDER)
+#define ROOM(n)         if(CHECKED && sp+(n) > dsz) FAULT(EX_DSTK_OVER)
+#define RNEED(n)        if(CHECKED && rp < (n)) FAULT(EX_RSTK_UNDER)
+#define RROOM(n)        if(CHECKED && rp+(n) > rsz) FAULT(EX_RSTK_OVER)
+#define OPERAND()       if(CHECKED && pc >= binsz) FAULT(EX_SEGV_CODE)
+
+#define PUSH(x)                                 \
+    do{                                         \
+        fith_cell v_=(x);                       \
+        if(sp) dstk[sp-1]=tos;                  \
+        tos=v_;                                 \
+        ++sp;                                   \
+    }while(0)
+#define POP()           do{ if(--sp) tos=dstk[sp-1]; }while(0)
+#define BINOP(expr)     NEED(2); tos=(expr); --sp; NEXT
+#define IMM()           (DECODED ? arg : code[pc])
+#define TRACE(at, x)    do{ if(TRACING) trace((at), (x)); }while(0)
+// taken backward branches and calls are charged against the budget
+#define CHARGE()        if(BUDGETED && --budget == 0) FAULT(EX_HALTED)
+#define JUMP()                                  \
+    do{                                         \
+        off=IMM();                              \
+        pc+=off-1;                              \
+        if(off <= 0) CHARGE();                  \
+    }while(0)
+#define BRANCH(cond)    if(cond) JUMP(); else ++pc
+
+#ifdef FITH_COMPUTED_GOTO
+#define OP(op)          F_##op
+#define OTHER           F_OTHER
+#define NEXT                                    \
+    do{                                         \
+        if(CHECKED && pc >= binsz) FAULT(EX_SEGV_CODE); \
+        if(DECODED){                            \
+            ins=dec[pc].op;                     \
+            arg=dec[pc++].arg;                  \
+            if(ins < MW_INTERP_COUNT) TRACE(pc, ins | FLAG_MACHINE); \
+            goto *labels[ins];                  \
+        }                                       \
+        ins=code[pc++];                         \
+        if((ins & FLAG_MACHINE) == 0) goto call;\
+        ins &= FLAG_ADDR;                       \
+        if(ins >= MW_INTERP_COUNT) FAULT(EX_BAD_OPCODE); \
+        TRACE(pc, ins | FLAG_MACHINE);          \
+        goto *labels[ins];                      \
+    }while(0)
+#else
+#define OP(op)          case op
+#define OTHER           default
+#define NEXT            goto fetch
+#endif
+
+template<unsigned XP>
+Interpreter::EXEC_RESULT Interpreter::Context::run_fast()
+{
+    enum {
+        CHECKED=(XP & XP_CHECKED) != 0,
+        DECODED=(XP & XP_DECODED) != 0,
+        TRACING=(XP & XP_TRACE) != 0,
+        BUDGETED=(XP & XP_BUDGET) != 0
+    };
+
+    const fith_cell *const code=interp.bin;
+    const Decoded *const dec=interp.decoded;
+    fith_cell *const heap=interp.heap;
+    const size_t binsz=interp.binsz, heapsz=interp.heapsz;
+    size_t pc, sp, rp;
+    fith_cell ins, tos=0, tmp, arg=0, off;
+
+#ifdef FITH_COMPUTED_GOTO
+    static void *const labels[DEC_BAD+1]={
+        &&F_MW_EXIT,
+        &&F_MW_LIT,
+        &&F_MW_TICK,
+        &&F_MW_PLUS,
+        &&F_MW_MINUS,
+        &&F_MW_NEG,
+        &&F_MW_MUL,
+        &&F_MW_DIV,
+        &&F_MW_MOD,
+        &&F_OTHER,      // MULDIV
+        &&F_MW_DIVMOD,
+        &&F_OTHER,      // MULMOD
+        &&F_MW_JMP,
+        &&F_MW_JZ,
+        &&F_OTHER,      // CALL
+        &&F_MW_LT,
+        &&F_MW_GT,
+        &&F_MW_LE,
+        &&F_MW_GE,
+        &&F_MW_EQ,
+        &&F_MW_DUP,
+        &&F_OTHER,      // DUPNZ
+        &&F_MW_DROP,
+        &&F_MW_SWAP,
+        &&F_MW_ROT,
+        &&F_MW_NROT,
+        &&F_MW_PICK,
+        &&F_OTHER,      // ROLL
+        &&F_MW_AND,
+        &&F_MW_OR,
+        &&F_MW_XOR,
+        &&F_MW_INVERT,
+        &&F_MW_SL,
+        &&F_MW_SRA,
+        &&F_MW_SRL,
+        &&F_MW_STORE,
+        &&F_OTHER,      // STOREC
+        &&F_MW_READ,
+        &&F_OTHER,      // READC
+        &&F_MW_TORS,
+        &&F_MW_FROMRS,
+        &&F_MW_CPFROMRS,
+        &&F_MW_RDROP,
+        &&F_MW_RPICK,
+        &&F_MW_HERE,
+        &&F_OTHER,      // SYSCALL1
+        &&F_OTHER,      // SYSCALL2
+        &&F_OTHER,      // SYSCALL3
+        &&F_MW_PLUSLIT,
+        &&F_MW_READLIT,
+        &&F_MW_DUPJZ,
+        &&F_MW_FORTEST,
+        &&F_MW_RPLUSLIT,
+        &&F_MW_ANDLIT,
+        &&F_MW_ORLIT,
+        &&F_MW_XORLIT,
+        &&F_MW_DO,
+        &&F_MW_LOOP,
+        &&F_MW_PLUSLOOP,
+        &&F_MW_LOOPI,
+        &&F_MW_LOOPJ,
+        &&F_OTHER,      // MOVE
+        &&F_OTHER,      // MOVEC
+        &&F_OTHER,      // FILL
+        &&F_OTHER,      // FILLC
+        &&F_OTHER,      // COMPARE
+        &&F_OTHER,      // COMPAREC
+        &&F_OTHER,      // SCAN
+        &&F_OTHER,      // SCANC
+        &&F_OTHER,      // STRLEN
+        &&F_OTHER,      // [@]
+        &&F_OTHER,      // [!]
+        &&F_OTHER,      // STRCMP
+        &&F_OTHER,      // STRCAT
+        &&F_OTHER,      // EMIT
+        &&F_OTHER,      // TYPE
+        &&F_OTHER,      // TELL
+        &&F_OTHER,      // FLUSH
+        &&F_MW_BTST,
+        &&F_MW_BSET,
+        &&F_MW_BCLR,
+        &&F_MW_BTGL,
+        &&F_MW_BFX,
+        &&F_MW_BFI,
+        &&F_MW_POPCNT,
+        &&F_MW_FFS,
+        &&F_MW_DPLUS,
+        &&F_MW_DMINUS,
+        &&F_MW_MSTAR,
+        &&F_OTHER,      // UM/MOD
+        &&F_MW_DLT,
+        &&F_MW_DEQ,
+        &&F_MW_QMUL,
+        &&F_OTHER,      // Q/
+        &&F_OTHER,      // SQRT
+        &&F_MW_MIN,
+        &&F_MW_MAX,
+        &&F_MW_CLAMP,
+        &&F_OTHER,      // INTERP
+        &&F_OTHER,      // TON
+        &&F_OTHER,      // TOF
+        &&F_OTHER,      // TP
+        &&F_OTHER,      // CTU
+        &&F_OTHER,      // CTD
+        &&F_OTHER,      // R_TRIG
+        &&F_OTHER,      // F_TRIG
+        &&F_MW_CASE,
+        &&F_MW_STORELIT,
+        &&F_MW_READX,
+        &&F_MW_STOREX,
+        &&F_MW_READCX,
+        &&F_MW_STORECX,
+        &&F_MW_READINC,
+        &&F_MW_STOREINC,
+        &&F_MW_READCINC,
+        &&F_MW_STORECINC,
+        &&F_MW_FRAME,
+        &&F_MW_UNFRAME,
+        &&F_MW_LOCALGET,
+        &&F_MW_LOCALSET,
+#ifdef FULLFITH
+        &&F_OTHER,      // STORECODE
+        &&F_OTHER,      // READCODE
+        &&F_OTHER,      // COMMA
+        &&F_OTHER,      // KEY
+        &&F_OTHER,      // WORD
+        &&F_OTHER,      // EOF
+        &&F_OTHER,      // NUMBER
+        &&F_OTHER,      // DOT
+        &&F_OTHER,      // CREATE
+        &&F_OTHER,      // FIND
+        &&F_OTHER,      // LATEST
+        &&F_OTHER,      // IMMEDIATE
+        &&F_OTHER,      // HIDDEN
+        &&F_OTHER,      // LBRAC
+        &&F_OTHER,      // RBRAC
+        &&F_OTHER,      // STATE
+        &&F_OTHER,      // INTERPRET
+        &&F_OTHER,      // DUMP
+        &&F_OTHER,      // SAVE
+        &&F_OTHER,      // GC
+        &&F_OTHER,      // INCLUDE
+        &&F_OTHER,      // FUSE
+        &&F_OTHER,      // LOCAL
+        &&F_OTHER,      // FINDLOCAL
+        &&F_OTHER,      // ENDLOCALS
+        &&F_OTHER,      // DEPTH
+#endif
+        &&call,         // DEC_CALL
+        &&bad           // DEC_BAD
+    };
+#endif
+
+    state=EX_RUNNING;
+    RELOAD();
+    NEXT;
+
+#ifndef FITH_COMPUTED_GOTO
+fetch:
+    if(CHECKED && pc >= binsz){
+        FAULT(EX_SEGV_CODE);
+    }
+    if(DECODED){
+        ins=dec[pc].op;
+        arg=dec[pc++].arg;
+        if(ins == DEC_CALL){
+            goto call;
+        }
+        if(ins == DEC_BAD){
+            goto bad;
+        }
+    }
+    else{
+        ins=code[pc++];
+        if((ins & FLAG_MACHINE) == 0){
+            goto call;
+        }
+        ins &= FLAG_ADDR;
+        // even trusted code can't index past the handlers
+        if(ins >= MW_INTERP_COUNT){
+            FAULT(EX_BAD_OPCODE);
+        }
+    }
+    TRACE(pc, ins | FLAG_MACHINE);
+
+    switch(ins){
+#endif
+
+    OP(MW_EXIT):
+        if(rp == 0){
+            state=EX_SUCCESS;
+            goto done;
+        }
+        pc=rstk[--rp];
+        NEXT;
+    OP(MW_LIT):
+    OP(MW_TICK):
+        ROOM(1);
+        OPERAND();
+        PUSH(IMM());
+        ++pc;
+        NEXT;
+    OP(MW_PLUS):
+        BINOP(dstk[sp-2] + tos);
+    OP(MW_MINUS):
+        BINOP(dstk[sp-2] - tos);
+    OP(MW_NEG):
+        NEED(1);
+        tos= -tos;
+        NEXT;
+    OP(MW_MUL):
+        BINOP(dstk[sp-2] * tos);
+    OP(MW_DIV):
+        NEED(2);
+        if(tos == 0){
+            FAULT(EX_DIV_ZERO);
+        }
+        tos=dstk[sp-2] / tos;
+        --sp;
+        NEXT;
+    OP(MW_MOD):
+        NEED(2);
+        if(tos == 0){
+            FAULT(EX_DIV_ZERO);
+        }
+        tos=dstk[sp-2] % tos;
+        --sp;
+        NEXT;
+    OP(MW_DIVMOD):
+        NEED(2);
+        if(tos == 0){
+            FAULT(EX_DIV_ZERO);
+        }
+        {
+            // at double width, so that MIN/-1 can't trap
+            long long n=dstk[sp-2];
+            dstk[sp-2]=(fith_cell) (n % tos);
+            tos=(fith_cell) (n / tos);
+        }
+        NEXT;
+    OP(MW_JMP):
+        OPERAND();
+        JUMP();
+        NEXT;
+    OP(MW_JZ):
+        NEED(1);
+        OPERAND();
+        tmp=tos;
+        POP();
+        BRANCH(tmp == 0);
+        NEXT;
+    OP(MW_LT):
+        BINOP((dstk[sp-2] < tos) ? 1 : 0);
+    OP(MW_GT):
+        BINOP((dstk[sp-2] > tos) ? 1 : 0);
+    OP(MW_LE):
+        BINOP((dstk[sp-2] <= tos) ? 1 : 0);
+    OP(MW_GE):
+        BINOP((dstk[sp-2] >= tos) ? 1 : 0);
+    OP(MW_EQ):
+        BINOP((dstk[sp-2] == tos) ? 1 : 0);
+    OP(MW_DUP):
+        NEED(1);
+        ROOM(1);
+        dstk[sp-1]=tos;
+        ++sp;
+        NEXT;
+    OP(MW_DROP):
+        NEED(1);
+        POP();
+        NEXT;
+    OP(MW_SWAP):
+        NEED(2);
+        tmp=dstk[sp-2];
+        dstk[sp-2]=tos;
+        tos=tmp;
+        NEXT;
+    OP(MW_ROT):
+        NEED(3);
+        tmp=dstk[sp-3];
+        dstk[sp-3]=dstk[sp-2];
+        dstk[sp-2]=tos;
+        tos=tmp;
+        NEXT;
+    OP(MW_NROT):
+        NEED(3);
+        tmp=tos;
+        tos=dstk[sp-2];
+        dstk[sp-2]=dstk[sp-3];
+        dstk[sp-3]=tmp;
+        NEXT;
+    OP(MW_PICK):
+        // index is only known at runtime, always check
+        if(sp < 2 || tos < 0 || sp < size_t(tos+2)){
+            FAULT(EX_DSTK_UNDER);
+        }
+        tos=dstk[sp-tos-2];
+        NEXT;
+    OP(MW_AND):
+        BINOP(dstk[sp-2] & tos);
+    OP(MW_OR):
+        BINOP(dstk[sp-2] | tos);
+    OP(MW_XOR):
+        BINOP(dstk[sp-2] ^ tos);
+    OP(MW_INVERT):
+        NEED(1);
+        tos= ~tos;
+        NEXT;
+    OP(MW_SL):
+        BINOP(dstk[sp-2] << tos);
+    OP(MW_SRA):
+        BINOP(dstk[sp-2] >> tos);
+    OP(MW_SRL):
+        BINOP((fith_cell) (((unsigned long) dstk[sp-2]) >> tos));
+    OP(MW_STORE):
+        NEED(2);
+        if(size_t(tos) >= heapsz){
+            FAULT(EX_SEGV_DATA);
+        }
+        heap[tos]=dstk[sp-2];
+        --sp;
+        POP();
+        NEXT;
+    OP(MW_READ):
+        NEED(1);
+        if(size_t(tos) >= heapsz){
+            FAULT(EX_SEGV_DATA);
+        }
+        tos=heap[tos];
+        NEXT;
+    OP(MW_TORS):
+        NEED(1);
+        RROOM(1);
+        rstk[rp++]=tos;
+        POP();
+        NEXT;
+    OP(MW_FROMRS):
+        RNEED(1);
+        ROOM(1);
+        PUSH(rstk[--rp]);
+        NEXT;
+    OP(MW_CPFROMRS):
+        RNEED(1);
+        ROOM(1);
+        PUSH(rstk[rp-1]);
+        NEXT;
+    OP(MW_RDROP):
+        RNEED(1);
+        --rp;
+        NEXT;
+    OP(MW_RPICK):
+        NEED(1);
+        if(tos < 0 || rp < size_t(1+tos)){
+            FAULT(EX_RSTK_UNDER);
+        }
+        tos=rstk[rp-tos-1];
+        NEXT;
+    OP(MW_HERE):
+        ROOM(1);
+        PUSH(0);
+        NEXT;
+    OP(MW_PLUSLIT):
+        NEED(1);
+        OPERAND();
+        tos+=IMM();
+        ++pc;
+        NEXT;
+    OP(MW_READLIT):
+        ROOM(1);
+        OPERAND();
+        tmp=IMM();
+        ++pc;
+        if(size_t(tmp) >= heapsz){
+            FAULT(EX_SEGV_DATA);
+        }
+        PUSH(heap[tmp]);
+        NEXT;
+    OP(MW_DUPJZ):
+        NEED(1);
+        OPERAND();
+        BRANCH(tos == 0);
+        NEXT;
+    OP(MW_FORTEST):
+        RNEED(2);
+        ROOM(1);
+        PUSH((rstk[rp-1] < rstk[rp-2]) ? 1 : 0);
+        NEXT;
+    OP(MW_RPLUSLIT):
+        RNEED(1);
+        OPERAND();
+        rstk[rp-1]+=IMM();
+        ++pc;
+        NEXT;
+    OP(MW_ANDLIT):
+        NEED(1);
+        OPERAND();
+        tos&=IMM();
+        ++pc;
+        NEXT;
+    OP(MW_ORLIT):
+        NEED(1);
+        OPERAND();
+        tos|=IMM();
+        ++pc;
+        NEXT;
+    OP(MW_XORLIT):
+        NEED(1);
+        OPERAND();
+        tos^=IMM();
+        ++pc;
+        NEXT;
+    OP(MW_DO):
+        NEED(2);
+        RROOM(2);
+        OPERAND();
+        rstk[rp++]=dstk[sp-2];
+        rstk[rp++]=tos;
+        --sp;
+        POP();
+        BRANCH(rstk[rp-1] >= rstk[rp-2]);
+        NEXT;
+    OP(MW_LOOP):
+        RNEED(2);
+        OPERAND();
+        BRANCH(++rstk[rp-1] < rstk[rp-2]);
+        NEXT;
+    OP(MW_PLUSLOOP):
+        NEED(1);
+        RNEED(2);
+        OPERAND();
+        rstk[rp-1]+=tos;
+        POP();
+        BRANCH(rstk[rp-1] < rstk[rp-2]);
+        NEXT;
+    OP(MW_LOOPI):
+        RNEED(1);
+        ROOM(1);
+        PUSH(rstk[rp-1]);
+        NEXT;
+    OP(MW_LOOPJ):
+        RNEED(3);
+        ROOM(1);
+        PUSH(rstk[rp-3]);
+        NEXT;
+    OP(MW_BTST):
+        BINOP((unsigned(dstk[sp-2]) & bit_mask(tos)) ? 1 : 0);
+    OP(MW_BSET):
+        BINOP(dstk[sp-2] | bit_mask(tos));
+    OP(MW_BCLR):
+        BINOP(dstk[sp-2] & ~bit_mask(tos));
+    OP(MW_BTGL):
+        BINOP(dstk[sp-2] ^ bit_mask(tos));
+    OP(MW_BFX):
+        NEED(3);
+        tos=bit_extract(dstk[sp-3], dstk[sp-2], tos);
+        sp-=2;
+        NEXT;
+    OP(MW_BFI):
+        NEED(4);
+        tos=bit_insert(dstk[sp-4], dstk[sp-3], dstk[sp-2], tos);
+        sp-=3;
+        NEXT;
+    OP(MW_POPCNT):
+        NEED(1);
+        tos=bit_count(tos);
+        NEXT;
+    OP(MW_FFS):
+        NEED(1);
+        tos=bit_first(tos);
+        NEXT;
+    OP(MW_DPLUS):
+        NEED(4);
+        {
+            unsigned long long d=dcell(dstk[sp-4], dstk[sp-3])+dcell(dstk[sp-2], tos);
+            dstk[sp-4]=dcell_lo(d);
+            tos=dcell_hi(d);
+        }
+        sp-=2;
+        NEXT;
+    OP(MW_DMINUS):
+        NEED(4);
+        {
+            unsigned long long d=dcell(dstk[sp-4], dstk[sp-3])-dcell(dstk[sp-2], tos);
+            dstk[sp-4]=dcell_lo(d);
+            tos=dcell_hi(d);
+        }
+        sp-=2;
+        NEXT;
+    OP(MW_MSTAR):
+        NEED(2);
+        {
+            unsigned long long d=((long long) dstk[sp-2])*tos;
+            dstk[sp-2]=dcell_lo(d);
+            tos=dcell_hi(d);
+        }
+        NEXT;
+    OP(MW_DLT):
+        NEED(4);
+        tos=((long long) dcell(dstk[sp-4], dstk[sp-3]) < (long long) dcell(dstk[sp-2], tos)) ? 1 : 0;
+        sp-=3;
+        NEXT;
+    OP(MW_DEQ):
+        NEED(4);
+        tos=(dstk[sp-4] == dstk[sp-2] && dstk[sp-3] == tos) ? 1 : 0;
+        sp-=3;
+        NEXT;
+    OP(MW_QMUL):
+        BINOP(qmul(dstk[sp-2], tos));
+    OP(MW_MIN):
+        BINOP((dstk[sp-2] < tos) ? dstk[sp-2] : tos);
+    OP(MW_MAX):
+        BINOP((dstk[sp-2] > tos) ? dstk[sp-2] : tos);
+    OP(MW_CLAMP):
+        NEED(3);
+        tmp=dstk[sp-3];
+        tos=(tmp < dstk[sp-2]) ? dstk[sp-2] : (tmp > tos) ? tos : tmp;
+        sp-=2;
+        NEXT;
+    OP(MW_CASE):
+        // the table isn't pre-decoded, so read it from the binary
+        NEED(1);
+        OPERAND();
+        tmp=code[pc];
+        if(CHECKED && (tmp < 0 || pc+1+tmp >= binsz)) FAULT(EX_SEGV_CODE);
+        off=(tos >= 0 && tos < tmp) ? code[pc+2+tos] : code[pc+1];
+        POP();
+        pc+=off-1;
+        if(off <= 0) CHARGE();
+        NEXT;
+    OP(MW_STORELIT):
+        NEED(1);
+        OPERAND();
+        tmp=IMM();
+        ++pc;
+        if(size_t(tmp) >= heapsz){
+            FAULT(EX_SEGV_DATA);
+        }
+        heap[tmp]=tos;
+        POP();
+        NEXT;
+    OP(MW_READX):
+        NEED(2);
+        tmp=dstk[sp-2]+tos;
+        if(size_t(tmp) >= heapsz){
+            FAULT(EX_SEGV_DATA);
+        }
+        tos=heap[tmp];
+        --sp;
+        NEXT;
+    OP(MW_STOREX):
+        NEED(3);
+        tmp=dstk[sp-2]+tos;
+        if(size_t(tmp) >= heapsz){
+            FAULT(EX_SEGV_DATA);
+        }
+        heap[tmp]=dstk[sp-3];
+        sp-=2;
+        POP();
+        NEXT;
+    OP(MW_READCX):
+        NEED(2);
+        tmp=dstk[sp-2]+tos;
+        if(size_t(tmp) >= heapsz*sizeof(fith_cell)){
+            FAULT(EX_SEGV_DATA);
+        }
+        tos=((const char *) heap)[tmp];
+        --sp;
+        NEXT;
+    OP(MW_STORECX):
+        NEED(3);
+        tmp=dstk[sp-2]+tos;
+        if(size_t(tmp) >= heapsz*sizeof(fith_cell)){
+            FAULT(EX_SEGV_DATA);
+        }
+        ((char *) heap)[tmp]=dstk[sp-3] & 0xFF;
+        sp-=2;
+        POP();
+        NEXT;
+    OP(MW_READINC):
+        NEED(1);
+        ROOM(1);
+        if(size_t(tos) >= heapsz){
+            FAULT(EX_SEGV_DATA);
+        }
+        tmp=heap[tos++];
+        PUSH(tmp);
+        NEXT;
+    OP(MW_STOREINC):
+        NEED(2);
+        if(size_t(tos) >= heapsz){
+            FAULT(EX_SEGV_DATA);
+        }
+        heap[tos++]=dstk[sp-2];
+        --sp;
+        NEXT;
+    OP(MW_READCINC):
+        NEED(1);
+        ROOM(1);
+        if(size_t(tos) >= heapsz*sizeof(fith_cell)){
+            FAULT(EX_SEGV_DATA);
+        }
+        tmp=((const char *) heap)[tos++];
+        PUSH(tmp);
+        NEXT;
+    OP(MW_STORECINC):
+        NEED(2);
+        if(size_t(tos) >= heapsz*sizeof(fith_cell)){
+            FAULT(EX_SEGV_DATA);
+        }
+        ((char *) heap)[tos++]=dstk[sp-2] & 0xFF;
+        --sp;
+        NEXT;
+    OP(MW_FRAME):
+        OPERAND();
+        tmp=IMM();
+        ++pc;
+        if(CHECKED && size_t(tmp) > sp) FAULT(EX_DSTK_UNDER);
+        RROOM(tmp);
+        if(tmp > 0){
+            dstk[sp-1]=tos;
+            sp-=tmp;
+            memcpy(rstk+rp, dstk+sp, tmp*sizeof(fith_cell));
+            rp+=tmp;
+            if(sp) tos=dstk[sp-1];
+        }
+        NEXT;
+    OP(MW_UNFRAME):
+        OPERAND();
+        tmp=IMM();
+        ++pc;
+        if(CHECKED && size_t(tmp) > rp) FAULT(EX_RSTK_UNDER);
+        rp-=tmp;
+        NEXT;
+    OP(MW_LOCALGET):
+        ROOM(1);
+        OPERAND();
+        tmp=IMM();
+        ++pc;
+        if(CHECKED && size_t(tmp) >= rp) FAULT(EX_RSTK_UNDER);
+        PUSH(rstk[rp-1-tmp]);
+        NEXT;
+    OP(MW_LOCALSET):
+        NEED(1);
+        OPERAND();
+        tmp=IMM();
+        ++pc;
+        if(CHECKED && size_t(tmp) >= rp) FAULT(EX_RSTK_UNDER);
+        rstk[rp-1-tmp]=tos;
+        POP();
+        NEXT;
+    OTHER:
+        // everything else goes through the checked handler
+        SPILL();
+        (this->*builtin[ins])();
+        if(state != EX_RUNNING){
+            return state;
+        }
+        RELOAD();
+        NEXT;
+
+#ifndef FITH_COMPUTED_GOTO
+    }
+#endif
+
+call:
+    if(!DECODED){
+        arg=ins & FLAG_ADDR;
+    }
+    TRACE(pc, arg);
+    RROOM(1);
+    rstk[rp++]=pc;
+    pc=arg;
+    CHARGE();
+    NEXT;
+
+bad:
+    FAULT(EX_BAD_OPCODE);
+
+done:
+    SPILL();
+    return state;
+}
+
+#undef NEXT
+#undef OTHER
+#undef OP
+#undef BRANCH
+#undef JUMP
+#undef CHARGE
+#undef IMM
+#undef TRACE
+#undef BINOP
+#undef POP
+#undef PUSH
+#undef OPERAND
+#undef RROOM
+#undef RNEED
+#undef ROOM
+#undef NEED
+#undef FAULT
+#undef RELOAD
+#undef SPILL
+#undef TRACE_CALL
+#undef TRACE_OP
+
+void Interpreter::Context::set_ip(size_t _ip)
+{
+    ip=_ip;
+}
+
+void Interpreter::Context::set_mode(EXEC_MODE _mode)
+{
+    mode=_mode;
+}
+
+#ifdef FULLFITH
+
+void Interpreter::Context::printdump(ostream &s)
+{
+    s << "************************" << endl;
+    s << "context state = " << states[state] << endl;
+    s << "IP = " << ip << endl << "D:";
+    size_t stklen=dsp > 6 ? 6 : dsp;
+    for(size_t i=stklen; i>0; --i){
+        s << " " << dstk[dsp-i];
+    }
+    s << endl << "R:";
+    stklen=rsp > 6 ? 6 : rsp;
+    for(size_t i=stklen; i>0; --i){
+        s << " " << rstk[rsp-i];
+    }
+    s << endl;
+    s << "************************" << endl;
+}
+
+#endif
+
+/*
+ * Here be the implementations of the builtin words
+ */
+
+void Interpreter::Context::mw_exit()
+{
+    if(rsp == 0){
+        // returned from top-level function
+        state=Interpreter::EX_SUCCESS;
+    }
+    else{
+        // jump back
+        ip=rstk[--rsp];
+    }
+}
+
+void Interpreter::Context::mw_lit()
+{
+    if(dsp >= dsz){
+        // stack overflow
+        state=Interpreter::EX_DSTK_OVER;
+    }
+    else if(ip >= interp.binsz){
+        // opcode trails off the end of the binary
+        state=Interpreter::EX_SEGV_CODE;
+    }
+    else{
+        // push literal
+        dstk[dsp++]=interp.bin[ip++];
+    }
+}
+
+void Interpreter::Context::mw_tick()
+{
+    if(dsp >= dsz){
+        // stack overflow
+        state=Interpreter::EX_DSTK_OVER;
+    }
+    else if(ip >= interp.binsz){
+        // opcode trails off the end of the binary
+        state=Interpreter::EX_SEGV_CODE;
+    }
+    else{
+        // push literal
+        dstk[dsp++]=interp.bin[ip++];
+    }
+}
+
+void Interpreter::Context::mw_plus()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+    }
+    else{
+        --dsp;
+        dstk[dsp-1]=dstk[dsp-1] + dstk[dsp];
+    }
+}
+
+void Interpreter::Context::mw_minus()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+    }
+    else{
+        --dsp;
+        dstk[dsp-1]=dstk[dsp-1] - dstk[dsp];
+    }
+}
+
+void Interpreter::Context::mw_neg()
+{
+    if(dsp < 1){
+        state=Interpreter::EX_DSTK_UNDER;
+    }
+    else{
+        dstk[dsp-1]= -dstk[dsp-1];
+    }
+}
+
+void Interpreter::Context::mw_mul()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+    }
+    else{
+        --dsp;
+        dstk[dsp-1]=dstk[dsp-1] * dstk[dsp];
+    }
+}
+
+void Interpreter::Context::mw_div()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+    }
+    else if(dstk[dsp-1] == 0){
+        state=Interpreter::EX_DIV_ZERO;
+    }
+    else{        
+        --dsp;
+        dstk[dsp-1]=dstk[dsp-1] / dstk[dsp];
     }
 }
 
 void Interpreter::Context::mw_mod()
 {
-    if(dsp < 2){
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+    }
+    else if(dstk[dsp-1] == 0){
+        state=Interpreter::EX_DIV_ZERO;
+    }
+    else{        
+        --dsp;
+        dstk[dsp-1]=dstk[dsp-1] % dstk[dsp];
+    }
+}
+
+void Interpreter::Context::mw_muldiv()
+{
+    if(dsp < 3){
+        state=Interpreter::EX_DSTK_UNDER;
+    }
+    else if(dstk[dsp-1] == 0){
+        state=Interpreter::EX_DIV_ZERO;
+    }
+    else{
+        // 64-bit mul (keep all the bits)
+        long long prod=((long long) dstk[dsp-3]) * ((long long) dstk[dsp-2]);
+        // then divide; discard upper bits
+        fith_cell div=(fith_cell) ((prod/dstk[dsp-1]) & 0xFFFFFFFF);
+        dsp-=2;
+        dstk[dsp-1]=div;
+    }
+}
+
+// ( n1 n2 -- rem quot )
+void Interpreter::Context::mw_divmod()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+    }
+    else if(dstk[dsp-1] == 0){
+        state=Interpreter::EX_DIV_ZERO;
+    }
+    else{
+        // at double width, so that MIN/-1 can't trap
+        long long n=dstk[dsp-2], d=dstk[dsp-1];
+        dstk[dsp-2]=(fith_cell) (n % d);
+        dstk[dsp-1]=(fith_cell) (n / d);
+    }
+}
+
+// ( n1 n2 n3 -- rem quot )
+void Interpreter::Context::mw_mulmod()
+{
+    if(dsp < 3){
+        state=Interpreter::EX_DSTK_UNDER;
+    }
+    else if(dstk[dsp-1] == 0){
+        state=Interpreter::EX_DIV_ZERO;
+    }
+    else{
+        // as */, keeping the remainder too
+        long long prod=((long long) dstk[dsp-3]) * ((long long) dstk[dsp-2]);
+        long long d=dstk[dsp-1];
+        --dsp;
+        dstk[dsp-2]=(fith_cell) (prod % d);
+        dstk[dsp-1]=(fith_cell) ((prod / d) & 0xFFFFFFFF);
+    }
+}
+
+void Interpreter::Context::mw_jmp()
+{
+    if(ip >= interp.binsz){
+        // opcode trails off the end of the binary
+        state=Interpreter::EX_SEGV_CODE;
+    }
+    else{
+        // move the IP by the specified offset wrt the start of the JMP instruction
+        branch();
+    }
+}
+
+void Interpreter::Context::mw_jz()
+{
+    if(dsp < 1){
+        // do we have a test-value
+        state=Interpreter::EX_DSTK_UNDER;
+    }
+    else if(ip >= interp.binsz){
+        // opcode trails off the end of the binary
+        state=Interpreter::EX_SEGV_CODE;
+    }
+    else{
+        // pop test-value
+        fith_cell tv=dstk[--dsp];
+
+        if(tv == 0){
+            // move the IP by the specified offset wrt the start of the JMP instruction
+            branch();
+        }
+        else{
+            // no branch, skip over the offset to next instruction
+            ++ip;
+        }
+    }
+}
+
+void Interpreter::Context::mw_call()
+{
+    if(dsp < 1){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    fith_cell tgt=dstk[--dsp];
+    
+    if((tgt & FLAG_MACHINE) != 0){
+        // builtin word, just run it
+        // gonna be fun if it's MW_CALL :)
+        tgt &= FLAG_ADDR;
+        if(tgt >= Interpreter::MW_INTERP_COUNT){
+            state=Interpreter::EX_BAD_OPCODE;
+            return;
+        }
+        // exec it
+        (this->*builtin[tgt])();
+    }
+    else{
+        if(rsp >= rsz){
+            state=Interpreter::EX_RSTK_OVER;
+            return;
+        }
+
+        // clear any flag bits there might be
+        tgt &= FLAG_ADDR;
+
+        // call = push return, branch
+        rstk[rsp++]=ip;  // IP was inc'd before we were called, so this is where to return to
+        ip=tgt;
+        charge();
+
+        // we don't validate the target address here, it will get
+        // checked before fetch in the next cycle of execute()
+    }
+}
+    
+void Interpreter::Context::mw_lt()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    --dsp;
+    dstk[dsp-1]=(dstk[dsp-1] < dstk[dsp]) ? 1 : 0;
+}
+
+void Interpreter::Context::mw_gt()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    --dsp;
+    dstk[dsp-1]=(dstk[dsp-1] > dstk[dsp]) ? 1 : 0;
+}
+
+void Interpreter::Context::mw_le()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    --dsp;
+    dstk[dsp-1]=(dstk[dsp-1] <= dstk[dsp]) ? 1 : 0;
+}
+
+void Interpreter::Context::mw_ge()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    --dsp;
+    dstk[dsp-1]=(dstk[dsp-1] >= dstk[dsp]) ? 1 : 0;
+}
+
+void Interpreter::Context::mw_eq()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    --dsp;
+    dstk[dsp-1]=(dstk[dsp-1] == dstk[dsp]) ? 1 : 0;
+}
+
+void Interpreter::Context::mw_dup()
+{
+    if(dsp < 1){
+        state=Interpreter::EX_DSTK_UNDER;
+    }
+    else if(dsp >= dsz){
+        state=Interpreter::EX_DSTK_OVER;
+    }
+    else{
+        fith_cell c=dstk[dsp-1];
+        dstk[dsp++]=c;
+    }
+}
+
+void Interpreter::Context::mw_dupnz()
+{
+    if(dsp < 1){
+        state=Interpreter::EX_DSTK_UNDER;
+    }
+    else if(dsp >= dsz){
+        state=Interpreter::EX_DSTK_OVER;
+    }
+    else{
+        fith_cell c=dstk[dsp-1];
+        if(c != 0){
+            dstk[dsp++]=c;
+        }
+    }
+}
+
+void Interpreter::Context::mw_drop()
+{
+    if(dsp < 1){
+        state=Interpreter::EX_DSTK_UNDER;
+    }
+    else{
+        --dsp;
+    }
+}
+
+void Interpreter::Context::mw_swap()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+    }
+    else{
+        fith_cell tmp=dstk[dsp-1];
+        dstk[dsp-1]=dstk[dsp-2];
+        dstk[dsp-2]=tmp;
+    }
+}
+
+void Interpreter::Context::mw_rot()
+{
+    if(dsp < 3){
+        state=Interpreter::EX_DSTK_UNDER;
+    }
+    else{
+        fith_cell tmp=dstk[dsp-3];
+        dstk[dsp-3]=dstk[dsp-2];
+        dstk[dsp-2]=dstk[dsp-1];
+        dstk[dsp-1]=tmp;
+    }
+}
+void Interpreter::Context::mw_nrot()
+{
+    if(dsp < 3){
+        state=Interpreter::EX_DSTK_UNDER;
+    }
+    else{
+        fith_cell tmp=dstk[dsp-1];
+        dstk[dsp-1]=dstk[dsp-2];
+        dstk[dsp-2]=dstk[dsp-3];
+        dstk[dsp-3]=tmp;
+    }
+}
+void Interpreter::Context::mw_pick()
+{
+    if(dsp < 2 || dstk[dsp-1] < 0 || dsp < size_t(dstk[dsp-1]+2)){
+        state=Interpreter::EX_DSTK_UNDER;
+    }
+    else{
+        dstk[dsp-1]=dstk[dsp-dstk[dsp-1]-2];
+    }
+}
+void Interpreter::Context::mw_roll()
+{
+    if(dsp < 2 || dsp < size_t(abs(dstk[dsp-1])+1)){
+        state=Interpreter::EX_DSTK_UNDER;
+    }
+    else{
+        fith_cell n=dstk[--dsp];
+
+        if(n > 1){
+            // roll n cells upwards, updating the range [-n .. -1]
+            fith_cell tmp=dstk[dsp-n];
+            for(fith_cell i=n;i>1;--i){
+                dstk[dsp-i]=dstk[dsp-i+1];
+            }
+            dstk[dsp-1]=tmp;
+        }
+        else if(n < 1){
+            // roll downwards, updating [-n .. -1
+            n=-n;
+            fith_cell tmp=dstk[dsp-1];
+            for(fith_cell i=1;i<n;++i){
+                dstk[dsp-i]=dstk[dsp-i-1];
+            }
+            dstk[dsp-n]=tmp;
+        }
+    }
+}
+
+void Interpreter::Context::mw_and()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    --dsp;
+    dstk[dsp-1] &= dstk[dsp];
+}
+
+void Interpreter::Context::mw_or()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    --dsp;
+    dstk[dsp-1] |= dstk[dsp];
+}
+
+void Interpreter::Context::mw_xor()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    --dsp;
+    dstk[dsp-1] ^= dstk[dsp];
+}
+
+void Interpreter::Context::mw_invert()
+{
+    if(dsp < 1){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    dstk[dsp-1] = ~dstk[dsp-1];
+}
+
+void Interpreter::Context::mw_sl()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    --dsp;
+    dstk[dsp-1] <<= dstk[dsp];
+}
+
+void Interpreter::Context::mw_sra()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    --dsp;
+    dstk[dsp-1] >>= dstk[dsp];
+}
+
+void Interpreter::Context::mw_srl()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    --dsp;
+    unsigned long c=(unsigned long) dstk[dsp-1];
+    c >>= dstk[dsp];
+    dstk[dsp-1]=(fith_cell) c;
+}
+
+// ( val addr -- )
+void Interpreter::Context::mw_store()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    size_t ptr=(size_t) dstk[dsp-1];
+    if(ptr >= interp.heapsz){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
+    }
+    interp.heap[ptr]=dstk[dsp-2];
+    dsp-=2;
+}
+
+// ( val addr -- )
+void Interpreter::Context::mw_storec()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    size_t ptr=(size_t) dstk[dsp-1];
+    if(ptr >= interp.heapsz*sizeof(fith_cell)){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
+    }
+    ((char *) interp.heap)[ptr]=dstk[dsp-2] & 0xFF;
+    dsp-=2;
+}
+
+void Interpreter::Context::mw_read()
+{
+    if(dsp < 1){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    size_t ptr=(size_t) dstk[dsp-1];
+    if(ptr >= interp.heapsz){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
+    }
+    dstk[dsp-1]=interp.heap[ptr];
+}
+
+void Interpreter::Context::mw_readc()
+{
+    if(dsp < 1){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    size_t ptr=(size_t) dstk[dsp-1];
+    if(ptr >= interp.heapsz*sizeof(fith_cell)){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
+    }
+    dstk[dsp-1]=((char *) interp.heap)[ptr];
+}
+
+
+void Interpreter::Context::mw_tors()
+{
+    if(dsp < 1){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    if(rsp >= rsz){
+        state=Interpreter::EX_RSTK_OVER;
+        return;
+    }
+    
+    rstk[rsp++]=dstk[--dsp];
+}
+
+void Interpreter::Context::mw_fromrs()
+{
+    if(rsp < 1){
+        state=Interpreter::EX_RSTK_UNDER;
+        return;
+    }
+    if(dsp >= dsz){
+        state=Interpreter::EX_DSTK_OVER;
+        return;
+    }
+    
+    dstk[dsp++]=rstk[--rsp];
+}
+
+void Interpreter::Context::mw_cpfromrs()
+{
+    if(rsp < 1){
+        state=Interpreter::EX_RSTK_UNDER;
+        return;
+    }
+    if(dsp >= dsz){
+        state=Interpreter::EX_DSTK_OVER;
+        return;
+    }
+    
+    dstk[dsp++]=rstk[rsp-1];
+}
+
+void Interpreter::Context::mw_rdrop()
+{
+    if(rsp < 1){
+        state=Interpreter::EX_RSTK_UNDER;
+        return;
+    }
+    
+    --rsp;
+}
+
+void Interpreter::Context::mw_rpick()
+{    
+    if(dsp < 1){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    fith_cell n=dstk[dsp-1];
+    if(n < 0 || rsp < size_t(1+n)){
+        state=Interpreter::EX_RSTK_UNDER;
+        return;
+    }
+    
+    dstk[dsp-1]=rstk[rsp-n-1];
+}
+
+void Interpreter::Context::mw_here()
+{
+    if(dsp >= dsz){
+        state=Interpreter::EX_DSTK_OVER;
+        return;
+    }
+    dstk[dsp++]=0;
+}
+
+void Interpreter::Context::mw_syscall1()
+{
+    if(dsp < 1){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+#if !defined(NDEBUG) && defined(FULLFITH)
+    cerr << "syscall1(" << dstk[dsp-1] << ")" << endl;
+#endif
+    // so that output keeps its order with anything the syscall does
+    flush();
+    if(interp.syscalls){
+        dstk[dsp-1]=interp.syscalls->syscall1(dstk[dsp-1]);
+    }
+    else{
+        dstk[dsp-1]=0;
+    }
+}
+
+void Interpreter::Context::mw_syscall2()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+#if !defined(NDEBUG) && defined(FULLFITH)
+    cerr << "syscall2(" << dstk[dsp-2] << ", " << dstk[dsp-1] << ")" << endl;
+#endif
+    fith_cell b=dstk[--dsp], a=dstk[dsp-1];
+    flush();
+    if(interp.syscalls){
+        dstk[dsp-1]=interp.syscalls->syscall2(a, b);
+    }
+    else{
+        dstk[dsp-1]=0;
+    }
+}
+
+void Interpreter::Context::mw_syscall3()
+{
+    if(dsp < 3){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+#if !defined(NDEBUG) && defined(FULLFITH)
+    cerr << "syscall3(" << dstk[dsp-3] << ", " << dstk[dsp-2] << ", " << dstk[dsp-1] << ")" << endl;
+#endif
+    fith_cell c=dstk[--dsp],  b=dstk[--dsp], a=dstk[dsp-1];
+    flush();
+    if(interp.syscalls){
+        dstk[dsp-1]=interp.syscalls->syscall3(a, b, c);
+    }
+    else{
+        dstk[dsp-1]=0;
+    }
+}
+
+/*
+ * Superinstructions: each does the same as the sequence it replaces, in
+ * one dispatch.  Only the checks for the fused op's own net stack effect
+ * are made, so they never fail where the original sequence would not.
+ */
+
+// LIT n +
+void Interpreter::Context::mw_pluslit()
+{
+    if(dsp < 1){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    if(ip >= interp.binsz){
+        state=Interpreter::EX_SEGV_CODE;
+        return;
+    }
+    dstk[dsp-1]+=interp.bin[ip++];
+}
+
+// LIT addr @
+void Interpreter::Context::mw_readlit()
+{
+    if(dsp >= dsz){
+        state=Interpreter::EX_DSTK_OVER;
+        return;
+    }
+    if(ip >= interp.binsz){
+        state=Interpreter::EX_SEGV_CODE;
+        return;
+    }
+    size_t ptr=(size_t) interp.bin[ip++];
+    if(ptr >= interp.heapsz){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
+    }
+    dstk[dsp++]=interp.heap[ptr];
+}
+
+// DUP JZ off
+void Interpreter::Context::mw_dupjz()
+{
+    if(dsp < 1){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    if(ip >= interp.binsz){
+        state=Interpreter::EX_SEGV_CODE;
+        return;
+    }
+
+    if(dstk[dsp-1] == 0){
+        // offset is wrt the start of the instruction
+        branch();
+    }
+    else{
+        ++ip;
+    }
+}
+
+// R> R@ OVER >R <
+// ( -- pos<limit ) R:( limit pos -- limit pos )
+void Interpreter::Context::mw_fortest()
+{
+    if(rsp < 2){
+        state=Interpreter::EX_RSTK_UNDER;
+        return;
+    }
+    if(dsp >= dsz){
+        state=Interpreter::EX_DSTK_OVER;
+        return;
+    }
+    dstk[dsp++]=(rstk[rsp-1] < rstk[rsp-2]) ? 1 : 0;
+}
+
+// R> LIT n + >R
+void Interpreter::Context::mw_rpluslit()
+{
+    if(rsp < 1){
+        state=Interpreter::EX_RSTK_UNDER;
+        return;
+    }
+    if(ip >= interp.binsz){
+        state=Interpreter::EX_SEGV_CODE;
+        return;
+    }
+    rstk[rsp-1]+=interp.bin[ip++];
+}
+
+// LIT m &, and LIT m ~ & with the mask inverted by fuse()
+void Interpreter::Context::mw_andlit()
+{
+    if(dsp < 1){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    if(ip >= interp.binsz){
+        state=Interpreter::EX_SEGV_CODE;
+        return;
+    }
+    dstk[dsp-1]&=interp.bin[ip++];
+}
+
+// LIT m |
+void Interpreter::Context::mw_orlit()
+{
+    if(dsp < 1){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    if(ip >= interp.binsz){
+        state=Interpreter::EX_SEGV_CODE;
+        return;
+    }
+    dstk[dsp-1]|=interp.bin[ip++];
+}
+
+// LIT m ^
+void Interpreter::Context::mw_xorlit()
+{
+    if(dsp < 1){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    if(ip >= interp.binsz){
+        state=Interpreter::EX_SEGV_CODE;
+        return;
+    }
+    dstk[dsp-1]^=interp.bin[ip++];
+}
+
+/*
+ * Counted loops.  FOR compiles (DO), ROF compiles (LOOP) and +ROF compiles
+ * (+LOOP), each followed by an offset wrt the opcode.  The limit and index
+ * live on the return stack exactly as they did when FOR was built from >R,
+ * so RDROP RDROP after the loop still cleans up.
+ */
+
+// ( limit start -- ) R:( -- limit start )
+void Interpreter::Context::mw_do()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    if(rsp+2 > rsz){
+        state=Interpreter::EX_RSTK_OVER;
+        return;
+    }
+    if(ip >= interp.binsz){
+        state=Interpreter::EX_SEGV_CODE;
+        return;
+    }
+
+    dsp-=2;
+    fith_cell limit=dstk[dsp], start=dstk[dsp+1];
+    rstk[rsp++]=limit;
+    rstk[rsp++]=start;
+
+    if(start < limit){
+        // into the body
+        ++ip;
+    }
+    else{
+        // skip to the cleanup at the end
+        branch();
+    }
+}
+
+// R:( limit index -- limit index+1 )
+void Interpreter::Context::mw_loop()
+{
+    if(rsp < 2){
+        state=Interpreter::EX_RSTK_UNDER;
+        return;
+    }
+    if(ip >= interp.binsz){
+        state=Interpreter::EX_SEGV_CODE;
+        return;
+    }
+
+    if(++rstk[rsp-1] < rstk[rsp-2]){
+        // back to the top of the body
+        branch();
+    }
+    else{
+        ++ip;
+    }
+}
+
+// ( delta -- ) R:( limit index -- limit index+delta )
+void Interpreter::Context::mw_plusloop()
+{
+    if(dsp < 1){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    if(rsp < 2){
+        state=Interpreter::EX_RSTK_UNDER;
+        return;
+    }
+    if(ip >= interp.binsz){
+        state=Interpreter::EX_SEGV_CODE;
+        return;
+    }
+
+    rstk[rsp-1]+=dstk[--dsp];
+    if(rstk[rsp-1] < rstk[rsp-2]){
+        branch();
+    }
+    else{
+        ++ip;
+    }
+}
+
+void Interpreter::Context::mw_loopi()
+{
+    if(rsp < 1){
+        state=Interpreter::EX_RSTK_UNDER;
+        return;
+    }
+    if(dsp >= dsz){
+        state=Interpreter::EX_DSTK_OVER;
+        return;
+    }
+    dstk[dsp++]=rstk[rsp-1];
+}
+
+void Interpreter::Context::mw_loopj()
+{
+    if(rsp < 3){
+        state=Interpreter::EX_RSTK_UNDER;
+        return;
+    }
+    if(dsp >= dsz){
+        state=Interpreter::EX_DSTK_OVER;
+        return;
+    }
+    dstk[dsp++]=rstk[rsp-3];
+}
+
+/*
+ * Bulk operations check the whole range up-front and then leave the work
+ * to memmove() and friends, which use wide loads and stores.
+ */
+
+/// does [p, p+n) lie within a space of lim cells or bytes?
+static inline bool in_range(fith_cell p, fith_cell n, size_t lim)
+{
+    return p >= 0 && n >= 0 && size_t(p) <= lim && size_t(n) <= lim-size_t(p);
+}
+
+// ( src dst n -- )
+void Interpreter::Context::mw_move()
+{
+    if(dsp < 3){
         state=Interpreter::EX_DSTK_UNDER;
+        return;
     }
-    else if(dstk[dsp-1] == 0){
-        state=Interpreter::EX_DIV_ZERO;
+    fith_cell src=dstk[dsp-3], dst=dstk[dsp-2], n=dstk[dsp-1];
+    if(!in_range(src, n, interp.heapsz) || !in_range(dst, n, interp.heapsz)){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
     }
-    else{        
-        --dsp;
-        dstk[dsp-1]=dstk[dsp-1] % dstk[dsp];
+    memmove(interp.heap+dst, interp.heap+src, n*sizeof(fith_cell));
+    dsp-=3;
+}
+
+// ( src dst n -- )
+void Interpreter::Context::mw_movec()
+{
+    if(dsp < 3){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
     }
+    fith_cell src=dstk[dsp-3], dst=dstk[dsp-2], n=dstk[dsp-1];
+    size_t lim=interp.heapsz*sizeof(fith_cell);
+    if(!in_range(src, n, lim) || !in_range(dst, n, lim)){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
+    }
+    char *bytes=(char *) interp.heap;
+    memmove(bytes+dst, bytes+src, n);
+    dsp-=3;
 }
 
-void Interpreter::Context::mw_muldiv()
+// ( addr n val -- )
+void Interpreter::Context::mw_fill()
 {
     if(dsp < 3){
         state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    fith_cell addr=dstk[dsp-3], n=dstk[dsp-2], val=dstk[dsp-1];
+    if(!in_range(addr, n, interp.heapsz)){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
+    }
+    fith_cell *p=interp.heap+addr;
+    if(val == 0 || val == -1){
+        // every byte the same, e.g. clearing a buffer
+        memset(p, val & 0xFF, n*sizeof(fith_cell));
     }
     else{
-        // 64-bit mul (keep all the bits)
-        long long prod=((long long) dstk[dsp-3]) * ((long long) dstk[dsp-2]);
-        // then divide; discard upper bits
-        fith_cell div=(fith_cell) ((prod/dstk[dsp-1]) & 0xFFFFFFFF);
-        dsp-=2;
-        dstk[dsp-1]=div;
+        for(fith_cell i=0;i<n;++i){
+            p[i]=val;
+        }
     }
+    dsp-=3;
 }
 
-void Interpreter::Context::mw_divmod()
+// ( addr n char -- )
+void Interpreter::Context::mw_fillc()
 {
-    state=Interpreter::EX_BAD_OPCODE;
+    if(dsp < 3){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    fith_cell addr=dstk[dsp-3], n=dstk[dsp-2];
+    if(!in_range(addr, n, interp.heapsz*sizeof(fith_cell))){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
+    }
+    memset(((char *) interp.heap)+addr, dstk[dsp-1] & 0xFF, n);
+    dsp-=3;
 }
 
-void Interpreter::Context::mw_mulmod()
+// ( a1 a2 n -- cmp )
+void Interpreter::Context::mw_compare()
 {
-    state=Interpreter::EX_BAD_OPCODE;
+    if(dsp < 3){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    fith_cell a1=dstk[dsp-3], a2=dstk[dsp-2], n=dstk[dsp-1];
+    if(!in_range(a1, n, interp.heapsz) || !in_range(a2, n, interp.heapsz)){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
+    }
+    const fith_cell *p1=interp.heap+a1, *p2=interp.heap+a2;
+    fith_cell cmp=0;
+    for(fith_cell i=0;i<n;++i){
+        if(p1[i] != p2[i]){
+            cmp=(p1[i] < p2[i]) ? -1 : 1;
+            break;
+        }
+    }
+    dsp-=2;
+    dstk[dsp-1]=cmp;
 }
 
-void Interpreter::Context::mw_jmp()
+// ( a1 a2 n -- cmp )
+void Interpreter::Context::mw_comparec()
 {
-    if(ip >= interp.binsz){
-        // opcode trails off the end of the binary
-        state=Interpreter::EX_SEGV_CODE;
+    if(dsp < 3){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
     }
-    else{
-        // move the IP by the specified offset wrt the start of the JMP instruction
-        ip+=interp.bin[ip]-1;
+    fith_cell a1=dstk[dsp-3], a2=dstk[dsp-2], n=dstk[dsp-1];
+    size_t lim=interp.heapsz*sizeof(fith_cell);
+    if(!in_range(a1, n, lim) || !in_range(a2, n, lim)){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
+    }
+    const char *bytes=(const char *) interp.heap;
+    int cmp=memcmp(bytes+a1, bytes+a2, n);
+    dsp-=2;
+    dstk[dsp-1]=(cmp < 0) ? -1 : (cmp > 0) ? 1 : 0;
+}
+
+// ( addr n val -- i )
+void Interpreter::Context::mw_scan()
+{
+    if(dsp < 3){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    fith_cell addr=dstk[dsp-3], n=dstk[dsp-2], val=dstk[dsp-1];
+    if(!in_range(addr, n, interp.heapsz)){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
+    }
+    const fith_cell *p=interp.heap+addr;
+    fith_cell found=-1;
+    for(fith_cell i=0;i<n;++i){
+        if(p[i] == val){
+            found=i;
+            break;
+        }
+    }
+    dsp-=2;
+    dstk[dsp-1]=found;
+}
+
+// ( addr n char -- i )
+void Interpreter::Context::mw_scanc()
+{
+    if(dsp < 3){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    fith_cell addr=dstk[dsp-3], n=dstk[dsp-2];
+    if(!in_range(addr, n, interp.heapsz*sizeof(fith_cell))){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
+    }
+    const char *p=((const char *) interp.heap)+addr;
+    const char *hit=(const char *) memchr(p, dstk[dsp-1] & 0xFF, n);
+    dsp-=2;
+    dstk[dsp-1]=hit ? fith_cell(hit-p) : -1;
+}
+
+const char *Interpreter::get_string(fith_cell p)
+{
+    size_t ptr=size_t(p);
+    
+    if(ptr >= heapsz){
+        // invalid ptr
+        return NULL;
+    }
+
+    // retrieve string-len
+    if(heap[ptr] < 0){
+        return NULL;
+    }
+    size_t len=size_t(heap[ptr]);
+    if(ptr+1+((len+3)>>2) >= heapsz){
+        // invalid length
+        return NULL;
+    }
+    // ptr to data
+    const char *sp=(const char *) &heap[ptr+1];
+    if(sp[len] != '\0'){
+        // no trailing NUL at expected location
+        return NULL;
+    }
+
+    return sp;
+}
+
+// ( str -- len )
+void Interpreter::Context::mw_strlen()
+{
+    if(dsp < 1){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    if(interp.get_string(dstk[dsp-1]) == NULL){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
+    }
+    dstk[dsp-1]=interp.heap[dstk[dsp-1]];
+}
+
+// ( str off -- char )
+void Interpreter::Context::mw_strread()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    fith_cell ptr=dstk[dsp-2], off=dstk[dsp-1];
+    const char *str=interp.get_string(ptr);
+    if(str == NULL){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
+    }
+    --dsp;
+    dstk[dsp-1]=(off >= 0 && off < interp.heap[ptr]) ? str[off] : 0;
+}
+
+// ( char str off -- )
+void Interpreter::Context::mw_strwrite()
+{
+    if(dsp < 3){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    fith_cell ptr=dstk[dsp-2], off=dstk[dsp-1];
+    const char *str=interp.get_string(ptr);
+    if(str == NULL){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
+    }
+    if(off >= 0 && off < interp.heap[ptr]){
+        const_cast<char *>(str)[off]=dstk[dsp-3] & 0xFF;
+    }
+    dsp-=3;
+}
+
+// ( s1 s2 -- cmp )
+void Interpreter::Context::mw_strcmp()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    const char *s1=interp.get_string(dstk[dsp-2]), *s2=interp.get_string(dstk[dsp-1]);
+    if(s1 == NULL || s2 == NULL){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
+    }
+    fith_cell len1=interp.heap[dstk[dsp-2]], len2=interp.heap[dstk[dsp-1]];
+    int cmp=memcmp(s1, s2, (len1 < len2) ? len1 : len2);
+    if(cmp == 0){
+        cmp=len1-len2;
+    }
+    --dsp;
+    dstk[dsp-1]=(cmp < 0) ? -1 : (cmp > 0) ? 1 : 0;
+}
+
+// ( s1 s2 -- s3 )
+void Interpreter::Context::mw_strcat()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    const char *s1=interp.get_string(dstk[dsp-2]), *s2=interp.get_string(dstk[dsp-1]);
+    if(s1 == NULL || s2 == NULL){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
+    }
+    size_t len1=interp.heap[dstk[dsp-2]], len2=interp.heap[dstk[dsp-1]];
+    size_t len=len1+len2;
+
+    // allot it at HERE, as STRSIZE: length cell plus the chars and NUL, rounded up
+    size_t here=size_t(interp.heap[0]), size=1+((len+4)>>2);
+    if(here >= interp.heapsz || size > interp.heapsz-here){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
+    }
+    char *str=(char *) &interp.heap[here+1];
+    memmove(str, s1, len1);
+    memmove(str+len1, s2, len2);
+    str[len]='\0';
+    interp.heap[here]=fith_cell(len);
+    interp.heap[0]=fith_cell(here+size);
+
+    --dsp;
+    dstk[dsp-1]=fith_cell(here);
+}
+
+void Interpreter::Context::mw_emit()
+{
+    if(dsp < 1){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    char c=dstk[--dsp] & 0xFF;
+    output(&c, 1);
+}
+
+// ( addr n -- )
+void Interpreter::Context::mw_type()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    fith_cell addr=dstk[dsp-2], n=dstk[dsp-1];
+    if(!in_range(addr, n, interp.heapsz*sizeof(fith_cell))){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
+    }
+    output(((const char *) interp.heap)+addr, n);
+    dsp-=2;
+}
+
+// ( str -- )
+void Interpreter::Context::mw_tell()
+{
+    if(dsp < 1){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    fith_cell ptr=dstk[dsp-1];
+    const char *str=interp.get_string(ptr);
+    if(str == NULL){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
+    }
+    output(str, interp.heap[ptr]);
+    --dsp;
+}
+
+void Interpreter::Context::mw_flush()
+{
+    flush();
+}
+
+// ( x n -- f )
+void Interpreter::Context::mw_btst()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    --dsp;
+    dstk[dsp-1]=(unsigned(dstk[dsp-1]) & bit_mask(dstk[dsp])) ? 1 : 0;
+}
+
+// ( x n -- x' )
+void Interpreter::Context::mw_bset()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    --dsp;
+    dstk[dsp-1] |= bit_mask(dstk[dsp]);
+}
+
+// ( x n -- x' )
+void Interpreter::Context::mw_bclr()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    --dsp;
+    dstk[dsp-1] &= ~bit_mask(dstk[dsp]);
+}
+
+// ( x n -- x' )
+void Interpreter::Context::mw_btgl()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    --dsp;
+    dstk[dsp-1] ^= bit_mask(dstk[dsp]);
+}
+
+// ( x pos width -- f )
+void Interpreter::Context::mw_bfx()
+{
+    if(dsp < 3){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
     }
+    dsp-=2;
+    dstk[dsp-1]=bit_extract(dstk[dsp-1], dstk[dsp], dstk[dsp+1]);
 }
 
-void Interpreter::Context::mw_jz()
+// ( x f pos width -- x' )
+void Interpreter::Context::mw_bfi()
 {
-    if(dsp < 1){
-        // do we have a test-value
+    if(dsp < 4){
         state=Interpreter::EX_DSTK_UNDER;
+        return;
     }
-    if(ip >= interp.binsz){
-        // opcode trails off the end of the binary
-        state=Interpreter::EX_SEGV_CODE;
-    }
-    else{
-        // pop test-value
-        fith_cell tv=dstk[--dsp];
+    dsp-=3;
+    dstk[dsp-1]=bit_insert(dstk[dsp-1], dstk[dsp], dstk[dsp+1], dstk[dsp+2]);
+}
 
-        if(tv == 0){
-            // move the IP by the specified offset wrt the start of the JMP instruction
-            ip+=interp.bin[ip]-1;
-        }
-        else{
-            // no branch, skip over the offset to next instruction
-            ++ip;
-        }
+// ( x -- n )
+void Interpreter::Context::mw_popcnt()
+{
+    if(dsp < 1){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
     }
+    dstk[dsp-1]=bit_count(dstk[dsp-1]);
 }
 
-void Interpreter::Context::mw_call()
+// ( x -- n )
+void Interpreter::Context::mw_ffs()
 {
     if(dsp < 1){
         state=Interpreter::EX_DSTK_UNDER;
         return;
     }
-    fith_cell tgt=dstk[--dsp];
-    
-    if((tgt & FLAG_MACHINE) != 0){
-        // builtin word, just run it
-        // gonna be fun if it's MW_CALL :)
-        tgt &= FLAG_ADDR;
-        if(tgt >= Interpreter::MW_INTERP_COUNT){
-            state=Interpreter::EX_BAD_OPCODE;
-            return;
-        }
-        // exec it
-        (this->*builtin[tgt])();
-    }
-    else{
-        if(rsp >= rsz){
-            state=Interpreter::EX_RSTK_OVER;
-            return;
-        }
-
-        // clear any flag bits there might be
-        tgt &= FLAG_ADDR;
+    dstk[dsp-1]=bit_first(dstk[dsp-1]);
+}
 
-        // call = push return, branch
-        rstk[rsp++]=ip;  // IP was inc'd before we were called, so this is where to return to
-        ip=tgt;
+// ( d1 d2 -- d3 )
+void Interpreter::Context::mw_dplus()
+{
+    if(dsp < 4){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    unsigned long long d=dcell(dstk[dsp-4], dstk[dsp-3])+dcell(dstk[dsp-2], dstk[dsp-1]);
+    dsp-=2;
+    dstk[dsp-2]=dcell_lo(d);
+    dstk[dsp-1]=dcell_hi(d);
+}
 
-        // we don't validate the target address here, it will get
-        // checked before fetch in the next cycle of execute()
+// ( d1 d2 -- d3 )
+void Interpreter::Context::mw_dminus()
+{
+    if(dsp < 4){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
     }
+    unsigned long long d=dcell(dstk[dsp-4], dstk[dsp-3])-dcell(dstk[dsp-2], dstk[dsp-1]);
+    dsp-=2;
+    dstk[dsp-2]=dcell_lo(d);
+    dstk[dsp-1]=dcell_hi(d);
 }
-    
-void Interpreter::Context::mw_lt()
+
+// ( n1 n2 -- d )
+void Interpreter::Context::mw_mstar()
 {
     if(dsp < 2){
         state=Interpreter::EX_DSTK_UNDER;
+        return;
     }
-    --dsp;
-    dstk[dsp-1]=(dstk[dsp-1] < dstk[dsp]) ? 1 : 0;
+    unsigned long long d=((long long) dstk[dsp-2]) * ((long long) dstk[dsp-1]);
+    dstk[dsp-2]=dcell_lo(d);
+    dstk[dsp-1]=dcell_hi(d);
 }
 
-void Interpreter::Context::mw_gt()
+// ( ud u -- rem quot )
+void Interpreter::Context::mw_umdivmod()
 {
-    if(dsp < 2){
+    if(dsp < 3){
         state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    unsigned u=unsigned(dstk[dsp-1]);
+    if(u == 0){
+        state=Interpreter::EX_DIV_ZERO;
+        return;
     }
+    unsigned long long d=dcell(dstk[dsp-3], dstk[dsp-2]);
     --dsp;
-    dstk[dsp-1]=(dstk[dsp-1] > dstk[dsp]) ? 1 : 0;
+    dstk[dsp-2]=(fith_cell) (d % u);
+    dstk[dsp-1]=dcell_lo(d / u);
 }
 
-void Interpreter::Context::mw_le()
+// ( d1 d2 -- f )
+void Interpreter::Context::mw_dlt()
 {
-    if(dsp < 2){
+    if(dsp < 4){
         state=Interpreter::EX_DSTK_UNDER;
+        return;
     }
-    --dsp;
-    dstk[dsp-1]=(dstk[dsp-1] <= dstk[dsp]) ? 1 : 0;
+    long long a=(long long) dcell(dstk[dsp-4], dstk[dsp-3]);
+    long long b=(long long) dcell(dstk[dsp-2], dstk[dsp-1]);
+    dsp-=3;
+    dstk[dsp-1]=(a < b) ? 1 : 0;
 }
 
-void Interpreter::Context::mw_ge()
+// ( d1 d2 -- f )
+void Interpreter::Context::mw_deq()
 {
-    if(dsp < 2){
+    if(dsp < 4){
         state=Interpreter::EX_DSTK_UNDER;
+        return;
     }
-    --dsp;
-    dstk[dsp-1]=(dstk[dsp-1] >= dstk[dsp]) ? 1 : 0;
+    bool eq=dstk[dsp-4] == dstk[dsp-2] && dstk[dsp-3] == dstk[dsp-1];
+    dsp-=3;
+    dstk[dsp-1]=eq ? 1 : 0;
 }
 
-void Interpreter::Context::mw_eq()
+// ( a b -- a*b )
+void Interpreter::Context::mw_qmul()
 {
     if(dsp < 2){
         state=Interpreter::EX_DSTK_UNDER;
+        return;
     }
     --dsp;
-    dstk[dsp-1]=(dstk[dsp-1] == dstk[dsp]) ? 1 : 0;
+    dstk[dsp-1]=qmul(dstk[dsp-1], dstk[dsp]);
 }
 
-void Interpreter::Context::mw_dup()
+// ( a b -- a/b )
+void Interpreter::Context::mw_qdiv()
 {
-    if(dsp < 1){
+    if(dsp < 2){
         state=Interpreter::EX_DSTK_UNDER;
     }
-    else if(dsp >= dsz){
-        state=Interpreter::EX_DSTK_OVER;
+    else if(dstk[dsp-1] == 0){
+        state=Interpreter::EX_DIV_ZERO;
     }
     else{
-        fith_cell c=dstk[dsp-1];
-        dstk[dsp++]=c;
+        --dsp;
+        dstk[dsp-1]=saturate(((long long) dstk[dsp-1])*65536/dstk[dsp]);
     }
 }
 
-void Interpreter::Context::mw_dupnz()
+// ( u -- r )
+void Interpreter::Context::mw_sqrt()
 {
     if(dsp < 1){
         state=Interpreter::EX_DSTK_UNDER;
+        return;
     }
-    else if(dsp >= dsz){
-        state=Interpreter::EX_DSTK_OVER;
+    // a bit of the root at a time, from the top
+    unsigned u=unsigned(dstk[dsp-1]), r=0, b=1U << 30;
+    while(b > u){
+        b >>= 2;
     }
-    else{
-        fith_cell c=dstk[dsp-1];
-        if(c != 0){
-            dstk[dsp++]=c;
+    while(b != 0){
+        if(u >= r+b){
+            u-=r+b;
+            r=(r >> 1)+b;
         }
+        else{
+            r >>= 1;
+        }
+        b >>= 2;
     }
+    dstk[dsp-1]=(fith_cell) r;
 }
 
-void Interpreter::Context::mw_drop()
+void Interpreter::Context::mw_min()
 {
-    if(dsp < 1){
+    if(dsp < 2){
         state=Interpreter::EX_DSTK_UNDER;
+        return;
     }
-    else{
-        --dsp;
+    --dsp;
+    if(dstk[dsp] < dstk[dsp-1]){
+        dstk[dsp-1]=dstk[dsp];
     }
 }
 
-void Interpreter::Context::mw_swap()
+void Interpreter::Context::mw_max()
 {
     if(dsp < 2){
         state=Interpreter::EX_DSTK_UNDER;
+        return;
     }
-    else{
-        fith_cell tmp=dstk[dsp-1];
-        dstk[dsp-1]=dstk[dsp-2];
-        dstk[dsp-2]=tmp;
+    --dsp;
+    if(dstk[dsp] > dstk[dsp-1]){
+        dstk[dsp-1]=dstk[dsp];
     }
 }
 
-void Interpreter::Context::mw_rot()
+// ( x lo hi -- x' )
+void Interpreter::Context::mw_clamp()
 {
     if(dsp < 3){
         state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    fith_cell x=dstk[dsp-3], lo=dstk[dsp-2], hi=dstk[dsp-1];
+    dsp-=2;
+    dstk[dsp-1]=(x < lo) ? lo : (x > hi) ? hi : x;
+}
+
+/*
+ * ( x table -- y )
+ * The table is a count n >= 1 then n (x, y) pairs, in order of x.  Below
+ * the first x gives the first y and above the last the last; in between,
+ * the line through the pairs either side, rounded towards zero.  The
+ * whole table is checked once; an empty one is EX_SEGV_DATA.
+ */
+void Interpreter::Context::mw_interp()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    fith_cell x=dstk[dsp-2], tab=dstk[dsp-1];
+    if(!in_range(tab, 1, interp.heapsz)){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
+    }
+    fith_cell n=interp.heap[tab];
+    if(n < 1 || size_t(n) > interp.heapsz/2 || !in_range(tab+1, 2*n, interp.heapsz)){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
+    }
+    const fith_cell *p=interp.heap+tab+1;
+
+    fith_cell y;
+    if(x <= p[0]){
+        y=p[1];
+    }
+    else if(x >= p[2*(n-1)]){
+        y=p[2*(n-1)+1];
     }
     else{
-        fith_cell tmp=dstk[dsp-3];
-        dstk[dsp-3]=dstk[dsp-2];
-        dstk[dsp-2]=dstk[dsp-1];
-        dstk[dsp-1]=tmp;
+        // p[2*lo] <= x < p[2*hi]
+        fith_cell lo=0, hi=n-1;
+        while(hi-lo > 1){
+            fith_cell mid=lo+(hi-lo)/2;
+            if(p[2*mid] <= x){
+                lo=mid;
+            }
+            else{
+                hi=mid;
+            }
+        }
+        long long x0=p[2*lo], y0=p[2*lo+1], dy=p[2*hi+1]-y0;
+        // |dy|*(x-x0) may need all 64 bits, so scale the magnitude
+        unsigned long long m=(unsigned long long) (dy < 0 ? -dy : dy);
+        m=m*(unsigned long long) (x-x0)/(unsigned long long) (p[2*hi]-x0);
+        y=(fith_cell) (dy < 0 ? y0-(long long) m : y0+(long long) m);
     }
+    --dsp;
+    dstk[dsp-1]=y;
 }
-void Interpreter::Context::mw_nrot()
+
+/*
+ * Function blocks.  An instance is a few zeroed cells in the data space:
+ *   timers     flags, start, ET (elapsed ms, up to pt)
+ *   counters   flags, CV
+ *   triggers   flags
+ * The whole instance is checked on each call.  Times are differences of
+ * SysCalls::msboot(), taken unsigned so that its wrapping doesn't matter.
+ */
+
+static const fith_cell FB_IN=1;     ///< the input, as of the last call
+static const fith_cell FB_Q=2;      ///< the output
+static const fith_cell FB_RUN=4;    ///< a TP pulse is under way
+
+static const fith_cell FB_TIMER_CELLS=3, FB_COUNTER_CELLS=2, FB_TRIG_CELLS=1;
+
+/// time since start, up to pt
+static inline fith_cell fb_elapsed(fith_cell now, fith_cell start, fith_cell pt)
+{
+    unsigned e=unsigned(now)-unsigned(start);
+    return (pt <= 0) ? 0 : (e >= unsigned(pt)) ? pt : fith_cell(e);
+}
+
+// the instance, or NULL having set the state
+fith_cell *Interpreter::Context::fb_timer(fith_cell &now)
 {
     if(dsp < 3){
         state=Interpreter::EX_DSTK_UNDER;
+        return NULL;
     }
-    else{
-        fith_cell tmp=dstk[dsp-1];
-        dstk[dsp-1]=dstk[dsp-2];
-        dstk[dsp-2]=dstk[dsp-3];
-        dstk[dsp-3]=tmp;
+    fith_cell fb=dstk[dsp-1];
+    if(!in_range(fb, FB_TIMER_CELLS, interp.heapsz)){
+        state=Interpreter::EX_SEGV_DATA;
+        return NULL;
     }
+    now=interp.syscalls ? interp.syscalls->msboot() : 0;
+    return interp.heap+fb;
 }
-void Interpreter::Context::mw_pick()
+
+// ( in pt fb -- q )
+void Interpreter::Context::mw_ton()
 {
-    if(dsp < 2 || dstk[dsp-1] < 0 || dsp < size_t(dstk[dsp-1]+2)){
-        state=Interpreter::EX_DSTK_UNDER;
+    fith_cell now;
+    fith_cell *fb=fb_timer(now);
+    if(fb == NULL){
+        return;
+    }
+    bool in=dstk[dsp-3] != 0;
+    fith_cell pt=dstk[dsp-2];
+    if(!in){
+        fb[0]=0;
+        fb[2]=0;
     }
     else{
-        dstk[dsp-1]=dstk[dsp-dstk[dsp-1]-2];
+        if((fb[0] & FB_IN) == 0){
+            fb[1]=now;
+        }
+        fb[2]=fb_elapsed(now, fb[1], pt);
+        fb[0]=FB_IN | ((fb[2] >= pt) ? FB_Q : 0);
     }
+    dsp-=2;
+    dstk[dsp-1]=(fb[0] & FB_Q) ? 1 : 0;
 }
-void Interpreter::Context::mw_roll()
+
+// ( in pt fb -- q )
+void Interpreter::Context::mw_tof()
 {
-    if(dsp < 2 || dsp < size_t(abs(dstk[dsp-1])+1)){
-        state=Interpreter::EX_DSTK_UNDER;
+    fith_cell now;
+    fith_cell *fb=fb_timer(now);
+    if(fb == NULL){
+        return;
+    }
+    bool in=dstk[dsp-3] != 0;
+    fith_cell pt=dstk[dsp-2];
+    if(in){
+        fb[0]=FB_IN | FB_Q;
+        fb[2]=0;
     }
     else{
-        fith_cell n=dstk[--dsp];
+        if((fb[0] & FB_IN) != 0){
+            // falling edge
+            fb[1]=now;
+        }
+        if((fb[0] & FB_Q) != 0){
+            fb[2]=fb_elapsed(now, fb[1], pt);
+            fb[0]=(fb[2] < pt) ? FB_Q : 0;
+        }
+    }
+    dsp-=2;
+    dstk[dsp-1]=(fb[0] & FB_Q) ? 1 : 0;
+}
 
-        if(n > 1){
-            // roll n cells upwards, updating the range [-n .. -1]
-            fith_cell tmp=dstk[dsp-n];
-            for(fith_cell i=n;i>1;--i){
-                dstk[dsp-i]=dstk[dsp-i+1];
-            }
-            dstk[dsp-1]=tmp;
+// ( in pt fb -- q )
+void Interpreter::Context::mw_tp()
+{
+    fith_cell now;
+    fith_cell *fb=fb_timer(now);
+    if(fb == NULL){
+        return;
+    }
+    bool in=dstk[dsp-3] != 0;
+    fith_cell pt=dstk[dsp-2];
+    fith_cell flags=fb[0] & FB_RUN;
+    if(flags == 0 && in && (fb[0] & FB_IN) == 0){
+        // rising edge, not already in a pulse
+        fb[1]=now;
+        flags=FB_RUN;
+    }
+    if(flags != 0){
+        fb[2]=fb_elapsed(now, fb[1], pt);
+        if(fb[2] < pt){
+            flags|=FB_Q;
         }
-        else if(n < 1){
-            // roll downwards, updating [-n .. -1
-            n=-n;
-            fith_cell tmp=dstk[dsp-1];
-            for(fith_cell i=1;i<n;++i){
-                dstk[dsp-i]=dstk[dsp-i-1];
-            }
-            dstk[dsp-n]=tmp;
+        else if(!in){
+            // over, and ready for the next
+            flags=0;
+            fb[2]=0;
         }
     }
+    fb[0]=flags | (in ? FB_IN : 0);
+    dsp-=2;
+    dstk[dsp-1]=(fb[0] & FB_Q) ? 1 : 0;
 }
 
-void Interpreter::Context::mw_and()
+// ( cu reset pv fb -- q )
+void Interpreter::Context::mw_ctu()
 {
-    if(dsp < 2){
+    if(dsp < 4){
         state=Interpreter::EX_DSTK_UNDER;
+        return;
     }
-    --dsp;
-    dstk[dsp-1] &= dstk[dsp];
+    if(!in_range(dstk[dsp-1], FB_COUNTER_CELLS, interp.heapsz)){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
+    }
+    fith_cell *fb=interp.heap+dstk[dsp-1];
+    bool cu=dstk[dsp-4] != 0;
+    if(dstk[dsp-3] != 0){
+        fb[1]=0;
+    }
+    else if(cu && (fb[0] & FB_IN) == 0 && fb[1] < 0x7FFFFFFF){
+        ++fb[1];
+    }
+    fb[0]=cu ? FB_IN : 0;
+    fith_cell pv=dstk[dsp-2];
+    dsp-=3;
+    dstk[dsp-1]=(fb[1] >= pv) ? 1 : 0;
 }
 
-void Interpreter::Context::mw_or()
+// ( cd load pv fb -- q )
+void Interpreter::Context::mw_ctd()
 {
-    if(dsp < 2){
+    if(dsp < 4){
         state=Interpreter::EX_DSTK_UNDER;
+        return;
     }
-    --dsp;
-    dstk[dsp-1] |= dstk[dsp];
+    if(!in_range(dstk[dsp-1], FB_COUNTER_CELLS, interp.heapsz)){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
+    }
+    fith_cell *fb=interp.heap+dstk[dsp-1];
+    bool cd=dstk[dsp-4] != 0;
+    if(dstk[dsp-3] != 0){
+        fb[1]=dstk[dsp-2];
+    }
+    else if(cd && (fb[0] & FB_IN) == 0 && fb[1] > fith_cell(0x80000000)){
+        --fb[1];
+    }
+    fb[0]=cd ? FB_IN : 0;
+    dsp-=3;
+    dstk[dsp-1]=(fb[1] <= 0) ? 1 : 0;
 }
 
-void Interpreter::Context::mw_xor()
+// ( clk fb -- q )
+void Interpreter::Context::mw_rtrig()
 {
     if(dsp < 2){
         state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    if(!in_range(dstk[dsp-1], FB_TRIG_CELLS, interp.heapsz)){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
     }
+    fith_cell *fb=interp.heap+dstk[dsp-1];
+    bool clk=dstk[dsp-2] != 0;
+    bool q=clk && (fb[0] & FB_IN) == 0;
+    fb[0]=clk ? FB_IN : 0;
     --dsp;
-    dstk[dsp-1] ^= dstk[dsp];
+    dstk[dsp-1]=q ? 1 : 0;
 }
 
-void Interpreter::Context::mw_invert()
+// ( clk fb -- q )
+void Interpreter::Context::mw_ftrig()
 {
-    if(dsp < 1){
+    if(dsp < 2){
         state=Interpreter::EX_DSTK_UNDER;
+        return;
     }
-    dstk[dsp-1] = ~dstk[dsp-1];
+    if(!in_range(dstk[dsp-1], FB_TRIG_CELLS, interp.heapsz)){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
+    }
+    fith_cell *fb=interp.heap+dstk[dsp-1];
+    bool clk=dstk[dsp-2] != 0;
+    bool q=!clk && (fb[0] & FB_IN) != 0;
+    fb[0]=clk ? FB_IN : 0;
+    --dsp;
+    dstk[dsp-1]=q ? 1 : 0;
 }
 
-void Interpreter::Context::mw_sl()
+// ( x -- ) followed by n, default, then n offsets
+void Interpreter::Context::mw_case()
 {
-    if(dsp < 2){
+    if(dsp < 1){
         state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    fith_cell n=(ip < interp.binsz) ? interp.bin[ip] : -1;
+    if(n < 0 || ip+1+n >= interp.binsz){
+        // count, default or table trails off the end of the binary
+        state=Interpreter::EX_SEGV_CODE;
+        return;
+    }
+    fith_cell x=dstk[--dsp];
+    fith_cell off=interp.bin[ip+((x >= 0 && x < n) ? 2+x : 1)];
+    ip+=off-1;
+    if(off <= 0){
+        charge();
     }
-    --dsp;
-    dstk[dsp-1] <<= dstk[dsp];
 }
 
-void Interpreter::Context::mw_sra()
+// LIT addr !
+void Interpreter::Context::mw_storelit()
 {
-    if(dsp < 2){
+    if(dsp < 1){
         state=Interpreter::EX_DSTK_UNDER;
+        return;
     }
-    --dsp;
-    dstk[dsp-1] >>= dstk[dsp];
+    if(ip >= interp.binsz){
+        state=Interpreter::EX_SEGV_CODE;
+        return;
+    }
+    size_t ptr=(size_t) interp.bin[ip++];
+    if(ptr >= interp.heapsz){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
+    }
+    interp.heap[ptr]=dstk[--dsp];
 }
 
-void Interpreter::Context::mw_srl()
+// ( base i -- x )
+void Interpreter::Context::mw_readx()
 {
     if(dsp < 2){
         state=Interpreter::EX_DSTK_UNDER;
+        return;
+    }
+    size_t ptr=(size_t) (dstk[dsp-2]+dstk[dsp-1]);
+    if(ptr >= interp.heapsz){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
     }
     --dsp;
-    unsigned long c=(unsigned long) dstk[dsp-1];
-    c >>= dstk[dsp];
-    dstk[dsp-1]=(fith_cell) c;
+    dstk[dsp-1]=interp.heap[ptr];
 }
 
-// ( val addr -- )
-void Interpreter::Context::mw_store()
+// ( x base i -- )
+void Interpreter::Context::mw_storex()
 {
-    if(dsp < 2){
+    if(dsp < 3){
         state=Interpreter::EX_DSTK_UNDER;
         return;
     }
-    size_t ptr=(size_t) dstk[dsp-1];
+    size_t ptr=(size_t) (dstk[dsp-2]+dstk[dsp-1]);
     if(ptr >= interp.heapsz){
         state=Interpreter::EX_SEGV_DATA;
         return;
     }
-    interp.heap[ptr]=dstk[dsp-2];
-    dsp-=2;
+    interp.heap[ptr]=dstk[dsp-3];
+    dsp-=3;
 }
 
-// ( val addr -- )
-void Interpreter::Context::mw_storec()
+// ( base i -- c )
+void Interpreter::Context::mw_readcx()
 {
     if(dsp < 2){
         state=Interpreter::EX_DSTK_UNDER;
         return;
     }
-    size_t ptr=(size_t) dstk[dsp-1];
+    size_t ptr=(size_t) (dstk[dsp-2]+dstk[dsp-1]);
     if(ptr >= interp.heapsz*sizeof(fith_cell)){
         state=Interpreter::EX_SEGV_DATA;
         return;
     }
-    ((char *) interp.heap)[ptr]=dstk[dsp-2] & 0xFF;
-    dsp-=2;
+    --dsp;
+    dstk[dsp-1]=((char *) interp.heap)[ptr];
 }
 
-void Interpreter::Context::mw_read()
+// ( c base i -- )
+void Interpreter::Context::mw_storecx()
 {
-    if(dsp < 1){
+    if(dsp < 3){
         state=Interpreter::EX_DSTK_UNDER;
         return;
     }
-    size_t ptr=(size_t) dstk[dsp-1];
-    if(ptr >= interp.heapsz){
+    size_t ptr=(size_t) (dstk[dsp-2]+dstk[dsp-1]);
+    if(ptr >= interp.heapsz*sizeof(fith_cell)){
         state=Interpreter::EX_SEGV_DATA;
+        return;
     }
-    dstk[dsp-1]=interp.heap[ptr];
+    ((char *) interp.heap)[ptr]=dstk[dsp-3] & 0xFF;
+    dsp-=3;
 }
 
-void Interpreter::Context::mw_readc()
+// ( addr -- addr+1 x )
+void Interpreter::Context::mw_readinc()
 {
     if(dsp < 1){
         state=Interpreter::EX_DSTK_UNDER;
         return;
     }
+    if(dsp >= dsz){
+        state=Interpreter::EX_DSTK_OVER;
+        return;
+    }
     size_t ptr=(size_t) dstk[dsp-1];
-    if(ptr >= interp.heapsz*sizeof(fith_cell)){
+    if(ptr >= interp.heapsz){
         state=Interpreter::EX_SEGV_DATA;
+        return;
     }
-    dstk[dsp-1]=((char *) interp.heap)[ptr];
+    ++dstk[dsp-1];
+    dstk[dsp++]=interp.heap[ptr];
 }
 
-
-void Interpreter::Context::mw_tors()
+// ( x addr -- addr+1 )
+void Interpreter::Context::mw_storeinc()
 {
-    if(dsp < 1){
+    if(dsp < 2){
         state=Interpreter::EX_DSTK_UNDER;
         return;
     }
-    if(rsp >= rsz){
-        state=Interpreter::EX_RSTK_OVER;
+    size_t ptr=(size_t) dstk[dsp-1];
+    if(ptr >= interp.heapsz){
+        state=Interpreter::EX_SEGV_DATA;
         return;
     }
-    
-    rstk[rsp++]=dstk[--dsp];
+    interp.heap[ptr]=dstk[dsp-2];
+    --dsp;
+    dstk[dsp-1]=dstk[dsp]+1;
 }
 
-void Interpreter::Context::mw_fromrs()
+// ( addr -- addr+1 c )
+void Interpreter::Context::mw_readcinc()
 {
-    if(rsp < 1){
-        state=Interpreter::EX_RSTK_UNDER;
+    if(dsp < 1){
+        state=Interpreter::EX_DSTK_UNDER;
         return;
     }
     if(dsp >= dsz){
         state=Interpreter::EX_DSTK_OVER;
         return;
     }
-    
-    dstk[dsp++]=rstk[--rsp];
+    size_t ptr=(size_t) dstk[dsp-1];
+    if(ptr >= interp.heapsz*sizeof(fith_cell)){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
+    }
+    ++dstk[dsp-1];
+    dstk[dsp++]=((char *) interp.heap)[ptr];
 }
 
-void Interpreter::Context::mw_cpfromrs()
+// ( c addr -- addr+1 )
+void Interpreter::Context::mw_storecinc()
 {
-    if(rsp < 1){
-        state=Interpreter::EX_RSTK_UNDER;
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
         return;
     }
-    if(dsp >= dsz){
-        state=Interpreter::EX_DSTK_OVER;
+    size_t ptr=(size_t) dstk[dsp-1];
+    if(ptr >= interp.heapsz*sizeof(fith_cell)){
+        state=Interpreter::EX_SEGV_DATA;
         return;
     }
-    
-    dstk[dsp++]=rstk[rsp-1];
+    ((char *) interp.heap)[ptr]=dstk[dsp-2] & 0xFF;
+    --dsp;
+    dstk[dsp-1]=dstk[dsp]+1;
 }
 
-void Interpreter::Context::mw_rdrop()
+// ( x0 .. xn-1 -- ) R:( -- x0 .. xn-1 )
+void Interpreter::Context::mw_frame()
 {
-    if(rsp < 1){
-        state=Interpreter::EX_RSTK_UNDER;
+    if(ip >= interp.binsz){
+        state=Interpreter::EX_SEGV_CODE;
         return;
     }
-    
-    --rsp;
-}
-
-void Interpreter::Context::mw_rpick()
-{    
-    if(dsp < 1){
+    fith_cell n=interp.bin[ip++];
+    if(size_t(n) > dsp){
         state=Interpreter::EX_DSTK_UNDER;
         return;
     }
-    fith_cell n=dstk[dsp-1];
-    if(n < 0 || rsp < size_t(1+n)){
-        state=Interpreter::EX_RSTK_UNDER;
+    if(rsp+n > rsz){
+        state=Interpreter::EX_RSTK_OVER;
         return;
     }
-    
-    dstk[dsp-1]=rstk[rsp-n-1];
+    dsp-=n;
+    memcpy(rstk+rsp, dstk+dsp, n*sizeof(fith_cell));
+    rsp+=n;
 }
 
-void Interpreter::Context::mw_here()
+// R:( x0 .. xn-1 -- )
+void Interpreter::Context::mw_unframe()
 {
-    if(dsp >= dsz){
-        state=Interpreter::EX_DSTK_OVER;
+    if(ip >= interp.binsz){
+        state=Interpreter::EX_SEGV_CODE;
         return;
     }
-    dstk[dsp++]=0;
+    fith_cell n=interp.bin[ip++];
+    if(size_t(n) > rsp){
+        state=Interpreter::EX_RSTK_UNDER;
+        return;
+    }
+    rsp-=n;
 }
 
-void Interpreter::Context::mw_syscall1()
+// ( -- x ) with the index as operand
+void Interpreter::Context::mw_localget()
 {
-    if(dsp < 1){
-        state=Interpreter::EX_DSTK_UNDER;
+    if(dsp >= dsz){
+        state=Interpreter::EX_DSTK_OVER;
         return;
     }
-#ifndef NDEBUG
-    cerr << "syscall1(" << dstk[dsp-1] << ")" << endl;
-#endif
-    if(interp.syscalls){
-        dstk[dsp-1]=interp.syscalls->syscall1(dstk[dsp-1]);
+    if(ip >= interp.binsz){
+        state=Interpreter::EX_SEGV_CODE;
+        return;
     }
-    else{
-        dstk[dsp-1]=0;
+    fith_cell i=interp.bin[ip++];
+    if(size_t(i) >= rsp){
+        state=Interpreter::EX_RSTK_UNDER;
+        return;
     }
+    dstk[dsp++]=rstk[rsp-1-i];
 }
 
-void Interpreter::Context::mw_syscall2()
+// ( x -- ) with the index as operand
+void Interpreter::Context::mw_localset()
 {
-    if(dsp < 2){
+    if(dsp < 1){
         state=Interpreter::EX_DSTK_UNDER;
         return;
     }
-#ifndef NDEBUG
-    cerr << "syscall2(" << dstk[dsp-2] << ", " << dstk[dsp-1] << ")" << endl;
-#endif
-    fith_cell b=dstk[--dsp], a=dstk[dsp-1];
-    if(interp.syscalls){
-        dstk[dsp-1]=interp.syscalls->syscall2(a, b);
+    if(ip >= interp.binsz){
+        state=Interpreter::EX_SEGV_CODE;
+        return;
     }
-    else{
-        dstk[dsp-1]=0;
+    fith_cell i=interp.bin[ip++];
+    if(size_t(i) >= rsp){
+        state=Interpreter::EX_RSTK_UNDER;
+        return;
     }
+    rstk[rsp-1-i]=dstk[--dsp];
 }
 
-void Interpreter::Context::mw_syscall3()
+void Interpreter::Context::mw_badop()
 {
-    if(dsp < 3){
-        state=Interpreter::EX_DSTK_UNDER;
-        return;
-    }
-#ifndef NDEBUG
-    cerr << "syscall3(" << dstk[dsp-3] << ", " << dstk[dsp-2] << ", " << dstk[dsp-1] << ")" << endl;
-#endif
-    fith_cell c=dstk[--dsp],  b=dstk[--dsp], a=dstk[dsp-1];
-    if(interp.syscalls){
-        dstk[dsp-1]=interp.syscalls->syscall3(a, b, c);
-    }
-    else{
-        dstk[dsp-1]=0;
-    }
+    state=Interpreter::EX_BAD_OPCODE;
 }
 
 
@@ -973,8 +4508,8 @@ void Interpreter::bootstrap(bool full)
         create(opcodes[i], i | FLAG_MACHINE);
     }
     // make some words immediate
-    dictionary["IMMEDIATE"] |= FLAG_IMMED;
-    dictionary["["] |= FLAG_IMMED;
+    dictionary.flip("IMMEDIATE", FLAG_IMMED);
+    dictionary.flip("[", FLAG_IMMED);
 
     if(full){    
         // : : WORD HERE @C CREATE LATEST @ HIDDEN ] ;
@@ -989,12 +4524,21 @@ void Interpreter::bootstrap(bool full)
         compile(MW_RBRAC);
         compile(MW_EXIT);
     
-        // : ; IMMEDIATE ' EXIT , LATEST @ HIDDEN [ ;
+        // : ; IMMEDIATE ENDLOCALS ?DUP IF ' (UNFRAME) , , ENDIF ' EXIT , FUSE LATEST @ HIDDEN [ ;
         fith_cell semicolon=here() | FLAG_IMMED;
         create(";", semicolon);
+        compile(MW_ENDLOCALS); // drop any locals' frame
+        compile(MW_DUPNZ);
+        compile(MW_JZ);
+        compile(6, false);
+        compile(MW_TICK);
+        compile(MW_UNFRAME);
+        compile(MW_COMMA);
+        compile(MW_COMMA);
         compile(MW_TICK);      // compile EXIT
         compile(MW_EXIT);
         compile(MW_COMMA);
+        compile(MW_FUSE);      // peephole-optimise the finished word
         compile(MW_LATEST);
         compile(MW_HIDDEN);    // toggle hidden-bit
         compile(MW_LBRAC);     // back to immediate mode
@@ -1011,62 +4555,273 @@ void Interpreter::bootstrap(bool full)
     }
 }
 
-void Interpreter::compile(fith_cell c, bool machine)
+void Interpreter::compile(fith_cell c, bool machine)
+{
+    fith_cell &here=bin[HEREAT];
+    if(size_t(here) >= binsz){
+        // no room, ignore
+        return;
+    }
+
+    bin[here++]=c | (machine ? FLAG_MACHINE : 0);
+    redecode(here-2, here);
+}
+
+bool Interpreter::instruction_due() const
+{
+    fith_cell at=find(latestword.c_str());
+    if(at < 0){
+        return false;
+    }
+    at &= FLAG_ADDR;
+
+    const fith_cell here=bin[HEREAT];
+    while(at < here){
+        fith_cell n=1;
+        if((bin[at] & FLAG_MACHINE) != 0){
+            n+=operands(bin+at, here-at);
+        }
+        at+=n;
+    }
+    return at == here;
+}
+
+fith_cell Interpreter::rsdepth() const
+{
+    const fith_cell n=locals.size();
+    fith_cell at=find("_RSDEPTH");
+    if(at < 0 || (at & FLAG_MACHINE) != 0){
+        return n;
+    }
+
+    // as per TO: a VARIABLE's pointer follows its first opcode
+    at &= FLAG_ADDR;
+    if(at+1 >= bin[HEREAT] || bin[at] != (MW_READLIT | FLAG_MACHINE)){
+        return n;
+    }
+    fith_cell p=bin[at+1];
+    if(p < 0 || size_t(p) >= heapsz || heap[p] < n){
+        return n;
+    }
+    return heap[p];
+}
+
+void Interpreter::create(const string &name, fith_cell value)
+{
+#ifndef NDEBUG
+    cerr << name << " = " << value << endl;
+#endif
+    
+    dictionary.set(name, value);
+    latestword=name;
+}
+
+fith_cell Interpreter::find(const char *name) const
+{
+    return dictionary.find(name);
+}
+
+Interpreter::Dictionary::Dictionary()
+    : table(64, -1), stale(true)
+{
+}
+
+unsigned Interpreter::Dictionary::hashOf(const char *name)
+{
+    // FNV-1a
+    unsigned h=2166136261u;
+    while(*name){
+        h=(h ^ (unsigned char) *name++)*16777619u;
+    }
+    return h;
+}
+
+size_t Interpreter::Dictionary::slot(const char *name, unsigned h) const
+{
+    size_t mask=table.size()-1;
+    for(size_t i=h & mask;;i=(i+1) & mask){
+        int s=table[i];
+        if(s < 0 || (symbols[s].hash == h && symbols[s].name == name)){
+            return i;
+        }
+    }
+}
+
+fith_cell Interpreter::Dictionary::find(const char *name) const
+{
+    int s=table[slot(name, hashOf(name))];
+    return s < 0 ? -1 : symbols[s].value;
+}
+
+void Interpreter::Dictionary::set(const string &name, fith_cell value)
+{
+    stale=true;
+
+    unsigned h=hashOf(name.c_str());
+    size_t i=slot(name.c_str(), h);
+    if(table[i] >= 0){
+        symbols[table[i]].value=value;
+        return;
+    }
+
+    Symbol sym={ name, value, h };
+    table[i]=symbols.size();
+    symbols.push_back(sym);
+
+    // keep the table at most half full
+    if(symbols.size()*2 > table.size()){
+        table.assign(table.size()*2, -1);
+        size_t mask=table.size()-1;
+        for(size_t k=0;k<symbols.size();++k){
+            size_t j=symbols[k].hash & mask;
+            while(table[j] >= 0){
+                j=(j+1) & mask;
+            }
+            table[j]=k;
+        }
+    }
+}
+
+void Interpreter::Dictionary::flip(const char *name, fith_cell flags)
+{
+    // flags aren't in the index, so it stays good
+    int s=table[slot(name, hashOf(name))];
+    if(s >= 0){
+        symbols[s].value ^= flags & (FLAG_IMMED | FLAG_HIDE);
+    }
+}
+
+void Interpreter::Dictionary::clear()
+{
+    symbols.clear();
+    table.assign(64, -1);
+    index.clear();
+    stale=true;
+}
+
+void Interpreter::Dictionary::swap(Dictionary &other)
+{
+    symbols.swap(other.symbols);
+    table.swap(other.table);
+    index.swap(other.index);
+    std::swap(stale, other.stale);
+}
+
+/// orders the index by address, then name
+class Interpreter::Dictionary::ByAddress {
+public:
+    explicit ByAddress(const Dictionary &_d) : d(_d) {}
+
+    bool operator()(const Entry &a, const Entry &b) const
+    {
+        if(a.first != b.first){
+            return a.first < b.first;
+        }
+        return d.name(a.second) < d.name(b.second);
+    }
+
+private:
+    const Dictionary &d;
+};
+
+bool Interpreter::Dictionary::before(const Entry &e, fith_cell addr)
+{
+    return e.first < addr;
+}
+
+const vector<Interpreter::Dictionary::Entry> &Interpreter::Dictionary::byAddress() const
 {
-    fith_cell &here=bin[HEREAT];
-    if(size_t(here) >= binsz){
-        // no room, ignore
-        return;
+    if(stale){
+        index.clear();
+        for(size_t k=0;k<symbols.size();++k){
+            if((symbols[k].value & FLAG_MACHINE) == 0){
+                index.push_back(Entry(symbols[k].value & FLAG_ADDR, k));
+            }
+        }
+        sort(index.begin(), index.end(), ByAddress(*this));
+        stale=false;
     }
+    return index;
+}
 
-    bin[here++]=c | (machine ? FLAG_MACHINE : 0);
+const char *Interpreter::Dictionary::at(fith_cell addr) const
+{
+    const vector<Entry> &ix=byAddress();
+    vector<Entry>::const_iterator i=lower_bound(ix.begin(), ix.end(), addr, before);
+    if(i == ix.end() || i->first != addr){
+        return NULL;
+    }
+    return symbols[i->second].name.c_str();
 }
 
-void Interpreter::create(const string &name, fith_cell value)
+void Interpreter::snapshot(ostream &os) const
 {
-#ifndef NDEBUG
-    cerr << name << " = " << value << endl;
-#endif
-    
-    dictionary[name]=value;
-    latestword=name;
+    os << (compilestate ? 1 : 0) << " " << dictionary.size() << endl
+       << latestword << endl
+       << hex << setfill('0');
+    for(Dictionary::const_iterator i=dictionary.begin();i!=dictionary.end();++i){
+        os << setw(8) << unsigned(i->value) << " " << i->name << endl;
+    }
+    os << dec << setfill(' ');
 }
 
-fith_cell Interpreter::find(const string &name) const
+bool Interpreter::restore(istream &is)
 {
-    dci i=dictionary.find(name);
-    if(i == dictionary.end()){
-        return -1;
+    int cs;
+    size_t n;
+    if(!(is >> cs >> n) || is.get() != '\n'){
+        return false;
+    }
+    string latest;
+    getline(is, latest);
+
+    // build it aside, so a bad snapshot leaves us as we were
+    Dictionary d;
+    for(size_t k=0;k<n;++k){
+        unsigned long value;
+        string name;
+        if(!(is >> hex >> value >> name)){
+            return false;
+        }
+        d.set(name, fith_cell(value));
     }
 
-    return i->second;
+    dictionary.swap(d);
+    latestword=latest;
+    compilestate=(cs != 0);
+    locals.clear();
+    gcroot=0;
+    return true;
 }
 
 const char *Interpreter::reverse_find(fith_cell value) const
 {
-    value &= ~(FLAG_IMMED | FLAG_HIDE);
-    
-    for(dci i=dictionary.begin();i!=dictionary.end();++i){
-        if(value == (i->second & ~(FLAG_IMMED | FLAG_HIDE))){
-            return i->first.c_str();
-        }
+    if((value & FLAG_MACHINE) != 0){
+        return NULL;
     }
-
-    return NULL;
+    return dictionary.at(value & FLAG_ADDR);
 }
 
 Interpreter::revdict_t Interpreter::invert_dict(bool builtins, bool addronly) const
 {
     revdict_t result;
 
-    // basic map-inversion
-    for(dci i=dictionary.begin();i!=dictionary.end();++i){
-        if(builtins || (i->second & FLAG_MACHINE) == 0){
-            fith_cell addr=i->second;
-            if(addronly){
-                addr &= FLAG_ADDR;
+    // basic map-inversion; of several names at an address, the last
+    if(builtins || !addronly){
+        for(Dictionary::const_iterator i=dictionary.begin();i!=dictionary.end();++i){
+            if(builtins || (i->value & FLAG_MACHINE) == 0){
+                fith_cell addr=i->value;
+                if(addronly){
+                    addr &= FLAG_ADDR;
+                }
+                result[addr]=i->name;
             }
-            result[addr]=i->first;
+        }
+    }
+    else{
+        const vector<Dictionary::Entry> &ix=dictionary.byAddress();
+        for(size_t k=0;k<ix.size();++k){
+            result[ix[k].first]=dictionary.name(ix[k].second);
         }
     }
 
@@ -1079,11 +4834,9 @@ Interpreter::revdict_t Interpreter::invert_dict(bool builtins, bool addronly) co
         if(cell & FLAG_MACHINE){
             cell &= FLAG_ADDR;
 
-            // skip following scalar
-            if(cell == MW_LIT || cell == MW_JMP || cell == MW_JZ){
-                ++i;
-                continue;
-            }
+            // skip following scalars
+            // NB code-literals following MW_TICK are destinations
+            i+=scalars(i, bin[HEREATB]-i);
         }
         else{
             cell &= FLAG_ADDR;
@@ -1104,6 +4857,224 @@ const string &Interpreter::latest() const
     return latestword;
 }
 
+fith_cell Interpreter::scalars(fith_cell addr, fith_cell len) const
+{
+    fith_cell op=bin[addr] & FLAG_ADDR, n=0;
+    if(op == MW_TICK){
+        // code-literal is a pointer unless it's an opcode
+        n=(len > 1 && (bin[addr+1] & FLAG_MACHINE) != 0) ? 1 : 0;
+    }
+    else if(op < MW_INTERP_COUNT){
+        n=operands(bin+addr, len);
+    }
+    return n < len ? n : len-1;
+}
+
+fith_cell Interpreter::fuse(fith_cell start, fith_cell len)
+{
+    if(start < BINUSED || len < 1 || size_t(start+len) > binsz){
+        return len;
+    }
+    const fith_cell *code=bin+start;
+
+    // opcode in each cell, or -1; padded so patterns can look past the end
+    vector<fith_cell> ops(len+5, -1);
+    for(fith_cell k=0;k<len;++k){
+        if((code[k] & FLAG_MACHINE) != 0){
+            ops[k]=code[k] & FLAG_ADDR;
+        }
+    }
+
+    // find the instruction boundaries, and every place
+    // that is jumped to, called, or taken as a code-literal
+    vector<bool> insn(len+1, false), target(len+1, false);
+    fith_cell pc=0;
+    while(pc < len){
+        insn[pc]=true;
+        fith_cell cell=code[pc], dest=-1;
+        fith_cell n=0;
+        if((cell & FLAG_MACHINE) != 0){
+            cell &= FLAG_ADDR;
+            if(cell >= MW_INTERP_COUNT){
+                // don't know what this is; leave it alone
+                return len;
+            }
+            n=operands(code+pc, len-pc);
+            if(pc+n >= len){
+                break;
+            }
+            if((opinfo[cell].flags & OPF_BRANCH) != 0){
+                dest=pc+code[pc+1];
+            }
+            else if((opinfo[cell].flags & OPF_TABLE) != 0){
+                // the default and every entry
+                for(fith_cell k=2;k<=n;++k){
+                    fith_cell d=pc+code[pc+k];
+                    if(d >= 0 && d <= len){
+                        target[d]=true;
+                    }
+                }
+            }
+            else if(cell == MW_TICK && (code[pc+1] & FLAG_MACHINE) == 0){
+                dest=(code[pc+1] & FLAG_ADDR)-start;
+            }
+        }
+        else{
+            dest=(cell & FLAG_ADDR)-start;
+        }
+        if(dest >= 0 && dest <= len){
+            target[dest]=true;
+        }
+        pc+=1+n;
+    }
+    if(pc != len){
+        // operand trails off the end
+        return len;
+    }
+    insn[len]=true;
+    for(pc=0;pc<=len;++pc){
+        if(target[pc] && !insn[pc]){
+            // jump into the middle of an instruction?
+            return len;
+        }
+    }
+
+    // rewrite, recording where everything went and what needs relocating
+    vector<fith_cell> out, remap(len+1, -1);
+    typedef pair<fith_cell, fith_cell> reloc_t;
+    vector<reloc_t> branches, ticks;    // (new position, old destination)
+    vector<pair<fith_cell, reloc_t> > tables;   // (new opcode position, (new position, old destination))
+    out.reserve(len);
+
+    const fith_cell M=FLAG_MACHINE;
+    pc=0;
+    while(pc < len){
+        remap[pc]=out.size();
+
+        fith_cell o0=ops[pc], o1=ops[pc+1];
+        fith_cell n=0;  // number of cells replaced
+
+        if(o0 == MW_FROMRS && o1 == MW_CPFROMRS && pc+4 < len
+           && (code[pc+2] & FLAG_MACHINE) == 0
+           && ops[pc+3] == MW_TORS && ops[pc+4] == MW_LT){
+            // R> R@ OVER >R <, if that call really is OVER (1 PICK)
+            fith_cell over=code[pc+2] & FLAG_ADDR;
+            if(size_t(over+3) < binsz && bin[over] == (M | MW_LIT) && bin[over+1] == 1
+               && bin[over+2] == (M | MW_PICK) && bin[over+3] == (M | MW_EXIT)){
+                n=5;
+                out.push_back(M | MW_FORTEST);
+            }
+        }
+        if(n == 0 && o0 == MW_FROMRS && o1 == MW_LIT
+           && ops[pc+3] == MW_PLUS && ops[pc+4] == MW_TORS){
+            // R> LIT n + >R
+            n=5;
+            out.push_back(M | MW_RPLUSLIT);
+            out.push_back(code[pc+2]);
+        }
+        if(n == 0 && o0 == MW_LIT){
+            fith_cell o2=ops[pc+2];
+            if(o2 == MW_PLUS || o2 == MW_READ || o2 == MW_STORE){
+                // LIT n +, LIT addr @, LIT addr !
+                n=3;
+                out.push_back(M | (o2 == MW_PLUS ? MW_PLUSLIT : o2 == MW_READ ? MW_READLIT : MW_STORELIT));
+                out.push_back(code[pc+1]);
+            }
+            else if(o2 == MW_AND || o2 == MW_OR || o2 == MW_XOR){
+                // LIT m &, LIT m |, LIT m ^: masking GPIO bits
+                n=3;
+                out.push_back(M | (o2 == MW_AND ? MW_ANDLIT : o2 == MW_OR ? MW_ORLIT : MW_XORLIT));
+                out.push_back(code[pc+1]);
+            }
+            else if(o2 == MW_INVERT && ops[pc+3] == MW_AND){
+                // LIT m ~ &, clearing bits
+                n=4;
+                out.push_back(M | MW_ANDLIT);
+                out.push_back(~code[pc+1]);
+            }
+        }
+        if(n == 0 && o0 == MW_PLUS
+           && (o1 == MW_READ || o1 == MW_STORE || o1 == MW_READC || o1 == MW_STOREC)){
+            // base i + @ and friends: indexing an array
+            n=2;
+            out.push_back(M | (o1 == MW_READ ? MW_READX : o1 == MW_STORE ? MW_STOREX
+                               : o1 == MW_READC ? MW_READCX : MW_STORECX));
+        }
+        if(n == 0 && o0 == MW_DUP && o1 == MW_JZ){
+            // DUP JZ off; offset is wrt the JZ
+            n=3;
+            branches.push_back(reloc_t(out.size(), pc+1+code[pc+2]));
+            out.push_back(M | MW_DUPJZ);
+            out.push_back(0);
+        }
+
+        // nothing may jump into the middle of a fused sequence
+        for(fith_cell k=1;k<n;++k){
+            if(target[pc+k]){
+                out.resize(remap[pc]);
+                if(!branches.empty() && branches.back().first == remap[pc]){
+                    branches.pop_back();
+                }
+                n=0;
+                break;
+            }
+        }
+
+        if(n == 0){
+            // copy this instruction as-is
+            n=1;
+            if(o0 >= 0){
+                fith_cell m=operands(code+pc, len-pc);
+                n+=m;
+                if((opinfo[o0].flags & OPF_BRANCH) != 0){
+                    branches.push_back(reloc_t(out.size(), pc+code[pc+1]));
+                }
+                else if((opinfo[o0].flags & OPF_TABLE) != 0){
+                    for(fith_cell k=2;k<=m;++k){
+                        tables.push_back(make_pair(fith_cell(out.size()), reloc_t(out.size()+k, pc+code[pc+k])));
+                    }
+                }
+                else if(o0 == MW_TICK && (code[pc+1] & FLAG_MACHINE) == 0){
+                    ticks.push_back(reloc_t(out.size()+1, (code[pc+1] & FLAG_ADDR)-start));
+                }
+            }
+            for(fith_cell k=0;k<n;++k){
+                out.push_back(code[pc+k]);
+            }
+        }
+        pc+=n;
+    }
+    remap[len]=out.size();
+
+    // relocate: destinations outside the function stay put
+    for(size_t i=0;i<branches.size();++i){
+        fith_cell at=branches[i].first, dest=branches[i].second;
+        if(dest >= 0 && dest <= len){
+            dest=remap[dest];
+        }
+        out[at+1]=dest-at;
+    }
+    for(size_t i=0;i<tables.size();++i){
+        fith_cell op=tables[i].first, at=tables[i].second.first, dest=tables[i].second.second;
+        if(dest >= 0 && dest <= len){
+            dest=remap[dest];
+        }
+        out[at]=dest-op;
+    }
+    for(size_t i=0;i<ticks.size();++i){
+        fith_cell at=ticks[i].first, dest=ticks[i].second;
+        if(dest >= 0 && dest <= len){
+            out[at]=(out[at] & ~FLAG_ADDR) | (start+remap[dest]);
+        }
+    }
+
+    for(size_t i=0;i<out.size();++i){
+        bin[start+i]=out[i];
+    }
+    redecode(start-1, start+len);
+    return out.size();
+}
+
 
 
 void Interpreter::Context::mw_storecode()
@@ -1117,7 +5088,14 @@ void Interpreter::Context::mw_storecode()
         state=Interpreter::EX_SEGV_CODE;
         return;
     }
+    if(ptr < size_t(interp.proofhere)){
+        // proven code may have changed underneath us
+        interp.setProofs(NULL, 0);
+    }
+    // as may translated code
+    interp.drop_native();
     interp.bin[ptr]=dstk[dsp-2];
+    interp.redecode(ptr-1, ptr+1);
     dsp-=2;
 }
 
@@ -1130,6 +5108,7 @@ void Interpreter::Context::mw_readcode()
     size_t ptr=(size_t) dstk[dsp-1];
     if(ptr >= interp.binsz){
         state=Interpreter::EX_SEGV_CODE;
+        return;
     }
     dstk[dsp-1]=interp.bin[ptr];
 }
@@ -1146,8 +5125,121 @@ void Interpreter::Context::mw_comma()
         return;
     }
 
+    if(dstk[dsp-1] == (MW_EXIT | FLAG_MACHINE) && !interp.locals.empty() && interp.instruction_due()){
+        // leaving a word with locals, however the EXIT got here: drop the
+        // frame first, as ; does, and the cells of any loops it's inside
+        interp.compile(MW_UNFRAME);
+        interp.compile(interp.rsdepth(), false);
+    }
+
     // copy into the binary
     interp.bin[here++]=dstk[--dsp];
+    interp.redecode(here-2, here);
+}
+
+Interpreter::Source::Source(istream *_is)
+    : sb(_is->rdbuf()), owned(NULL), pos(NULL), end(NULL), map(NULL), maplen(0), ended(false)
+{
+}
+
+Interpreter::Source::Source(const char *_pos, size_t len, istream *_owned)
+    : sb(_owned ? _owned->rdbuf() : NULL), owned(_owned), pos(_pos), end(_pos+len),
+      map((void *) _pos), maplen(_owned ? 0 : len), ended(false)
+{
+}
+
+Interpreter::Source::~Source()
+{
+    if(maplen > 0){
+        munmap(map, maplen);
+    }
+    delete owned;
+}
+
+Interpreter::Source *Interpreter::Source::open(const char *filename)
+{
+    int fd=::open(filename, O_RDONLY);
+    if(fd < 0){
+        return NULL;
+    }
+
+    struct stat st;
+    void *p=MAP_FAILED;
+    if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0){
+        p=mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if(p != MAP_FAILED){
+        return new Source((const char *) p, st.st_size, NULL);
+    }
+
+    // empty, a pipe or a device: read it as a stream instead
+    ifstream *ifs=new ifstream(filename, ios::in);
+    if(!*ifs){
+        delete ifs;
+        return NULL;
+    }
+    return new Source(NULL, 0, ifs);
+}
+
+int Interpreter::Source::word(char *buf, size_t size)
+{
+    if(ended){
+        return -1;
+    }
+
+    int c;
+    if(!sb){
+        // mapped: scan the memory directly
+        while(pos < end && isspace((unsigned char) *pos)){
+            ++pos;
+        }
+        const char *start=pos;
+        while(pos < end && !isspace((unsigned char) *pos)){
+            ++pos;
+        }
+        if(pos == end){
+            ended=true;
+        }
+        if(pos == start){
+            return -1;
+        }
+        size_t len=pos-start;
+        if(len > size-1){
+            len=size-1;
+        }
+        memcpy(buf, start, len);
+        buf[len]='\0';
+        return len;
+    }
+
+    while((c=peek()) >= 0 && isspace(c)){
+        bump();
+    }
+    if(c < 0){
+        return -1;
+    }
+    size_t len=0;
+    while((c=peek()) >= 0 && !isspace(c)){
+        if(len < size-1){
+            buf[len++]=c;
+        }
+        bump();
+    }
+    buf[len]='\0';
+    return len;
+}
+
+int Interpreter::Source::key()
+{
+    if(ended){
+        return -1;
+    }
+    int c=peek();
+    if(c >= 0){
+        bump();
+    }
+    return c;
 }
 
 void Interpreter::Context::mw_key()
@@ -1157,9 +5249,11 @@ void Interpreter::Context::mw_key()
         return;
     }
 
-    char c;
-    is->get(c);  // blocking read 1 char
-    if(!*is){
+    // e.g. a prompt
+    flush();
+
+    int c=is->key();  // blocking read 1 char
+    if(c < 0){
         // fail, eof, etc
 
         if(!iostack.empty()){
@@ -1178,17 +5272,8 @@ void Interpreter::Context::mw_key()
     }
     else{
         // push result as int
-        dstk[dsp++]=(fith_cell) c;
-    }
-}
-
-void Interpreter::Context::mw_emit()
-{
-    if(dsp < 1){
-        state=Interpreter::EX_DSTK_UNDER;
-        return;
+        dstk[dsp++]=(fith_cell) (char) c;
     }
-    os->put((char)(dstk[--dsp] & 0xFF));
 }
 
 void Interpreter::Context::mw_word()
@@ -1198,10 +5283,13 @@ void Interpreter::Context::mw_word()
         return;
     }
     
-    string str;
-    *is >> str; // it's nice to cheat...
+    flush();
+
+    // straight into the buffer, truncated
+    char *buf=(char *) &interp.heap[WORDBUFAT];
+    int len=is->word(buf, WORDSZ*4);
 
-    if(!*is){
+    if(len < 0){
         // EOF/fail
         if(!iostack.empty()){
             // finished with an INCLUDE, close it and go back to prev file
@@ -1216,23 +5304,14 @@ void Interpreter::Context::mw_word()
         
         // nothing left
         interp.heap[WORDLENAT]=-1;
-        ((char *) &interp.heap[WORDBUFAT])[0]='\0';
+        buf[0]='\0';
     }
     else{
-        // truncate
-        size_t len=str.length();
-        if(len > WORDSZ*4-1){
-            len=WORDSZ*4-1;
-            str.resize(len);
-        }
-        // copy length into heap into fixed-size buffer
         interp.heap[WORDLENAT]=len;
-        // copy string data plus NUL
-        memcpy((char *) &interp.heap[WORDBUFAT], str.c_str(), len+1);
     }
 
 #ifndef NDEBUG
-    cerr << "word " << str << endl;
+    cerr << "word " << buf << endl;
 #endif
     
     // push ptr
@@ -1246,7 +5325,7 @@ void Interpreter::Context::mw_eof()
         return;
     }
 
-    if(!is->good()){
+    if(is->eof()){
         // EOF/fail
 
         if(!iostack.empty()){
@@ -1260,7 +5339,7 @@ void Interpreter::Context::mw_eof()
         }
     }
     
-    dstk[dsp++]=is->good() ? 0 : 1;
+    dstk[dsp++]=is->eof() ? 1 : 0;
 }
 
 void Interpreter::Context::mw_number()
@@ -1297,7 +5376,9 @@ void Interpreter::Context::mw_dot()
         state=EX_DSTK_UNDER;
         return;
     }
-    *os << dstk[--dsp] << ' ';
+    char num[16];
+    int n=snprintf(num, sizeof(num), "%d ", dstk[--dsp]);
+    output(num, n);
 }
 
 void Interpreter::Context::mw_create()
@@ -1318,48 +5399,85 @@ void Interpreter::Context::mw_create()
     interp.create(str, ptr);
 }
 
-const char *Interpreter::get_string(fith_cell p)
+void Interpreter::Context::mw_find()
 {
-    size_t ptr=size_t(p);
-    
-    if(ptr >= heapsz){
-        // invalid ptr
-        return NULL;
+    if(dsp < 1){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
     }
 
-    // retrieve string-len
-    size_t len=size_t(heap[ptr]);
-    if(ptr+1+((len+3)>>2) >= heapsz){
-        // invalid length
-        return NULL;
+    // pointer to string object
+    const char *p=interp.get_string(dstk[dsp-1]);
+    // valid?
+    if(p == NULL){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
     }
-    // ptr to data
-    const char *sp=(const char *) &heap[ptr+1];
-    if(sp[len] != '\0'){
-        // no trailing NUL at expected location
-        return NULL;
+
+    // lookup & overwrite TOS
+    dstk[dsp-1]=interp.find(p);
+}
+
+// ( str xt -- ) declare a local of the word being compiled
+void Interpreter::Context::mw_local()
+{
+    if(dsp < 2){
+        state=Interpreter::EX_DSTK_UNDER;
+        return;
     }
 
-    return sp;
+    fith_cell xt=dstk[--dsp];
+    const char *str=interp.get_string(dstk[--dsp]);
+
+    if(str == NULL){
+        state=Interpreter::EX_SEGV_DATA;
+        return;
+    }
+
+    interp.locals.push_back(std::make_pair(string(str), xt));
 }
 
-void Interpreter::Context::mw_find()
+// ( str -- k ) number of the local, or -1; later locals shadow earlier
+void Interpreter::Context::mw_findlocal()
 {
     if(dsp < 1){
         state=Interpreter::EX_DSTK_UNDER;
         return;
     }
 
-    // pointer to string object
     const char *p=interp.get_string(dstk[dsp-1]);
-    // valid?
     if(p == NULL){
         state=Interpreter::EX_SEGV_DATA;
         return;
     }
 
-    // lookup & overwrite TOS
-    dstk[dsp-1]=interp.find(p);
+    fith_cell k=interp.locals.size()-1;
+    while(k >= 0 && interp.locals[k].first != p){
+        --k;
+    }
+    dstk[dsp-1]=k;
+}
+
+// ( -- n ) forget the locals, returning how many there were
+void Interpreter::Context::mw_endlocals()
+{
+    if(dsp >= dsz){
+        state=Interpreter::EX_DSTK_OVER;
+        return;
+    }
+    dstk[dsp++]=interp.locals.size();
+    interp.locals.clear();
+}
+
+// ( -- n ) number of cells on the data stack, before this one
+void Interpreter::Context::mw_depth()
+{
+    if(dsp >= dsz){
+        state=Interpreter::EX_DSTK_OVER;
+        return;
+    }
+    dstk[dsp]=dsp;
+    ++dsp;
 }
 
 void Interpreter::Context::mw_latest()
@@ -1391,10 +5509,7 @@ void Interpreter::Context::mw_latest()
 
 void Interpreter::Context::mw_immediate()
 {
-    di i=interp.dictionary.find(interp.latestword);
-    if(i != interp.dictionary.end()){
-        i->second ^= FLAG_IMMED;
-    }
+    interp.dictionary.flip(interp.latestword.c_str(), FLAG_IMMED);
 }
 
 void Interpreter::Context::mw_hidden()
@@ -1405,9 +5520,8 @@ void Interpreter::Context::mw_hidden()
     }
     const char *str=interp.get_string(dstk[--dsp]);
     
-    di i=interp.dictionary.find(str);
-    if(i != interp.dictionary.end()){
-        i->second ^= FLAG_HIDE;
+    if(str != NULL){
+        interp.dictionary.flip(str, FLAG_HIDE);
     }
 }
 
@@ -1442,6 +5556,22 @@ void Interpreter::Context::mw_interpret()
     }
     // word ptr is on stack
 
+    if(interp.compilestate && !interp.locals.empty()){
+        // a local of the word being compiled: its word compiles the access
+        mw_findlocal();
+        fith_cell k=dstk[dsp-1];
+        if(k >= 0){
+            if(dsp >= dsz){
+                state=Interpreter::EX_DSTK_OVER;
+                return;
+            }
+            dstk[dsp++]=interp.locals[k].second;
+            mw_call();
+            return;
+        }
+        dstk[dsp-1]=WORDLENAT;
+    }
+
     // look it up
     mw_find();
     fith_cell wordptr=dstk[dsp-1];
@@ -1450,6 +5580,7 @@ void Interpreter::Context::mw_interpret()
 
         // hidden word; don't allow it to be compiled/run
         if((wordptr & FLAG_HIDE) != 0){
+            flush();
             *os << "Unrecognised word " << ((char *) &interp.heap[WORDBUFAT]) << endl;
             --dsp;
             return;
@@ -1487,6 +5618,7 @@ void Interpreter::Context::mw_interpret()
         else{
             // parse failure; whinge
             dsp-=2;            
+            flush();
             *os << "Unrecognised word " << ((char *) &interp.heap[WORDBUFAT]) << endl;
             return;
         }
@@ -1534,10 +5666,15 @@ void Interpreter::Context::mw_dump()
     if(ofs){
         ofs << "HERE = " << HERE << endl;
 
+        // labels come from walking the address index alongside
+        const vector<Dictionary::Entry> &ix=interp.dictionary.byAddress();
+        size_t next=0;
         for(fith_cell p=1;p<HERE;++p){
-            const char *label=interp.reverse_find(p);            
-            if(label != NULL){
-                ofs << label << ":" << endl;
+            while(next < ix.size() && ix[next].first < p){
+                ++next;
+            }
+            if(next < ix.size() && ix[next].first == p){
+                ofs << interp.dictionary.name(ix[next].second) << ":" << endl;
             }
 
             ofs << setw(4) << setfill('0') << p << " ";
@@ -1547,12 +5684,15 @@ void Interpreter::Context::mw_dump()
             ofs << "  " << opcode_to_string(v);
             if((v & FLAG_MACHINE) != 0){
                 v &= FLAG_ADDR;
-                if(v == MW_LIT || v == MW_JMP || v == MW_JZ){
-                    ofs << " " << interp.bin[++p];
-                }
-                else if(v == MW_TICK){
+                if(v == MW_TICK){
                     ofs << " " << opcode_to_string(interp.bin[++p]);
                 }
+                else if(v < MW_INTERP_COUNT){
+                    // an OPF_TABLE op's whole table goes on the one line
+                    for(fith_cell k=operands(interp.bin+p, HERE-p);k>0 && p+1<HERE;--k){
+                        ofs << " " << interp.bin[++p];
+                    }
+                }
             }
             ofs << endl;
         }
@@ -1590,9 +5730,9 @@ void Interpreter::Context::mw_save()
         // generate textual map
         ostringstream oss;
         oss << hex;
-        for(dci i=interp.dictionary.begin();i!=interp.dictionary.end();++i){
-            if((i->second & (FLAG_MACHINE | FLAG_HIDE)) == 0){
-                oss << setw(8) << setfill('0') << i->second << setw(0) << " " << i->first << endl;
+        for(Dictionary::const_iterator i=interp.dictionary.begin();i!=interp.dictionary.end();++i){
+            if((i->value & (FLAG_MACHINE | FLAG_HIDE)) == 0){
+                oss << setw(8) << setfill('0') << i->value << setw(0) << " " << i->name << endl;
             }
         }
         string mapstr=oss.str();
@@ -1609,6 +5749,7 @@ void Interpreter::Context::mw_save()
         fof.writeCrc();
         ofs.close();
 
+        flush();
         *os << "SAVE success" << endl;
     }
     catch(runtime_error &e){
@@ -1641,24 +5782,15 @@ void Interpreter::Context::mw_gc()
     // compute the size of each function, assuming each entry
     // in the dict is a whole function that ends at the next
     // dictionary entry
-    ccmap extents;
-
+    cset starts;
     for(rdci i=rd.begin();i!=rd.end();++i){
-        rdci j=i;  ++j;
-        if(j == rd.end()){
-            // last thing: goes to HERE
-            extents[i->first]=interp.bin[HEREATB] - i->first;
-        }
-        else{
-            // len = next - current
-            extents[i->first]=j->first - i->first;
-        }
-        
-        if(extents[i->first] <= 0){
-            cerr << "bad extents in GC" << endl;
-            state=EX_SEGV_CODE;
-            return;
-        }
+        starts.insert(i->first);
+    }
+    Verifier::extent_map extents;
+    if(!Verifier::extents(starts, interp.bin[HEREATB], extents)){
+        cerr << "bad extents in GC" << endl;
+        state=EX_SEGV_CODE;
+        return;
     }
     
     // set of functions in the call-tree of the root
@@ -1691,17 +5823,10 @@ void Interpreter::Context::mw_gc()
             for(fith_cell k=0;k<len;++k){
                 fith_cell cell=interp.bin[ptr+k];
 
-                // skip the next which is a literal/scalar
-                if(cell == (FLAG_MACHINE | MW_LIT) ||
-                   cell == (FLAG_MACHINE | MW_JZ) ||
-                   cell == (FLAG_MACHINE | MW_JMP)){
-                    ++k;
-                    continue;
-                }
-                
-                // ignore all builtins
-                // NB this means we still follow ptrs following MW_TICK
+                // ignore all builtins and skip their scalars
+                // NB we still follow ptrs following MW_TICK
                 if((cell & FLAG_MACHINE) != 0){
+                    k+=interp.scalars(ptr+k, len-k);
                     continue;
                 }
 
@@ -1716,6 +5841,11 @@ void Interpreter::Context::mw_gc()
         }
     }
 
+    // peephole-optimise everything that's staying; functions only shrink
+    for(csci i=live.begin();i!=live.end();++i){
+        extents[*i]=interp.fuse(*i, extents[*i]);
+    }
+
     // decide on new locations, i.e. reallocate space for live objects
     fith_cell newhere=BINUSED;
     ccmap remap;
@@ -1758,12 +5888,13 @@ void Interpreter::Context::mw_gc()
                 cell &= FLAG_ADDR;
                 
                 if(cell >= MW_STORECODE){
+                    flush();
                     *os << "warn: GC retains extended instruction " << opcode_to_string(cell | FLAG_MACHINE)
                         << " in " << func << endl;
                 }
 
-                // copy also the following literal/scalar
-                if((cell == MW_LIT || cell == MW_JZ || cell == MW_JMP) && k+1 < len){
+                // copy also the following literals/scalars
+                for(fith_cell n=interp.scalars(from+k, len-k);n>0;--n){
                     ++k;
                     tmpbuf[to+k]=interp.bin[from+k];
                 }
@@ -1787,6 +5918,9 @@ void Interpreter::Context::mw_gc()
         interp.bin[i]=tmpbuf[i];
     }
     delete[] tmpbuf;
+    interp.setProofs(NULL, 0);
+    interp.drop_native();
+    interp.redecode(0, interp.binsz);
 
     // recreate the dictionary
     interp.dictionary.clear();
@@ -1794,7 +5928,7 @@ void Interpreter::Context::mw_gc()
 
     // add preserved functions
     for(cmci i=remap.begin();i!=remap.end();++i){
-        interp.dictionary[rd[i->first]]=i->second;
+        interp.dictionary.set(rd[i->first], i->second);
 #ifndef NDEBUG
         cerr << rd[i->first] << " => " << i->second << endl;
 #endif
@@ -1817,20 +5951,43 @@ void Interpreter::Context::mw_include()
     const char *fn=interp.get_string(dstk[--dsp]);
 
     if(!fn){
+        flush();
         *os << "invalid filename for INCLUDE" << endl;
         return;
     }
 
-    ifstream *ifs=new ifstream(fn, ios::in);
-    if(!ifs || !*ifs){
+    Source *src=Source::open(fn);
+    if(!src){
+        flush();
         *os << "INCLUDE fails to open " << fn << endl;
-        delete ifs;
         return;
     }
 
-    // remember the old input-stream and select the new one for WORD/KEY/EOF processing
+    // remember the old input and select the new one for WORD/KEY/EOF processing
     iostack.push(is);
-    is=ifs;
+    is=src;
+}
+
+void Interpreter::Context::mw_fuse()
+{
+    // the latest word runs from its entry point to HERE
+    fith_cell start=interp.find(interp.latestword.c_str());
+    if((start & FLAG_MACHINE) != 0){
+        // not found, or a builtin
+        return;
+    }
+    start &= FLAG_ADDR;
+
+    fith_cell &here=interp.bin[HEREATB];
+    if(start < BINUSED || start >= here){
+        return;
+    }
+    interp.drop_native();
+    if(start < interp.proofhere){
+        interp.setProofs(NULL, 0);
+    }
+
+    here=start+interp.fuse(start, here-start);
 }
 
 #endif  // FULLFITH
@@ -34,6 +34,7 @@
 #include <iostream>
 #include <map>
 #include <stack>
+#include <vector>
 #endif
 
 namespace fith {
@@ -49,6 +50,23 @@ public:
     virtual fith_cell syscall1(fith_cell a) =0;
     virtual fith_cell syscall2(fith_cell a, fith_cell b) =0;
     virtual fith_cell syscall3(fith_cell a, fith_cell b, fith_cell c) =0;    
+
+    /**
+     * Output from EMIT, TYPE and TELL, a Context's buffer at a time.  By
+     * default each char goes to syscall2(char, SC2_EMIT) in turn.
+     */
+    virtual void write(const char *buf, std::size_t len);
+
+    /**
+     * Milliseconds since boot, wrapping, for the timer function blocks
+     * (TON, TOF, TP).  By default syscall1(SC1_TIME_MSBOOT).
+     */
+    virtual fith_cell msboot();
+
+    /// the syscall2 that the default write() uses, as SCEMIT in 5th/example.5th
+    static const fith_cell SC2_EMIT=0;
+    /// the syscall1 that the default msboot() uses, as in 5th/plc.5th
+    static const fith_cell SC1_TIME_MSBOOT=0x2002;
 };
 
 class Interpreter {
@@ -64,12 +82,42 @@ public:
         EX_SEGV_CODE,       ///< execution outside the binary
         EX_BAD_OPCODE,      ///< opcode/instruction not recognised
         EX_DIV_ZERO,        ///< attempted to divide by zero
-        EX_HALTED,          ///< execution halted, e.g. by timeout callback
+        EX_HALTED,          ///< stopped: after GC, or the budget ran out (execute() again to resume)
         EX_RUNNING,         ///< still going
 
         EX_INTERP_COUNT
     };
+
+    /**
+     * How a Context runs code.  In the first two, proven entry-points use
+     * the fast loop without stack checks, and the mode applies to the rest.
+     */
+    enum EXEC_MODE {
+        EXEC_TABLE,         ///< every opcode via its handler in the jump table
+        EXEC_FAST,          ///< ip, stack pointers and TOS cached in locals; same checks
+        EXEC_PARANOID,      ///< as EXEC_FAST, ignoring proofs: everything checked
+        EXEC_TRUSTED,       ///< no stack or IP checks, proven or not: only for binaries known to be safe
+    };
+
+    /**
+     * Compile-time policy for the fast loop, which is instantiated once per
+     * combination used; the code for a feature that is off is not generated.
+     */
+    enum {
+        XP_CHECKED=1,       ///< stack, IP and opcode checks
+        XP_DECODED=2,       ///< run from the pre-decoded binary, see setDecoded
+        XP_TRACE=4,         ///< print each instruction to cerr (FULLFITH only)
+        XP_BUDGET=8,        ///< count backward branches and calls, see Context::execute
+    };
         
+#ifdef FULLFITH
+    /// the full system compiles into the binary
+    typedef fith_cell code_t;
+#else
+    /// the embedded interpreter never writes the binary, so it may be in ROM
+    typedef const fith_cell code_t;
+#endif
+
     /**
      * Create interpreter.
      *
@@ -79,7 +127,7 @@ public:
      * @param heapsz number of fith_cells in the heap
      * @param bs should the binary+heap be initialised to a raw bootstrapped state?  false if binary preloaded
      */
-    Interpreter(fith_cell *_bin, std::size_t _binsz, fith_cell *_heap, std::size_t _heapsz,
+    Interpreter(code_t *_bin, std::size_t _binsz, fith_cell *_heap, std::size_t _heapsz,
                 bool bs=true);
     
     enum {
@@ -93,8 +141,8 @@ public:
         MW_DIV,         ///< integer divide
         MW_MOD,         ///< integer mod
         MW_MULDIV,      ///< */ = floor(n1*n2/n3) where n1*n2 is kept at double-width
-        MW_DIVMOD,      ///< /MOD = quotient and mod
-        MW_MULMOD,      ///< */MOD = per */ and produce both quotient and mod
+        MW_DIVMOD,      ///< /MOD ( n1 n2 -- rem quot )
+        MW_MULMOD,      ///< */MOD ( n1 n2 n3 -- rem quot ) per */ and produce both quotient and mod
         MW_JMP,         ///< unconditional jump
         MW_JZ,          ///< conditional (TOS==0) jump
         MW_CALL,        ///< call the word at TOS, as if *ip == *dsp
@@ -131,13 +179,109 @@ public:
         MW_SYSCALL1,    ///< 1-param syscall
         MW_SYSCALL2,    ///< 2-param syscall
         MW_SYSCALL3,    ///< 3-param syscall
+
+        // superinstructions, produced only by fuse()
+        MW_PLUSLIT,     ///< LIT n +
+        MW_READLIT,     ///< LIT addr @, also a VARIABLE's fetch
+        MW_DUPJZ,       ///< DUP JZ, i.e. test TOS without consuming it
+        MW_FORTEST,     ///< R> R@ OVER >R <, the test at the top of a FOR loop
+        MW_RPLUSLIT,    ///< R> LIT n + >R, the increment at the bottom of a FOR loop
+        MW_ANDLIT,      ///< LIT m &, or LIT m ~ & with the mask inverted
+        MW_ORLIT,       ///< LIT m |
+        MW_XORLIT,      ///< LIT m ^
+
+        // counted loops; the return stack holds ( limit index )
+        MW_DO,          ///< (DO) start a loop ( limit start -- ), branch to its end if start >= limit
+        MW_LOOP,        ///< (LOOP) ++index, branch back while index < limit
+        MW_PLUSLOOP,    ///< (+LOOP) index += TOS, branch back while index < limit
+        MW_LOOPI,       ///< I, index of the innermost loop
+        MW_LOOPJ,       ///< J, index of the next loop out
+
+        // bulk data-space operations, range-checked once; the C forms take byte addresses
+        MW_MOVE,        ///< ( src dst n -- ) copy n cells, even if they overlap
+        MW_MOVEC,       ///< ( src dst n -- ) copy n bytes, even if they overlap
+        MW_FILL,        ///< ( addr n val -- ) set n cells to val
+        MW_FILLC,       ///< ( addr n char -- ) set n bytes to char
+        MW_COMPARE,     ///< ( a1 a2 n -- cmp ) -1, 0 or 1 as n cells at a1 are <, = or > those at a2
+        MW_COMPAREC,    ///< ( a1 a2 n -- cmp ) as COMPARE, for bytes (unsigned)
+        MW_SCAN,        ///< ( addr n val -- i ) index of the first of n cells equal to val, or -1
+        MW_SCANC,       ///< ( addr n char -- i ) as SCAN, for bytes
+
+        // strings, checked once with get_string: a bad one is EX_SEGV_DATA
+        MW_STRLEN,      ///< ( str -- len )
+        MW_STRREAD,     ///< [@] ( str off -- char ), NUL if off is out of range
+        MW_STRWRITE,    ///< [!] ( char str off -- ), nothing if off is out of range
+        MW_STRCMP,      ///< ( s1 s2 -- cmp ) -1, 0 or 1 as s1 sorts before, with or after s2
+        MW_STRCAT,      ///< ( s1 s2 -- s3 ) allot a new string, s1 followed by s2
+
+        // output, buffered in the Context until flush()
+        MW_EMIT,        ///< emit one char
+        MW_TYPE,        ///< ( addr n -- ) emit n bytes from a byte address
+        MW_TELL,        ///< print a string ( str -- )
+        MW_FLUSH,       ///< write out whatever is buffered
+
+        // single bits and bit-fields; positions outside 0..31 select no bits
+        MW_BTST,        ///< ( x n -- f ) 1 if bit n of x is set, else 0
+        MW_BSET,        ///< ( x n -- x' ) set bit n
+        MW_BCLR,        ///< ( x n -- x' ) clear bit n
+        MW_BTGL,        ///< ( x n -- x' ) toggle bit n
+        MW_BFX,         ///< ( x pos width -- f ) extract an unsigned field
+        MW_BFI,         ///< ( x f pos width -- x' ) insert the low width bits of f
+        MW_POPCNT,      ///< ( x -- n ) number of bits set
+        MW_FFS,         ///< ( x -- n ) position of the lowest set bit, or -1 if none
+
+        // double cells, kept as ( lo hi ) with the high cell on top
+        MW_DPLUS,       ///< D+ ( d1 d2 -- d3 )
+        MW_DMINUS,      ///< D- ( d1 d2 -- d3 )
+        MW_MSTAR,       ///< M* ( n1 n2 -- d ) signed product at double width
+        MW_UMDIVMOD,    ///< UM/MOD ( ud u -- rem quot ) unsigned; quot keeps only its low cell
+        MW_DLT,         ///< D< ( d1 d2 -- f ) signed
+        MW_DEQ,         ///< D= ( d1 d2 -- f )
+
+        // fixed point (Q16.16) and scaling; Q* and Q/ saturate rather than wrap
+        MW_QMUL,        ///< Q* ( a b -- a*b )
+        MW_QDIV,        ///< Q/ ( a b -- a/b )
+        MW_SQRT,        ///< ( u -- r ) square root of u taken as unsigned, rounded down
+        MW_MIN,         ///< ( a b -- min )
+        MW_MAX,         ///< ( a b -- max )
+        MW_CLAMP,       ///< ( x lo hi -- x' ) x limited to lo..hi
+        MW_INTERP,      ///< ( x table -- y ) piecewise-linear lookup, see mw_interp
+
+        // IEC 61131-3 function blocks, each keeping its state in a zeroed
+        // instance at fb in the data space; inputs are true if non-zero
+        MW_TON,         ///< ( in pt fb -- q ) on-delay: q once in has been true for pt ms
+        MW_TOF,         ///< ( in pt fb -- q ) off-delay: q until in has been false for pt ms
+        MW_TP,          ///< ( in pt fb -- q ) pulse: q for pt ms from a rising edge of in
+        MW_CTU,         ///< ( cu reset pv fb -- q ) count rising edges of cu up; q once cv >= pv
+        MW_CTD,         ///< ( cd load pv fb -- q ) count rising edges of cd down from pv; q once cv <= 0
+        MW_RTRIG,       ///< R_TRIG ( clk fb -- q ) q on a rising edge of clk
+        MW_FTRIG,       ///< F_TRIG ( clk fb -- q ) q on a falling edge of clk
+
+        // multi-way branch, see OPF_TABLE
+        MW_CASE,        ///< (CASE) ( x -- ) branch to entry x of the table, or the default if there isn't one
+
+        // indexed addressing, checked as per @ and !; the C forms take byte addresses
+        MW_STORELIT,    ///< !LIT ( x -- ) write to the address operand, i.e. TO a VARIABLE; LIT addr !
+        MW_READX,       ///< @X ( base i -- x ) read cell base+i; + @
+        MW_STOREX,      ///< !X ( x base i -- ) write cell base+i; + !
+        MW_READCX,      ///< @CX ( base i -- c ) read byte base+i; + @C
+        MW_STORECX,     ///< !CX ( c base i -- ) write byte base+i; + !C
+        MW_READINC,     ///< @+ ( addr -- addr+1 x ) read, stepping on to the next cell
+        MW_STOREINC,    ///< !+ ( x addr -- addr+1 ) write, stepping on to the next cell
+        MW_READCINC,    ///< @C+ ( addr -- addr+1 c ) as @+ for bytes
+        MW_STORECINC,   ///< !C+ ( c addr -- addr+1 ) as !+ for bytes
+
+        // locals, in a frame on the return stack; see OPF_COUNT and OPF_RINDEX
+        MW_FRAME,       ///< (FRAME) ( x0 .. xn-1 -- ) R:( -- x0 .. xn-1 ) move n cells to the return stack
+        MW_UNFRAME,     ///< (UNFRAME) R:( x0 .. xn-1 -- ) drop n cells from the return stack
+        MW_LOCALGET,    ///< (L@) ( -- x ) copy the cell i down the return stack, as i RPICK
+        MW_LOCALSET,    ///< (L!) ( x -- ) overwrite the cell i down the return stack
 #ifdef FULLFITH
         MW_STORECODE,   ///< C! write to code area
         MW_READCODE,    ///< C@ read from code area
         MW_COMMA,       ///< append to binary
 
         MW_KEY,         ///< wait and retrieve next keystroke
-        MW_EMIT,        ///< emit one char
         MW_WORD,        ///< read a word/identifier from input stream
         MW_EOF,         ///< is the input stream EOF or otherwise failed?
         MW_NUMBER,      ///< parse a string as a number ( ptr -- results unconverted )
@@ -159,14 +303,207 @@ public:
         MW_GC,          ///< garbage-collect and relink the binary from a nominated single entry point
 
         MW_INCLUDE,     ///< select() a different file (until EOF), then return back to the previous
+
+        MW_FUSE,        ///< rewrite the latest word with superinstructions
+
+        MW_LOCAL,       ///< ( str xt -- ) name the next local of the word being compiled
+        MW_FINDLOCAL,   ///< ( str -- k ) index of a local by name, or -1
+        MW_ENDLOCALS,   ///< ( -- n ) forget the locals, returning how many there were
+        MW_DEPTH,       ///< ( -- n ) number of cells on the data stack
 #endif            
         MW_INTERP_COUNT        ///< number of machine-words defined
     };
 
     // version numbers for saved binaries: compatibility check
-    static const unsigned BINVERSION=1;
+    static const unsigned BINVERSION=13;
     static const unsigned IOVERSION=1;    
+
+    /// flags describing opcode behaviour, see OpInfo
+    enum {
+        OPF_EXIT=1,         ///< returns from the current function
+        OPF_BRANCH=2,       ///< operand is a jump offset wrt the opcode
+        OPF_JUMP=4,         ///< never falls through to the next instruction
+        OPF_UNSAFE=8,       ///< stack effect unknowable, or modifies code: never verified
+        OPF_TABLE=16,       ///< operands are a count n, a default offset and n more offsets, all wrt the opcode
+        OPF_COUNT=32,       ///< operand is a count n: din, rin and rout are per cell
+        OPF_RINDEX=64,      ///< operand i indexes the return stack: rin and rout are i more
+    };
+
+    /**
+     * Static description of an opcode: its fixed stack effects and inline
+     * operands.  Ops that index the stacks with a runtime value (PICK, ROLL,
+     * RPICK) list only their fixed part and keep their own checks.
+     */
+    struct OpInfo {
+        unsigned char din;      ///< data stack cells consumed
+        unsigned char dout;     ///< data stack cells produced
+        unsigned char rin;      ///< return stack cells consumed
+        unsigned char rout;     ///< return stack cells produced
+        unsigned char operands; ///< inline scalar cells following the opcode
+        unsigned char flags;    ///< OPF_*
+    };
+
+    /// per-opcode stack effects
+    static const OpInfo opinfo[MW_INTERP_COUNT];
+
+    /**
+     * Number of cells following the opcode at op: as per opinfo, except
+     * that an OPF_TABLE op's table is counted too.
+     * @param len cells from op to the end of its function; a table with a
+     * count that doesn't fit is taken to run to the end
+     */
+    static fith_cell operands(const fith_cell *op, fith_cell len);
+
+    /**
+     * Stack effect of the instruction at op: as per opinfo, with OPF_COUNT
+     * and OPF_RINDEX applied.  An operand that is negative, or too big for
+     * an OpInfo, makes it OPF_UNSAFE, i.e. never verified.
+     * @param len cells from op to the end of its function
+     */
+    static OpInfo effect(const fith_cell *op, fith_cell len);
+
+    /**
+     * Stack bounds of one function, as proven by the load-time Verifier.
+     * A thread entering such a function on an empty return stack with
+     * enough data-stack cells and room on both stacks cannot fault on a
+     * stack or IP check, so it may be executed without them.
+     */
+    struct Proof {
+        fith_cell addr;     ///< entry point
+        fith_cell need;     ///< data stack cells consumed from the caller
+        fith_cell grow;     ///< max data stack growth above the entry depth
+        fith_cell rgrow;    ///< max return stack growth, including nested calls
+        fith_cell cost;     ///< most it can charge against a budget (its calls and theirs), -1 if it can loop
+    };
+
+    /**
+     * One cell of the binary, pre-decoded for the fast loop so that it
+     * needn't test the flags, mask and range-check every instruction it
+     * fetches.  There is one record per cell, so addresses, jump offsets
+     * and return addresses are unchanged; the binary itself remains the
+     * canonical copy for C@, DUMP, SAVE and the other loops.
+     */
+    struct Decoded {
+        fith_cell op;       ///< opcode, DEC_CALL or DEC_BAD
+        fith_cell arg;      ///< call target, else the next cell (i.e. any inline operand)
+    };
+
+    /**
+     * One thread's state as seen by native code (see fithaot): a function
+     * translated from the binary works on this directly, makes the same
+     * checks as the interpreter and returns the same EXEC_RESULT.
+     */
+    struct Machine {
+        fith_cell *dstk;
+        fith_cell *rstk;
+        std::size_t dsp;
+        std::size_t rsp;
+        std::size_t dsz;
+        std::size_t rsz;
+        fith_cell *heap;
+        std::size_t heapsz;
+        SysCalls *syscalls;
+        std::size_t ip;     ///< where the interpreter would have stopped, set on return
+    };
+
+    typedef EXEC_RESULT (*native_t)(Machine &);
+
+    /// native translation of the function at addr
+    struct Native {
+        fith_cell addr;
+        native_t fn;
+    };
+
+    /// native translations of a binary's functions, as generated by fithaot
+    struct NativeTable {
+        unsigned crc;           ///< crc() of the binary they were generated from
+        std::size_t count;
+        const Native *fns;      ///< sorted by address
+    };
+
+    /**
+     * Host code generator that runs alongside the interpreter (see Jit).
+     * Offered each entry to a function with an empty return stack, where
+     * native code may take over, so it can count them and compile the
+     * hot ones.  Compiled code follows the same rules as fithaot's.
+     */
+    class Compiler {
+    public:
+        virtual ~Compiler() {}
+
+        /// native code for the function at ip, or NULL to interpret it
+        virtual native_t enter(std::size_t ip) =0;
+
+        /// code space has changed underneath anything compiled
+        virtual void invalidate() =0;
+    };
+
+    /// Decoded::op values other than opcodes
+    enum {
+        DEC_CALL=MW_INTERP_COUNT,   ///< call to arg
+        DEC_BAD                     ///< not a valid opcode
+    };
     
+#ifdef FULLFITH
+    /**
+     * Input to WORD, KEY and EOF, scanned in place: a whole file mapped
+     * into memory (INCLUDE), else a stream read through its streambuf
+     * (stdin, or wherever the Context was given), so a terminal is read
+     * no further ahead than before.
+     */
+    class Source {
+    public:
+        /// read from a stream, which must outlive us
+        explicit Source(std::istream *_is);
+        ~Source();
+
+        /// map a file, or read it as a stream if it can't be mapped; NULL if it can't be opened
+        static Source *open(const char *filename);
+
+        /**
+         * Next whitespace-delimited word, as much of it as fits copied to
+         * buf with a NUL and the rest skipped.
+         * @return its length as copied, or -1 at the end
+         */
+        int word(char *buf, std::size_t size);
+        /// @return next character, or -1 at the end
+        int key();
+        /// has a read reached the end?
+        bool eof() const { return ended; }
+
+    private:
+        Source(const char *_pos, std::size_t len, std::istream *_owned);
+        Source(const Source &);
+        Source &operator=(const Source &);
+
+        int peek()
+        {
+            typedef std::char_traits<char> traits;
+            int c=sb ? sb->sgetc() : (pos < end ? traits::to_int_type(*pos) : traits::eof());
+            if(c == traits::eof()){
+                ended=true;
+            }
+            return c;
+        }
+        void bump()
+        {
+            if(sb){
+                sb->sbumpc();
+            }
+            else{
+                ++pos;
+            }
+        }
+
+        std::streambuf *sb;     ///< stream input, else NULL
+        std::istream *owned;    ///< stream we opened, to close
+        const char *pos, *end;  ///< mapped input
+        void *map;
+        std::size_t maplen;
+        bool ended;
+    };
+#endif
+
     /**
      * Context of execution of one thread.
      */
@@ -199,14 +536,36 @@ public:
         
         /**
          * Run the interpreter until the called word returns or something breaks.
+         * Uses the unchecked loop if the entry-point has been proven safe.
+         *
+         * With a budget, every backward branch and every call (including
+         * EXECUTE) costs one, and once it is spent execute() returns
+         * EX_HALTED with ip and both stacks as they are, so that calling it
+         * again carries on from there.  Native code can't be stopped
+         * part-way, so it is only used for a word that can't loop, whose
+         * proof's cost is then charged up front.
+         * @param budget limit for this call, 0 for none
+         */
+        EXEC_RESULT execute(std::size_t budget=0);
+
+        /**
+         * Write out the output buffered by EMIT, TYPE and TELL: to the
+         * output stream in the full system, else to SysCalls::write.  Done
+         * at a newline, when the buffer fills, before a syscall or reading
+         * input, by FLUSH and before execute() returns.
          */
-        EXEC_RESULT execute();
+        void flush();
 
         /**
          * Choose a new entry-point.
          */
         void set_ip(std::size_t _ip);
 
+        /**
+         * Choose how code is run; default EXEC_FAST.
+         */
+        void set_mode(EXEC_MODE _mode);
+
 #ifdef FULLFITH
 
         /**
@@ -216,6 +575,27 @@ public:
         
 #endif
     private:
+
+        /// main loop with all stack and IP checks
+        EXEC_RESULT execute_checked();
+        /// main loop with ip, stack pointers and TOS in locals; see EXEC_FAST and XP_*
+        template<unsigned XP> EXEC_RESULT run_fast();
+        /// pick the instantiation of run_fast for the binary
+        template<unsigned XP> EXEC_RESULT run_policy();
+        /// run a native translation of the function at ip
+        EXEC_RESULT run_native(native_t fn);
+        /// print the instruction (cell) just fetched from at-1, for XP_TRACE
+        void trace(std::size_t at, fith_cell cell);
+        /// charge a call or backward branch against the budget
+        void charge();
+        /// take the branch whose offset (wrt the opcode) is at ip
+        void branch();
+        /// pick the loop to run, for execute()
+        EXEC_RESULT dispatch();
+        /// buffer output, see flush()
+        void output(const char *p, std::size_t n);
+        /// checks common to TON, TOF and TP, and the time; the instance, or NULL
+        fith_cell *fb_timer(fith_cell &now);
         
         void mw_exit();
         void mw_lit();
@@ -265,13 +645,86 @@ public:
         void mw_syscall1();
         void mw_syscall2();
         void mw_syscall3();
+        void mw_pluslit();
+        void mw_readlit();
+        void mw_dupjz();
+        void mw_fortest();
+        void mw_rpluslit();
+        void mw_andlit();
+        void mw_orlit();
+        void mw_xorlit();
+        void mw_do();
+        void mw_loop();
+        void mw_plusloop();
+        void mw_loopi();
+        void mw_loopj();
+        void mw_move();
+        void mw_movec();
+        void mw_fill();
+        void mw_fillc();
+        void mw_compare();
+        void mw_comparec();
+        void mw_scan();
+        void mw_scanc();
+        void mw_strlen();
+        void mw_strread();
+        void mw_strwrite();
+        void mw_strcmp();
+        void mw_strcat();
+        void mw_emit();
+        void mw_type();
+        void mw_tell();
+        void mw_flush();
+        void mw_btst();
+        void mw_bset();
+        void mw_bclr();
+        void mw_btgl();
+        void mw_bfx();
+        void mw_bfi();
+        void mw_popcnt();
+        void mw_ffs();
+        void mw_dplus();
+        void mw_dminus();
+        void mw_mstar();
+        void mw_umdivmod();
+        void mw_dlt();
+        void mw_deq();
+        void mw_qmul();
+        void mw_qdiv();
+        void mw_sqrt();
+        void mw_min();
+        void mw_max();
+        void mw_clamp();
+        void mw_interp();
+        void mw_ton();
+        void mw_tof();
+        void mw_tp();
+        void mw_ctu();
+        void mw_ctd();
+        void mw_rtrig();
+        void mw_ftrig();
+        void mw_case();
+        void mw_storelit();
+        void mw_readx();
+        void mw_storex();
+        void mw_readcx();
+        void mw_storecx();
+        void mw_readinc();
+        void mw_storeinc();
+        void mw_readcinc();
+        void mw_storecinc();
+        void mw_frame();
+        void mw_unframe();
+        void mw_localget();
+        void mw_localset();
+        /// stands in for the opcodes left out of a minimal runtime, see fithgen
+        void mw_badop();
         
 #ifdef FULLFITH
         void mw_storecode();
         void mw_readcode();
         void mw_comma();
         void mw_key();
-        void mw_emit();
         void mw_word();
         void mw_eof();
         void mw_number();
@@ -291,6 +744,11 @@ public:
         void mw_save();
         void mw_gc();
         void mw_include();
+        void mw_fuse();
+        void mw_local();
+        void mw_findlocal();
+        void mw_endlocals();
+        void mw_depth();
 
         std::string opcode_to_string(fith_cell v);
         
@@ -306,6 +764,14 @@ public:
         std::size_t &dsp;   ///< data stack pointer
         std::size_t &rsp;   ///< return stack pointer
         EXEC_RESULT state;  ///< what we're doing
+        EXEC_MODE mode;     ///< which loop runs unproven code
+        std::size_t budget; ///< what's left of execute()'s budget, or UNLIMITED
+
+        static const std::size_t UNLIMITED=~std::size_t(0);
+
+        static const std::size_t OUTBUFSZ=128;
+        char outbuf[OUTBUFSZ];  ///< output not yet flushed
+        std::size_t outlen;
         
         fith_cell *dstk;
         fith_cell *rstk;
@@ -314,12 +780,12 @@ public:
         Interpreter &interp;
 
 #ifdef FULLFITH
-        typedef std::stack<std::istream *> iostack_t;
+        typedef std::stack<Source *> iostack_t;
 
-        std::istream *is;
+        Source *is;         ///< input for WORD, KEY and EOF
         std::ostream *os;
 
-        /// stack of input-streams being processed by nested INCLUDE
+        /// stack of inputs being processed by nested INCLUDE
         iostack_t iostack;
 #endif
     };
@@ -358,11 +824,24 @@ public:
      * lookup a dictionary entry
      * @return -1 on failure, else the stored word
      */
-    fith_cell find(const std::string &name) const;
+    fith_cell find(const char *name) const;
+
+    /**
+     * Write the compiler's state, i.e. the dictionary (with flags), the
+     * latest word and the compile state, as text.  With the code and data
+     * spaces, that's a bootstrap snapshot.
+     */
+    void snapshot(std::ostream &os) const;
+
+    /**
+     * Replace the compiler's state with one written by snapshot(); the
+     * code and data spaces must be restored to match.
+     * @return false, and nothing changed, if it's malformed
+     */
+    bool restore(std::istream &is);
 
     /**
      * Reverse lookup; get word name from cell value
-     * @todo: not linear time
      */
     const char *reverse_find(fith_cell value) const;
 
@@ -371,6 +850,27 @@ public:
      * get name of latest-created word
      */
     const std::string &latest() const;
+
+    /**
+     * Number of scalar cells following the opcode at addr, i.e. operands
+     * that are not code pointers and must not be relocated.
+     * @param len cells remaining from addr to the end of its function
+     */
+    fith_cell scalars(fith_cell addr, fith_cell len) const;
+
+    /// names of the handlers in Context::builtin, for generating minimal runtimes
+    static const std::string handlers[MW_INTERP_COUNT];
+
+    /**
+     * Peephole pass: rewrite common opcode sequences within one function
+     * as superinstructions, in place.  Branches and code-literals that
+     * point within the function are relocated; no sequence is fused across
+     * a branch target.
+     * @param start address of the function
+     * @param len number of cells in the function
+     * @return new number of cells, <= len
+     */
+    fith_cell fuse(fith_cell start, fith_cell len);
     
 #endif
 
@@ -378,16 +878,77 @@ public:
      * Provide syscall implementation
      */
     void setSyscalls(SysCalls *sc);
+
+    /**
+     * Provide the results of load-time verification.
+     * @param p array of proofs sorted by address, must outlive the interpreter; NULL for none
+     * @param n number of proofs
+     */
+    void setProofs(const Proof *p, std::size_t n);
+
+    /**
+     * May a thread starting at ip (with an empty return stack) run unchecked?
+     */
+    bool proven(std::size_t ip, std::size_t dsp, std::size_t dsz, std::size_t rsz) const;
+
+    /**
+     * The proof of the function at ip, or NULL.
+     */
+    const Proof *proof(std::size_t ip) const;
+
+    /**
+     * Translate the binary into pre-decoded form, which the fast loop then
+     * runs from.  Kept up to date as code is compiled or modified.
+     * @param d array of binsz records, must outlive the interpreter; NULL to stop using it
+     */
+    void setDecoded(Decoded *d);
+
+    /**
+     * CRC of the code space in use, i.e. cells [0, HERE).
+     */
+    unsigned crc() const;
+
+    /**
+     * Provide native translations of functions in the binary.  A thread
+     * entering one of them with an empty return stack then runs it natively.
+     * @param t table, must outlive the interpreter; NULL for none
+     * @return false (and not used) if t was generated from different code
+     */
+    bool setNative(const NativeTable *t);
+
+    /**
+     * Provide a run-time compiler, consulted after any NativeTable.
+     * @param c compiler, must outlive the interpreter; NULL for none
+     */
+    void setCompiler(Compiler *c);
+
+    /**
+     * Native code for the function at ip, or NULL.
+     */
+    native_t native(std::size_t ip) const;
     
 private:
+
+    /// bring the pre-decoded records for cells [from, to) up to date
+    void redecode(fith_cell from, fith_cell to);
+    /// pre-decode one cell
+    void decode_cell(fith_cell i);
+    /// code space has been modified: stop using native code
+    void drop_native();
     
     /// get a C-string from the TOS ptr; NULL if invalid
     const char *get_string(fith_cell ptr);
 
-    fith_cell *bin;
+    code_t *bin;
     fith_cell *heap;
     std::size_t binsz, heapsz;
     SysCalls *syscalls;
+    const Proof *proofs;
+    std::size_t nproofs;
+    fith_cell proofhere;    ///< extent of code covered by proofs
+    Decoded *decoded;       ///< pre-decoded copy of bin, or NULL
+    const NativeTable *natives;
+    Compiler *compiler;
 
     // we encode flags in the top three bits,
     // which means we have only 29-bit (*4 byte) = 2GB usable address space.
@@ -408,10 +969,59 @@ private:
      */
     void bootstrap(bool full=true);
 
-    typedef std::map<std::string, fith_cell> dict_t;
+    /**
+     * The names of words and opcodes.  Each name is interned once, found
+     * by hashing rather than by string-compares down a tree, and keeps its
+     * place when redefined; iteration is in order of first definition.
+     * The words (not opcodes) are also indexed by address for reverse
+     * lookups, the index being rebuilt on first use after a definition.
+     */
+    class Dictionary {
+    public:
+        struct Symbol {
+            std::string name;
+            fith_cell value;    ///< address or opcode, with flags
+            unsigned hash;
+        };
+        typedef std::vector<Symbol>::const_iterator const_iterator;
+        /// address (without flags) and symbol number of a word
+        typedef std::pair<fith_cell, std::size_t> Entry;
+
+        Dictionary();
+
+        /// @return the value of name, or -1
+        fith_cell find(const char *name) const;
+        /// define or redefine name
+        void set(const std::string &name, fith_cell value);
+        /// toggle IMMEDIATE/HIDE flags of name, if defined
+        void flip(const char *name, fith_cell flags);
+
+        void clear();
+        void swap(Dictionary &other);
+        std::size_t size() const { return symbols.size(); }
+        const_iterator begin() const { return symbols.begin(); }
+        const_iterator end() const { return symbols.end(); }
+        const std::string &name(std::size_t sym) const { return symbols[sym].name; }
+
+        /// the words by address, several at one address sorted by name
+        const std::vector<Entry> &byAddress() const;
+        /// @return name of the (first) word at addr, or NULL
+        const char *at(fith_cell addr) const;
+
+    private:
+        class ByAddress;
+        static bool before(const Entry &e, fith_cell addr);
+        static unsigned hashOf(const char *name);
+        /// table slot holding name, else the empty slot where it would go
+        std::size_t slot(const char *name, unsigned h) const;
+
+        std::vector<Symbol> symbols;
+        std::vector<int> table;     ///< open-addressed, power-of-2 size: symbol number or -1
+        mutable std::vector<Entry> index;
+        mutable bool stale;         ///< index needs rebuilding
+    };
+
     typedef std::map<fith_cell, std::string> revdict_t;
-    typedef dict_t::iterator di;
-    typedef dict_t::const_iterator dci;
     typedef revdict_t::iterator rdi;
     typedef revdict_t::const_iterator rdci;
 
@@ -421,6 +1031,19 @@ private:
      * @param addronly erase flag bits to leave pure addresses
      */
     revdict_t invert_dict(bool builtins=false, bool addronly=true) const;
+
+    /**
+     * Would a cell compiled now start an instruction of the latest word,
+     * rather than be an operand of one?
+     */
+    bool instruction_due() const;
+
+    /**
+     * Return-stack cells the word being compiled has at this point, i.e.
+     * its locals and the loops it's in, as bootstrap.5th counts them in
+     * _RSDEPTH; at least the number of locals.
+     */
+    fith_cell rsdepth() const;
         
     /// machine-word (opcode) names
     static const std::string opcodes[MW_INTERP_COUNT];
@@ -428,7 +1051,9 @@ private:
     static const std::string states[EX_INTERP_COUNT];
     
     std::string latestword;
-    dict_t dictionary;
+    Dictionary dictionary;
+    /// locals of the word being compiled, in frame order, and the word INTERPRET runs for each
+    std::vector<std::pair<std::string, fith_cell> > locals;
     bool compilestate;
     fith_cell gcroot;
 #endif
@@ -0,0 +1,1122 @@
+/** -*- C++ -*- */
+
+/*
+    Copyright (C) 2018 William Brodie-Tyrrell
+    william@brodie-tyrrell.org
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "fithjit.h"
+#include <cstddef>
+#include <cstring>
+#include <set>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define FITH_JIT_X86_64
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace fith {
+
+// flag bits and address mask, as per Interpreter
+static const fith_cell FLAG_MACHINE=0x80000000;
+static const fith_cell FLAG_ADDR=0x1FFFFFFF;
+
+/// address space reserved for compiled code
+static const size_t ARENASZ=16 << 20;
+
+/**
+ * Can the opcode be compiled?  As per fithaot.
+ */
+static bool supported(fith_cell op)
+{
+    switch(op){
+    case Interpreter::MW_MULDIV:
+    case Interpreter::MW_DIVMOD:
+    case Interpreter::MW_MULMOD:
+    case Interpreter::MW_CALL:
+    case Interpreter::MW_DUPNZ:
+    case Interpreter::MW_ROLL:
+    case Interpreter::MW_MOVE:
+    case Interpreter::MW_MOVEC:
+    case Interpreter::MW_FILL:
+    case Interpreter::MW_FILLC:
+    case Interpreter::MW_COMPARE:
+    case Interpreter::MW_COMPAREC:
+    case Interpreter::MW_SCAN:
+    case Interpreter::MW_SCANC:
+    case Interpreter::MW_STRLEN:
+    case Interpreter::MW_STRREAD:
+    case Interpreter::MW_STRWRITE:
+    case Interpreter::MW_STRCMP:
+    case Interpreter::MW_STRCAT:
+    case Interpreter::MW_EMIT:
+    case Interpreter::MW_TYPE:
+    case Interpreter::MW_TELL:
+    case Interpreter::MW_FLUSH:
+    case Interpreter::MW_BTST:
+    case Interpreter::MW_BSET:
+    case Interpreter::MW_BCLR:
+    case Interpreter::MW_BTGL:
+    case Interpreter::MW_BFX:
+    case Interpreter::MW_BFI:
+    case Interpreter::MW_POPCNT:
+    case Interpreter::MW_FFS:
+    case Interpreter::MW_DPLUS:
+    case Interpreter::MW_DMINUS:
+    case Interpreter::MW_MSTAR:
+    case Interpreter::MW_UMDIVMOD:
+    case Interpreter::MW_DLT:
+    case Interpreter::MW_DEQ:
+    case Interpreter::MW_QMUL:
+    case Interpreter::MW_QDIV:
+    case Interpreter::MW_SQRT:
+    case Interpreter::MW_MIN:
+    case Interpreter::MW_MAX:
+    case Interpreter::MW_CLAMP:
+    case Interpreter::MW_INTERP:
+    case Interpreter::MW_TON:
+    case Interpreter::MW_TOF:
+    case Interpreter::MW_TP:
+    case Interpreter::MW_CTU:
+    case Interpreter::MW_CTD:
+    case Interpreter::MW_RTRIG:
+    case Interpreter::MW_FTRIG:
+    case Interpreter::MW_CASE:
+        return false;
+    default:
+        // nothing from the full system
+#ifdef FULLFITH
+        return op < Interpreter::MW_STORECODE;
+#else
+        return op < Interpreter::MW_INTERP_COUNT;
+#endif
+    }
+}
+
+#ifdef FITH_JIT_X86_64
+
+/// x86-64 registers, by encoding
+enum REG { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15, NOREG=-1 };
+
+/// condition codes, for Jcc and SETcc
+enum CC { CC_B=0x2, CC_AE=0x3, CC_E=0x4, CC_NE=0x5, CC_BE=0x6, CC_A=0x7, CC_S=0x8,
+          CC_L=0xC, CC_GE=0xD, CC_LE=0xE, CC_G=0xF, CC_ALWAYS=-1 };
+
+// what lives where in compiled code; all callee-saved
+static const int R_M=RBX;       ///< Machine &
+static const int R_HEAP=RBP;    ///< m.heap
+static const int R_DSTK=R12;    ///< m.dstk
+static const int R_DSP=R13;     ///< m.dsp
+static const int R_RSTK=R14;    ///< m.rstk
+static const int R_RSP=R15;     ///< m.rsp
+
+// Machine fields
+static const int M_DSTK=offsetof(Interpreter::Machine, dstk);
+static const int M_RSTK=offsetof(Interpreter::Machine, rstk);
+static const int M_DSP=offsetof(Interpreter::Machine, dsp);
+static const int M_RSP=offsetof(Interpreter::Machine, rsp);
+static const int M_DSZ=offsetof(Interpreter::Machine, dsz);
+static const int M_RSZ=offsetof(Interpreter::Machine, rsz);
+static const int M_HEAP=offsetof(Interpreter::Machine, heap);
+static const int M_HEAPSZ=offsetof(Interpreter::Machine, heapsz);
+static const int M_IP=offsetof(Interpreter::Machine, ip);
+
+// syscalls, as per the handlers
+static fith_cell jit_syscall1(Interpreter::Machine *m, fith_cell a)
+{
+    return m->syscalls ? m->syscalls->syscall1(a) : 0;
+}
+
+static fith_cell jit_syscall2(Interpreter::Machine *m, fith_cell a, fith_cell b)
+{
+    return m->syscalls ? m->syscalls->syscall2(a, b) : 0;
+}
+
+static fith_cell jit_syscall3(Interpreter::Machine *m, fith_cell a, fith_cell b, fith_cell c)
+{
+    return m->syscalls ? m->syscalls->syscall3(a, b, c) : 0;
+}
+
+/**
+ * Generates the code for one function.
+ *
+ * The result is a native_t: it loads the stack pointers into registers,
+ * runs the function's templates, and on EXIT or any fault stores them
+ * back and returns through a common epilogue.  Faults are out-of-line
+ * stubs that set m.ip and the result.
+ */
+class Emitter {
+public:
+
+    typedef map<fith_cell, Interpreter::native_t> callee_map;
+
+    /**
+     * @param _base address the code will be installed at
+     * @param _callees compiled code for everything the function calls
+     */
+    Emitter(const fith_cell *_bin, const unsigned char *_base, const callee_map &_callees);
+
+    /// generate the function at addr
+    void function(fith_cell addr, fith_cell len);
+
+    vector<unsigned char> code;
+
+private:
+
+    /// generate one instruction, return the address of the next
+    fith_cell instruction(fith_cell at);
+
+    // raw encoding
+    void byte(unsigned b) { code.push_back(b & 0xFF); }
+    void dword(unsigned d);
+    void qword(unsigned long q);
+    void opcode(unsigned rex, unsigned op);
+    /// op reg, [b + x*scale + disp]; x may be NOREG
+    void rm(bool w, unsigned op, int reg, int b, int x, int scale, int disp);
+    /// op reg, r
+    void rr(bool w, unsigned op, int reg, int r);
+    /// jump (or Jcc) with a rel32 to be filled in; returns where it is
+    size_t jump(int cc);
+    void patch(size_t at, size_t target);
+
+    // the stacks
+    void ld_t(int reg, int n)   { rm(false, 0x8B, reg, R_DSTK, R_DSP, 4, -4*n); }
+    void st_t(int n, int reg)   { rm(false, 0x89, reg, R_DSTK, R_DSP, 4, -4*n); }
+    void ld_r(int reg, int n)   { rm(false, 0x8B, reg, R_RSTK, R_RSP, 4, -4*n); }
+    void st_r(int n, int reg)   { rm(false, 0x89, reg, R_RSTK, R_RSP, 4, -4*n); }
+    void add_sp(int r, int n);
+    void push(int reg)          { st_t(0, reg); add_sp(R_DSP, 1); }
+    void push_imm(fith_cell v);
+
+    // the interpreter's checks; at is where its ip would be
+    void fault(int cc, Interpreter::EXEC_RESULT x, fith_cell at);
+    void need(int n, fith_cell at);
+    void room(int n, fith_cell at);
+    void rneed(int n, fith_cell at);
+    void rroom(int n, fith_cell at);
+    /// rax=T(1), sign-extended and checked against the heap (in cells or bytes)
+    void heapref(bool bytes, fith_cell at);
+    /// rax=T(2)+T(1), likewise
+    void indexref(bool bytes, fith_cell at);
+    /// check rax against the heap
+    void heapcheck(bool bytes, fith_cell at);
+
+    void binop(unsigned op, fith_cell at);
+    void shift(int ext, fith_cell at);
+    void compare(int cc, fith_cell at);
+    void branch(int cc, fith_cell at);
+    void syscall(int n, fith_cell at);
+    void call(fith_cell target, fith_cell at);
+    void save();
+    void load();
+
+    typedef pair<int, fith_cell> fault_key;
+
+    const fith_cell *bin;
+    const unsigned char *base;
+    const callee_map &callees;
+    map<fith_cell, size_t> labels;                  ///< code offset of each instruction
+    vector<pair<size_t, fith_cell> > branches;      ///< jumps to instructions
+    map<fault_key, vector<size_t> > faults;         ///< jumps to fault stubs
+    vector<size_t> exits;                           ///< jumps to the epilogue
+};
+
+Emitter::Emitter(const fith_cell *_bin, const unsigned char *_base, const callee_map &_callees)
+    : bin(_bin), base(_base), callees(_callees)
+{
+}
+
+void Emitter::dword(unsigned d)
+{
+    for(int i=0;i<4;++i){
+        byte(d >> (8*i));
+    }
+}
+
+void Emitter::qword(unsigned long q)
+{
+    dword(q);
+    dword(q >> 32);
+}
+
+void Emitter::opcode(unsigned rex, unsigned op)
+{
+    if(rex != 0x40){
+        byte(rex);
+    }
+    if(op > 0xFF){
+        byte(op >> 8);
+    }
+    byte(op);
+}
+
+void Emitter::rm(bool w, unsigned op, int reg, int b, int x, int scale, int disp)
+{
+    opcode(0x40 | (w ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((x != NOREG && (x & 8)) ? 2 : 0) | ((b & 8) ? 1 : 0), op);
+
+    // [rbp] and [r13] can only be had with a displacement
+    unsigned mod=(disp == 0 && (b & 7) != RBP) ? 0 : (disp >= -128 && disp < 128) ? 1 : 2;
+    if(x == NOREG && (b & 7) != RSP){
+        byte(mod << 6 | (reg & 7) << 3 | (b & 7));
+    }
+    else{
+        unsigned ss=(scale == 8) ? 3 : (scale == 4) ? 2 : (scale == 2) ? 1 : 0;
+        byte(mod << 6 | (reg & 7) << 3 | RSP);
+        byte((x == NOREG ? RSP << 3 : (ss << 6 | (x & 7) << 3)) | (b & 7));
+    }
+    if(mod == 1){
+        byte(disp);
+    }
+    else if(mod == 2){
+        dword(disp);
+    }
+}
+
+void Emitter::rr(bool w, unsigned op, int reg, int r)
+{
+    opcode(0x40 | (w ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((r & 8) ? 1 : 0), op);
+    byte(0xC0 | (reg & 7) << 3 | (r & 7));
+}
+
+size_t Emitter::jump(int cc)
+{
+    if(cc == CC_ALWAYS){
+        byte(0xE9);
+    }
+    else{
+        byte(0x0F);
+        byte(0x80 | cc);
+    }
+    dword(0);
+    return code.size()-4;
+}
+
+void Emitter::patch(size_t at, size_t target)
+{
+    unsigned rel=target-(at+4);
+    for(int i=0;i<4;++i){
+        code[at+i]=rel >> (8*i);
+    }
+}
+
+void Emitter::add_sp(int r, int n)
+{
+    if(n == 1 || n == -1){
+        // inc/dec
+        rr(true, 0xFF, n > 0 ? 0 : 1, r);
+    }
+    else{
+        // add/sub imm8
+        rr(true, 0x83, n > 0 ? 0 : 5, r);
+        byte(n > 0 ? n : -n);
+    }
+}
+
+void Emitter::push_imm(fith_cell v)
+{
+    rm(false, 0xC7, 0, R_DSTK, R_DSP, 4, 0);
+    dword(v);
+    add_sp(R_DSP, 1);
+}
+
+void Emitter::fault(int cc, Interpreter::EXEC_RESULT x, fith_cell at)
+{
+    faults[fault_key(x, at)].push_back(jump(cc));
+}
+
+void Emitter::need(int n, fith_cell at)
+{
+    rr(true, 0x83, 7, R_DSP);
+    byte(n);
+    fault(CC_B, Interpreter::EX_DSTK_UNDER, at);
+}
+
+void Emitter::room(int n, fith_cell at)
+{
+    rm(true, 0x8D, RAX, R_DSP, NOREG, 1, n);
+    rm(true, 0x3B, RAX, R_M, NOREG, 1, M_DSZ);
+    fault(CC_A, Interpreter::EX_DSTK_OVER, at);
+}
+
+void Emitter::rneed(int n, fith_cell at)
+{
+    rr(true, 0x83, 7, R_RSP);
+    byte(n);
+    fault(CC_B, Interpreter::EX_RSTK_UNDER, at);
+}
+
+void Emitter::rroom(int n, fith_cell at)
+{
+    rm(true, 0x8D, RAX, R_RSP, NOREG, 1, n);
+    rm(true, 0x3B, RAX, R_M, NOREG, 1, M_RSZ);
+    fault(CC_A, Interpreter::EX_RSTK_OVER, at);
+}
+
+void Emitter::heapref(bool bytes, fith_cell at)
+{
+    rm(true, 0x63, RAX, R_DSTK, R_DSP, 4, -4);
+    heapcheck(bytes, at);
+}
+
+void Emitter::indexref(bool bytes, fith_cell at)
+{
+    // the sum wraps at 32 bits, as in the interpreter
+    ld_t(RAX, 1);
+    rm(false, 0x03, RAX, R_DSTK, R_DSP, 4, -8);
+    rr(true, 0x63, RAX, RAX);
+    heapcheck(bytes, at);
+}
+
+void Emitter::heapcheck(bool bytes, fith_cell at)
+{
+    if(bytes){
+        rm(true, 0x8B, RDX, R_M, NOREG, 1, M_HEAPSZ);
+        rr(true, 0xC1, 4, RDX);
+        byte(2);
+        rr(true, 0x3B, RAX, RDX);
+    }
+    else{
+        rm(true, 0x3B, RAX, R_M, NOREG, 1, M_HEAPSZ);
+    }
+    fault(CC_AE, Interpreter::EX_SEGV_DATA, at);
+}
+
+void Emitter::binop(unsigned op, fith_cell at)
+{
+    need(2, at);
+    ld_t(RAX, 1);
+    rm(false, op, RAX, R_DSTK, R_DSP, 4, -8);
+    add_sp(R_DSP, -1);
+}
+
+void Emitter::shift(int ext, fith_cell at)
+{
+    need(2, at);
+    ld_t(RCX, 1);
+    rm(false, 0xD3, ext, R_DSTK, R_DSP, 4, -8);
+    add_sp(R_DSP, -1);
+}
+
+void Emitter::compare(int cc, fith_cell at)
+{
+    need(2, at);
+    ld_t(RAX, 1);
+    rm(false, 0x39, RAX, R_DSTK, R_DSP, 4, -8);
+    rr(false, 0x0F90 | cc, 0, RAX);
+    rr(false, 0x0FB6, RAX, RAX);
+    st_t(2, RAX);
+    add_sp(R_DSP, -1);
+}
+
+void Emitter::branch(int cc, fith_cell at)
+{
+    branches.push_back(make_pair(jump(cc), at+bin[at+1]));
+}
+
+void Emitter::save()
+{
+    rm(true, 0x89, R_DSP, R_M, NOREG, 1, M_DSP);
+    rm(true, 0x89, R_RSP, R_M, NOREG, 1, M_RSP);
+}
+
+void Emitter::load()
+{
+    rm(true, 0x8B, R_DSP, R_M, NOREG, 1, M_DSP);
+    rm(true, 0x8B, R_RSP, R_M, NOREG, 1, M_RSP);
+}
+
+void Emitter::syscall(int n, fith_cell at)
+{
+    static const unsigned long fns[]={
+        0, (unsigned long) jit_syscall1, (unsigned long) jit_syscall2, (unsigned long) jit_syscall3
+    };
+
+    need(n, at);
+    add_sp(R_DSP, 1-n);
+    rr(true, 0x89, R_M, RDI);
+    ld_t(RSI, 1);
+    if(n > 1){
+        ld_t(RDX, 0);
+    }
+    if(n > 2){
+        ld_t(RCX, -1);
+    }
+    // movabs rax, fn; call rax
+    byte(0x48);
+    byte(0xB8);
+    qword(fns[n]);
+    rr(false, 0xFF, 2, RAX);
+    st_t(1, RAX);
+}
+
+void Emitter::call(fith_cell target, fith_cell at)
+{
+    rroom(1, at);
+    rm(false, 0xC7, 0, R_RSTK, R_RSP, 4, 0);
+    dword(at);
+    add_sp(R_RSP, 1);
+
+    save();
+    rr(true, 0x89, R_M, RDI);
+    byte(0xE8);
+    const unsigned char *fn=(const unsigned char *) callees.find(target)->second;
+    dword(fn-(base+code.size()+4));
+    load();
+
+    // pass on any fault
+    rr(false, 0x85, RAX, RAX);
+    exits.push_back(jump(CC_NE));
+}
+
+void Emitter::function(fith_cell addr, fith_cell len)
+{
+    // push rbx, rbp, r12-r15, keep the stack 16-byte aligned for calls
+    byte(0x53);
+    byte(0x55);
+    for(int r=R12;r<=R15;++r){
+        opcode(0x41, 0x50 | (r & 7));
+    }
+    rr(true, 0x83, 5, RSP);
+    byte(8);
+
+    rr(true, 0x89, RDI, R_M);
+    rm(true, 0x8B, R_DSTK, R_M, NOREG, 1, M_DSTK);
+    rm(true, 0x8B, R_RSTK, R_M, NOREG, 1, M_RSTK);
+    rm(true, 0x8B, R_HEAP, R_M, NOREG, 1, M_HEAP);
+    load();
+
+    for(fith_cell at=addr;at<addr+len;){
+        labels[at]=code.size();
+        at=instruction(at);
+    }
+    // the Verifier has shown that every path ends in EXIT or a jump
+    fault(CC_ALWAYS, Interpreter::EX_SEGV_CODE, addr+len);
+
+    for(size_t i=0;i<branches.size();++i){
+        patch(branches[i].first, labels[branches[i].second]);
+    }
+
+    // fault stubs: set m.ip and the result
+    for(map<fault_key, vector<size_t> >::const_iterator i=faults.begin();i!=faults.end();++i){
+        for(size_t j=0;j<i->second.size();++j){
+            patch(i->second[j], code.size());
+        }
+        rm(true, 0xC7, 0, R_M, NOREG, 1, M_IP);
+        dword(i->first.second);
+        byte(0xB8);
+        dword(i->first.first);
+        exits.push_back(jump(CC_ALWAYS));
+    }
+
+    // epilogue
+    for(size_t i=0;i<exits.size();++i){
+        patch(exits[i], code.size());
+    }
+    save();
+    rr(true, 0x83, 0, RSP);
+    byte(8);
+    for(int r=R15;r>=R12;--r){
+        opcode(0x41, 0x58 | (r & 7));
+    }
+    byte(0x5D);
+    byte(0x5B);
+    byte(0xC3);
+}
+
+fith_cell Emitter::instruction(fith_cell at)
+{
+    fith_cell cell=bin[at];
+    const fith_cell ip=at+1;    // interpreter's ip once the opcode is fetched
+
+    if((cell & FLAG_MACHINE) == 0){
+        call(cell & FLAG_ADDR, ip);
+        return ip;
+    }
+
+    cell &= FLAG_ADDR;
+    const fith_cell next=ip+Interpreter::opinfo[cell].operands;
+    const fith_cell v=(next > ip) ? bin[ip] : 0;
+
+    switch(cell){
+    case Interpreter::MW_EXIT:
+        // returning from the entry-point finishes, else back to our caller
+        rr(true, 0x85, R_RSP, R_RSP);
+        fault(CC_E, Interpreter::EX_SUCCESS, ip);
+        add_sp(R_RSP, -1);
+        rr(false, 0x31, RAX, RAX);
+        exits.push_back(jump(CC_ALWAYS));
+        break;
+    case Interpreter::MW_LIT:
+    case Interpreter::MW_TICK:
+        room(1, ip);
+        push_imm(v);
+        break;
+    case Interpreter::MW_HERE:
+        room(1, ip);
+        push_imm(0);
+        break;
+    case Interpreter::MW_PLUS:      binop(0x01, ip);        break;
+    case Interpreter::MW_MINUS:     binop(0x29, ip);        break;
+    case Interpreter::MW_AND:       binop(0x21, ip);        break;
+    case Interpreter::MW_OR:        binop(0x09, ip);        break;
+    case Interpreter::MW_XOR:       binop(0x31, ip);        break;
+    case Interpreter::MW_SL:        shift(4, ip);           break;
+    case Interpreter::MW_SRA:       shift(7, ip);           break;
+    case Interpreter::MW_LT:        compare(CC_L, ip);      break;
+    case Interpreter::MW_GT:        compare(CC_G, ip);      break;
+    case Interpreter::MW_LE:        compare(CC_LE, ip);     break;
+    case Interpreter::MW_GE:        compare(CC_GE, ip);     break;
+    case Interpreter::MW_EQ:        compare(CC_E, ip);      break;
+    case Interpreter::MW_SRL:
+        // as per the handler, which shifts a sign-extended unsigned long
+        need(2, ip);
+        ld_t(RCX, 1);
+        rm(true, 0x63, RAX, R_DSTK, R_DSP, 4, -8);
+        rr(true, 0xD3, 5, RAX);
+        st_t(2, RAX);
+        add_sp(R_DSP, -1);
+        break;
+    case Interpreter::MW_MUL:
+        need(2, ip);
+        ld_t(RAX, 1);
+        ld_t(RCX, 2);
+        rr(false, 0x0FAF, RCX, RAX);
+        st_t(2, RCX);
+        add_sp(R_DSP, -1);
+        break;
+    case Interpreter::MW_NEG:
+        need(1, ip);
+        rm(false, 0xF7, 3, R_DSTK, R_DSP, 4, -4);
+        break;
+    case Interpreter::MW_INVERT:
+        need(1, ip);
+        rm(false, 0xF7, 2, R_DSTK, R_DSP, 4, -4);
+        break;
+    case Interpreter::MW_DIV:
+    case Interpreter::MW_MOD:
+        need(2, ip);
+        ld_t(RCX, 1);
+        rr(false, 0x85, RCX, RCX);
+        fault(CC_E, Interpreter::EX_DIV_ZERO, ip);
+        ld_t(RAX, 2);
+        byte(0x99);                     // cdq
+        rr(false, 0xF7, 7, RCX);        // idiv ecx
+        st_t(2, cell == Interpreter::MW_DIV ? RAX : RDX);
+        add_sp(R_DSP, -1);
+        break;
+    case Interpreter::MW_JMP:
+        branch(CC_ALWAYS, at);
+        break;
+    case Interpreter::MW_JZ:
+        need(1, ip);
+        add_sp(R_DSP, -1);
+        ld_t(RAX, 0);
+        rr(false, 0x85, RAX, RAX);
+        branch(CC_E, at);
+        break;
+    case Interpreter::MW_DUPJZ:
+        need(1, ip);
+        ld_t(RAX, 1);
+        rr(false, 0x85, RAX, RAX);
+        branch(CC_E, at);
+        break;
+    case Interpreter::MW_DUP:
+        need(1, ip);
+        room(1, ip);
+        ld_t(RAX, 1);
+        push(RAX);
+        break;
+    case Interpreter::MW_DROP:
+        need(1, ip);
+        add_sp(R_DSP, -1);
+        break;
+    case Interpreter::MW_SWAP:
+        need(2, ip);
+        ld_t(RAX, 1);
+        ld_t(RCX, 2);
+        st_t(1, RCX);
+        st_t(2, RAX);
+        break;
+    case Interpreter::MW_ROT:
+        need(3, ip);
+        ld_t(RAX, 3);
+        ld_t(RCX, 2);
+        st_t(3, RCX);
+        ld_t(RCX, 1);
+        st_t(2, RCX);
+        st_t(1, RAX);
+        break;
+    case Interpreter::MW_NROT:
+        need(3, ip);
+        ld_t(RAX, 1);
+        ld_t(RCX, 2);
+        st_t(1, RCX);
+        ld_t(RCX, 3);
+        st_t(2, RCX);
+        st_t(3, RAX);
+        break;
+    case Interpreter::MW_PICK:
+        // index is only known at runtime: dsp >= 2, 0 <= n, n+2 <= dsp
+        rr(true, 0x83, 7, R_DSP);
+        byte(2);
+        fault(CC_B, Interpreter::EX_DSTK_UNDER, ip);
+        rm(true, 0x63, RAX, R_DSTK, R_DSP, 4, -4);
+        rr(true, 0x85, RAX, RAX);
+        fault(CC_S, Interpreter::EX_DSTK_UNDER, ip);
+        rm(true, 0x8D, RCX, RAX, NOREG, 1, 2);
+        rr(true, 0x3B, R_DSP, RCX);
+        fault(CC_B, Interpreter::EX_DSTK_UNDER, ip);
+        rr(true, 0x89, R_DSP, RCX);
+        rr(true, 0x29, RAX, RCX);
+        rm(false, 0x8B, RCX, R_DSTK, RCX, 4, -8);
+        st_t(1, RCX);
+        break;
+    case Interpreter::MW_RPICK:
+        need(1, ip);
+        rm(true, 0x63, RAX, R_DSTK, R_DSP, 4, -4);
+        rr(true, 0x85, RAX, RAX);
+        fault(CC_S, Interpreter::EX_RSTK_UNDER, ip);
+        rm(true, 0x8D, RCX, RAX, NOREG, 1, 1);
+        rr(true, 0x3B, R_RSP, RCX);
+        fault(CC_B, Interpreter::EX_RSTK_UNDER, ip);
+        rr(true, 0x89, R_RSP, RCX);
+        rr(true, 0x29, RAX, RCX);
+        rm(false, 0x8B, RCX, R_RSTK, RCX, 4, -4);
+        st_t(1, RCX);
+        break;
+    case Interpreter::MW_STORE:
+        need(2, ip);
+        heapref(false, ip);
+        ld_t(RCX, 2);
+        rm(false, 0x89, RCX, R_HEAP, RAX, 4, 0);
+        add_sp(R_DSP, -2);
+        break;
+    case Interpreter::MW_STOREC:
+        need(2, ip);
+        heapref(true, ip);
+        ld_t(RCX, 2);
+        rm(false, 0x88, RCX, R_HEAP, RAX, 1, 0);
+        add_sp(R_DSP, -2);
+        break;
+    case Interpreter::MW_READ:
+        need(1, ip);
+        heapref(false, ip);
+        rm(false, 0x8B, RAX, R_HEAP, RAX, 4, 0);
+        st_t(1, RAX);
+        break;
+    case Interpreter::MW_READC:
+        need(1, ip);
+        heapref(true, ip);
+        rm(false, 0x0FBE, RAX, R_HEAP, RAX, 1, 0);
+        st_t(1, RAX);
+        break;
+    case Interpreter::MW_READLIT:
+        room(1, ip);
+        if(v < 0){
+            fault(CC_ALWAYS, Interpreter::EX_SEGV_DATA, next);
+            break;
+        }
+        rm(true, 0x81, 7, R_M, NOREG, 1, M_HEAPSZ);
+        dword(v);
+        fault(CC_BE, Interpreter::EX_SEGV_DATA, next);
+        byte(0xB8);
+        dword(v);
+        rm(false, 0x8B, RAX, R_HEAP, RAX, 4, 0);
+        push(RAX);
+        break;
+    case Interpreter::MW_STORELIT:
+        need(1, ip);
+        if(v < 0){
+            fault(CC_ALWAYS, Interpreter::EX_SEGV_DATA, next);
+            break;
+        }
+        rm(true, 0x81, 7, R_M, NOREG, 1, M_HEAPSZ);
+        dword(v);
+        fault(CC_BE, Interpreter::EX_SEGV_DATA, next);
+        ld_t(RCX, 1);
+        byte(0xB8);
+        dword(v);
+        rm(false, 0x89, RCX, R_HEAP, RAX, 4, 0);
+        add_sp(R_DSP, -1);
+        break;
+    case Interpreter::MW_READX:
+    case Interpreter::MW_READCX:
+        need(2, ip);
+        indexref(cell == Interpreter::MW_READCX, ip);
+        if(cell == Interpreter::MW_READCX){
+            rm(false, 0x0FBE, RAX, R_HEAP, RAX, 1, 0);
+        }
+        else{
+            rm(false, 0x8B, RAX, R_HEAP, RAX, 4, 0);
+        }
+        st_t(2, RAX);
+        add_sp(R_DSP, -1);
+        break;
+    case Interpreter::MW_STOREX:
+    case Interpreter::MW_STORECX:
+        need(3, ip);
+        indexref(cell == Interpreter::MW_STORECX, ip);
+        ld_t(RCX, 3);
+        if(cell == Interpreter::MW_STORECX){
+            rm(false, 0x88, RCX, R_HEAP, RAX, 1, 0);
+        }
+        else{
+            rm(false, 0x89, RCX, R_HEAP, RAX, 4, 0);
+        }
+        add_sp(R_DSP, -3);
+        break;
+    case Interpreter::MW_READINC:
+    case Interpreter::MW_READCINC:
+        need(1, ip);
+        room(1, ip);
+        heapref(cell == Interpreter::MW_READCINC, ip);
+        if(cell == Interpreter::MW_READCINC){
+            rm(false, 0x0FBE, RCX, R_HEAP, RAX, 1, 0);
+        }
+        else{
+            rm(false, 0x8B, RCX, R_HEAP, RAX, 4, 0);
+        }
+        rm(false, 0x83, 0, R_DSTK, R_DSP, 4, -4);
+        byte(1);
+        push(RCX);
+        break;
+    case Interpreter::MW_STOREINC:
+    case Interpreter::MW_STORECINC:
+        need(2, ip);
+        heapref(cell == Interpreter::MW_STORECINC, ip);
+        ld_t(RCX, 2);
+        if(cell == Interpreter::MW_STORECINC){
+            rm(false, 0x88, RCX, R_HEAP, RAX, 1, 0);
+        }
+        else{
+            rm(false, 0x89, RCX, R_HEAP, RAX, 4, 0);
+        }
+        rr(false, 0xFF, 0, RAX);
+        st_t(2, RAX);
+        add_sp(R_DSP, -1);
+        break;
+    case Interpreter::MW_FRAME:
+        // counts are below 127 (see scan), so fit the imm8 checks
+        if(v == 0){
+            break;
+        }
+        need(v, next);
+        rroom(v, next);
+        for(fith_cell k=v;k>0;--k){
+            ld_t(RAX, k);
+            st_r(k-v, RAX);
+        }
+        add_sp(R_DSP, -v);
+        add_sp(R_RSP, v);
+        break;
+    case Interpreter::MW_UNFRAME:
+        if(v == 0){
+            break;
+        }
+        rneed(v, next);
+        add_sp(R_RSP, -v);
+        break;
+    case Interpreter::MW_LOCALGET:
+        room(1, ip);
+        rneed(v+1, next);
+        ld_r(RAX, v+1);
+        push(RAX);
+        break;
+    case Interpreter::MW_LOCALSET:
+        need(1, ip);
+        rneed(v+1, next);
+        ld_t(RAX, 1);
+        st_r(v+1, RAX);
+        add_sp(R_DSP, -1);
+        break;
+    case Interpreter::MW_PLUSLIT:
+        need(1, ip);
+        rm(false, 0x81, 0, R_DSTK, R_DSP, 4, -4);
+        dword(v);
+        break;
+    case Interpreter::MW_ANDLIT:
+        need(1, ip);
+        rm(false, 0x81, 4, R_DSTK, R_DSP, 4, -4);
+        dword(v);
+        break;
+    case Interpreter::MW_ORLIT:
+        need(1, ip);
+        rm(false, 0x81, 1, R_DSTK, R_DSP, 4, -4);
+        dword(v);
+        break;
+    case Interpreter::MW_XORLIT:
+        need(1, ip);
+        rm(false, 0x81, 6, R_DSTK, R_DSP, 4, -4);
+        dword(v);
+        break;
+    case Interpreter::MW_TORS:
+        need(1, ip);
+        rroom(1, ip);
+        ld_t(RAX, 1);
+        st_r(0, RAX);
+        add_sp(R_RSP, 1);
+        add_sp(R_DSP, -1);
+        break;
+    case Interpreter::MW_FROMRS:
+        rneed(1, ip);
+        room(1, ip);
+        add_sp(R_RSP, -1);
+        ld_r(RAX, 0);
+        push(RAX);
+        break;
+    case Interpreter::MW_CPFROMRS:
+    case Interpreter::MW_LOOPI:
+        rneed(1, ip);
+        room(1, ip);
+        ld_r(RAX, 1);
+        push(RAX);
+        break;
+    case Interpreter::MW_LOOPJ:
+        rneed(3, ip);
+        room(1, ip);
+        ld_r(RAX, 3);
+        push(RAX);
+        break;
+    case Interpreter::MW_RDROP:
+        rneed(1, ip);
+        add_sp(R_RSP, -1);
+        break;
+    case Interpreter::MW_SYSCALL1:  syscall(1, ip);     break;
+    case Interpreter::MW_SYSCALL2:  syscall(2, ip);     break;
+    case Interpreter::MW_SYSCALL3:  syscall(3, ip);     break;
+    case Interpreter::MW_FORTEST:
+        rneed(2, ip);
+        room(1, ip);
+        ld_r(RAX, 1);
+        rm(false, 0x3B, RAX, R_RSTK, R_RSP, 4, -8);
+        rr(false, 0x0F90 | CC_L, 0, RAX);
+        rr(false, 0x0FB6, RAX, RAX);
+        push(RAX);
+        break;
+    case Interpreter::MW_RPLUSLIT:
+        rneed(1, ip);
+        rm(false, 0x81, 0, R_RSTK, R_RSP, 4, -4);
+        dword(v);
+        break;
+    case Interpreter::MW_DO:
+        need(2, ip);
+        rroom(2, ip);
+        ld_t(RAX, 2);
+        st_r(0, RAX);
+        ld_t(RAX, 1);
+        st_r(-1, RAX);
+        add_sp(R_RSP, 2);
+        add_sp(R_DSP, -2);
+        ld_r(RAX, 1);
+        rm(false, 0x3B, RAX, R_RSTK, R_RSP, 4, -8);
+        branch(CC_GE, at);
+        break;
+    case Interpreter::MW_LOOP:
+        rneed(2, ip);
+        ld_r(RAX, 1);
+        rr(false, 0xFF, 0, RAX);
+        st_r(1, RAX);
+        rm(false, 0x3B, RAX, R_RSTK, R_RSP, 4, -8);
+        branch(CC_L, at);
+        break;
+    case Interpreter::MW_PLUSLOOP:
+        need(1, ip);
+        rneed(2, ip);
+        add_sp(R_DSP, -1);
+        ld_t(RAX, 0);
+        rm(false, 0x03, RAX, R_RSTK, R_RSP, 4, -4);
+        st_r(1, RAX);
+        rm(false, 0x3B, RAX, R_RSTK, R_RSP, 4, -8);
+        branch(CC_L, at);
+        break;
+    default:
+        // scan() should not have let this through
+        fault(CC_ALWAYS, Interpreter::EX_BAD_OPCODE, ip);
+        break;
+    }
+
+    return next;
+}
+
+#endif // FITH_JIT_X86_64
+
+Jit::Jit(const fith_cell *_bin, unsigned _threshold)
+    : bin(_bin), threshold(_threshold), ncompiled(0), enabled(false), arena(NULL), arenasz(0), used(0)
+{
+#ifdef FITH_JIT_X86_64
+    void *p=mmap(NULL, ARENASZ, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(p != MAP_FAILED){
+        arena=(unsigned char *) p;
+        arenasz=ARENASZ;
+        enabled=true;
+    }
+#endif
+}
+
+Jit::~Jit()
+{
+#ifdef FITH_JIT_X86_64
+    if(arena){
+        munmap(arena, arenasz);
+    }
+#endif
+}
+
+void Jit::setProofs(const Verifier &verifier)
+{
+    const Interpreter::Proof *proofs=verifier.proofs();
+    const Verifier::extent_map &ext=verifier.functions();
+
+    entries.clear();
+    for(size_t i=0;i<verifier.count();++i){
+        fith_cell addr=proofs[i].addr;
+        fith_cell len=ext.find(addr)->second;
+        if(scan(addr, len)){
+            Entry e={ len, 0, NULL, false };
+            entries[addr]=e;
+        }
+    }
+}
+
+bool Jit::scan(fith_cell addr, fith_cell len) const
+{
+    set<fith_cell> starts, targets;
+    for(fith_cell at=addr;at<addr+len;++at){
+        starts.insert(at);
+        fith_cell cell=bin[at];
+        if((cell & FLAG_MACHINE) == 0){
+            continue;
+        }
+        cell &= FLAG_ADDR;
+        if(!supported(cell) || at+Interpreter::opinfo[cell].operands >= addr+len){
+            return false;
+        }
+        if((Interpreter::opinfo[cell].flags & (Interpreter::OPF_COUNT | Interpreter::OPF_RINDEX)) != 0 && (bin[at+1] < 0 || bin[at+1] >= 127)){
+            // the emitter checks counts as signed bytes
+            return false;
+        }
+        if((Interpreter::opinfo[cell].flags & Interpreter::OPF_BRANCH) != 0){
+            targets.insert(at+bin[at+1]);
+        }
+        at+=Interpreter::opinfo[cell].operands;
+    }
+
+    // every branch, even in dead code, must land on an instruction here
+    for(set<fith_cell>::const_iterator i=targets.begin();i!=targets.end();++i){
+        if(starts.count(*i) == 0){
+            return false;
+        }
+    }
+    return true;
+}
+
+Interpreter::native_t Jit::enter(size_t ip)
+{
+    if(!enabled){
+        return NULL;
+    }
+    entry_map::iterator it=entries.find(ip);
+    if(it == entries.end()){
+        return NULL;
+    }
+
+    Entry &e=it->second;
+    if(e.fn || e.failed || ++e.count < threshold){
+        return e.fn;
+    }
+    return compile(ip);
+}
+
+void Jit::invalidate()
+{
+    // functions and proofs are both out of date; interpret from now on
+    entries.clear();
+    enabled=false;
+}
+
+size_t Jit::compiled() const
+{
+    return ncompiled;
+}
+
+Interpreter::native_t Jit::compile(fith_cell addr)
+{
+#ifdef FITH_JIT_X86_64
+    entry_map::iterator it=entries.find(addr);
+    if(it == entries.end()){
+        return NULL;
+    }
+    Entry &e=it->second;
+    if(e.fn || e.failed){
+        return e.fn;
+    }
+
+    // callees first, so we know where they are; proven code doesn't recurse,
+    // but don't rely on it
+    e.failed=true;
+    Emitter::callee_map callees;
+    for(fith_cell at=addr;at<addr+e.len;++at){
+        fith_cell cell=bin[at];
+        if((cell & FLAG_MACHINE) == 0){
+            fith_cell target=cell & FLAG_ADDR;
+            Interpreter::native_t fn=compile(target);
+            if(!fn){
+                return NULL;
+            }
+            callees[target]=fn;
+        }
+        else{
+            at+=Interpreter::opinfo[cell & FLAG_ADDR].operands;
+        }
+    }
+
+    Emitter em(bin, arena+used, callees);
+    em.function(addr, e.len);
+    e.fn=install(em.code);
+    e.failed=(e.fn == NULL);
+    if(e.fn){
+        ++ncompiled;
+    }
+    return e.fn;
+#else
+    return NULL;
+#endif
+}
+
+Interpreter::native_t Jit::install(const vector<unsigned char> &code)
+{
+#ifdef FITH_JIT_X86_64
+    // whole pages, so nothing already running is ever writable
+    size_t page=sysconf(_SC_PAGESIZE);
+    size_t len=(code.size()+page-1)/page*page;
+    if(used+len > arenasz){
+        return NULL;
+    }
+
+    unsigned char *p=arena+used;
+    memcpy(p, &code[0], code.size());
+    if(mprotect(p, len, PROT_READ | PROT_EXEC) != 0){
+        return NULL;
+    }
+    used+=len;
+    return (Interpreter::native_t) p;
+#else
+    return NULL;
+#endif
+}
+
+} // namespace fith
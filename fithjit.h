@@ -0,0 +1,108 @@
+/** -*- C++ -*- */
+
+/*
+    Copyright (C) 2018 William Brodie-Tyrrell
+    william@brodie-tyrrell.org
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _FITHJIT_H_
+#define _FITHJIT_H_
+
+#include <map>
+#include <vector>
+#include "fithi.h"
+#include "fithverify.h"
+
+namespace fith {
+
+/**
+ * Template JIT for x86-64 Linux hosts.
+ *
+ * Counts the entries the interpreter offers it (see Interpreter::Compiler)
+ * and, once a function has been entered threshold times, compiles it and
+ * everything it calls to host code, one fixed template per opcode.  The
+ * same functions qualify as for fithaot: proven by the Verifier, using
+ * only the simpler opcodes, calling only functions that qualify.
+ *
+ * Compiled code keeps the data and return stack pointers in registers and
+ * makes every check the interpreter does, inline, in the same order.  On
+ * a fault it stores them back along with the ip the interpreter would
+ * have stopped at, and returns the same EXEC_RESULT, so the Context is
+ * left exactly as if the function had been interpreted; none of this is
+ * visible to Fith code.
+ *
+ * Elsewhere, or if code space changes (C!, GC, FUSE), it compiles nothing
+ * and everything is interpreted as before.
+ */
+class Jit : public Interpreter::Compiler {
+public:
+
+    /// default number of entries before a function is compiled
+    static const unsigned THRESHOLD=16;
+
+    /**
+     * @param _bin code space
+     * @param _threshold entries before compiling; 1 to compile on first entry
+     */
+    explicit Jit(const fith_cell *_bin, unsigned _threshold=THRESHOLD);
+    virtual ~Jit();
+
+    /**
+     * Take the results of load-time verification: only proven functions
+     * are compiled, so nothing is until this is called.
+     * @param verifier having verified bin
+     */
+    void setProofs(const Verifier &verifier);
+
+    virtual Interpreter::native_t enter(std::size_t ip);
+    virtual void invalidate();
+
+    /// number of functions compiled so far
+    std::size_t compiled() const;
+
+private:
+
+    /// what we know about one function that qualifies
+    struct Entry {
+        fith_cell len;
+        unsigned count;             ///< entries so far
+        Interpreter::native_t fn;   ///< compiled code, or NULL
+        bool failed;                ///< can't be compiled
+    };
+
+    typedef std::map<fith_cell, Entry> entry_map;
+
+    /// does the function at addr use only what we can compile?
+    bool scan(fith_cell addr, fith_cell len) const;
+
+    /// compile a function and everything it calls; NULL if not possible
+    Interpreter::native_t compile(fith_cell addr);
+
+    /// copy generated code into the executable arena
+    Interpreter::native_t install(const std::vector<unsigned char> &code);
+
+    const fith_cell *bin;
+    unsigned threshold;
+    entry_map entries;
+    std::size_t ncompiled;
+    bool enabled;
+
+    unsigned char *arena;   ///< executable memory, or NULL
+    std::size_t arenasz;
+    std::size_t used;       ///< bytes of arena in use, a multiple of the page size
+};
+
+} // namespace fith
+
+#endif // _FITHJIT_H_
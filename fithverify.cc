@@ -0,0 +1,291 @@
+/** -*- C++ -*- */
+
+/*
+    Copyright (C) 2018 William Brodie-Tyrrell
+    william@brodie-tyrrell.org
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "fithverify.h"
+
+using namespace std;
+
+namespace fith {
+
+// flag bits and address mask, as per Interpreter
+static const fith_cell FLAG_MACHINE=0x80000000;
+static const fith_cell FLAG_ADDR=0x1FFFFFFF;
+
+Verifier::Verifier(const fith_cell *_bin)
+    : bin(_bin)
+{
+}
+
+bool Verifier::extents(const set<fith_cell> &starts, fith_cell here, extent_map &ext)
+{
+    typedef set<fith_cell>::const_iterator csci;
+
+    ext.clear();
+    for(csci i=starts.begin();i!=starts.end();++i){
+        csci j=i;  ++j;
+        if(j == starts.end()){
+            // last thing: goes to HERE
+            ext[*i]=here - *i;
+        }
+        else{
+            // len = next - current
+            ext[*i]=*j - *i;
+        }
+
+        if(*i < 1 || ext[*i] <= 0){
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t Verifier::verify(fith_cell entry)
+{
+    fith_cell here=bin[0];
+    set<fith_cell> starts;
+
+    starts.insert(entry & FLAG_ADDR);
+
+    // every call target and code-literal starts a function,
+    // as per Interpreter::invert_dict
+    for(fith_cell i=1;i<here;++i){
+        fith_cell cell=bin[i];
+        if((cell & FLAG_MACHINE) == 0){
+            starts.insert(cell & FLAG_ADDR);
+            continue;
+        }
+
+        cell &= FLAG_ADDR;
+        if(cell == Interpreter::MW_TICK && i+1 < here){
+            // code-literal, unless it's an opcode
+            if((bin[++i] & FLAG_MACHINE) == 0){
+                starts.insert(bin[i] & FLAG_ADDR);
+            }
+        }
+        else if(cell < Interpreter::MW_INTERP_COUNT){
+            // skip following scalars
+            i+=Interpreter::operands(bin+i, here-i);
+        }
+    }
+
+    info.clear();
+    result.clear();
+    if(!extents(starts, here, ext)){
+        return 0;
+    }
+
+    for(extent_map::const_iterator i=ext.begin();i!=ext.end();++i){
+        if(analyse(i->first)){
+            result.push_back(info[i->first].proof);
+        }
+    }
+
+    return result.size();
+}
+
+const Interpreter::Proof *Verifier::proofs() const
+{
+    return result.empty() ? NULL : &result[0];
+}
+
+size_t Verifier::count() const
+{
+    return result.size();
+}
+
+/// stack depths on entry to an instruction, relative to entry to its function
+struct Depth {
+    bool seen;
+    fith_cell d, r;
+};
+
+/**
+ * Reach instruction pc with the given depths.
+ * @return false if pc is outside the function or was already reached with other depths
+ */
+static bool reach(vector<Depth> &at, vector<fith_cell> &todo, fith_cell pc, fith_cell d, fith_cell r)
+{
+    if(pc < 0 || size_t(pc) >= at.size()){
+        // leaves the function other than by EXIT
+        return false;
+    }
+    Depth &x=at[pc];
+    if(!x.seen){
+        x.seen=true;
+        x.d=d;
+        x.r=r;
+        todo.push_back(pc);
+        return true;
+    }
+    return x.d == d && x.r == r;
+}
+
+bool Verifier::analyse(fith_cell addr)
+{
+    info_map::iterator it=info.find(addr);
+    if(it != info.end()){
+        // already done, or recursion
+        return it->second.status == PROVEN;
+    }
+
+    Info &fn=info[addr];
+    extent_map::const_iterator e=ext.find(addr);
+    if(e == ext.end()){
+        // not a function start
+        fn.status=FAILED;
+        return false;
+    }
+    fn.status=BUSY;
+
+    const fith_cell len=e->second;
+    Depth unseen={ false, 0, 0 };
+    vector<Depth> at(len, unseen);
+    vector<fith_cell> todo;
+
+    fith_cell need=0, grow=0, rgrow=0, delta=0, cost=0;
+    bool returns=false, ok=true;
+
+    reach(at, todo, 0, 0, 0);
+
+    while(ok && !todo.empty()){
+        fith_cell pc=todo.back();
+        todo.pop_back();
+
+        fith_cell d=at[pc].d, r=at[pc].r;
+        fith_cell cell=bin[addr+pc];
+        fith_cell next=pc+1;
+        bool falls=true, branches=false;
+
+        if((cell & FLAG_MACHINE) != 0){
+            cell &= FLAG_ADDR;
+            if(cell >= Interpreter::MW_INTERP_COUNT){
+                ok=false;
+                break;
+            }
+
+            const Interpreter::OpInfo oi=Interpreter::effect(bin+addr+pc, len-pc);
+            if((oi.flags & Interpreter::OPF_UNSAFE) != 0 || r < oi.rin){
+                ok=false;
+                break;
+            }
+
+            next+=Interpreter::operands(bin+addr+pc, len-pc);
+            if(next > len){
+                // operands trail off the end of the function
+                ok=false;
+                break;
+            }
+
+            if(need < oi.din-d){
+                need=oi.din-d;
+            }
+            d+=oi.dout-oi.din;
+            r+=oi.rout-oi.rin;
+
+            if((oi.flags & Interpreter::OPF_EXIT) != 0){
+                // must have put back anything stashed on the return stack,
+                // and every exit must leave the same depth
+                if(r != 0 || (returns && d != delta)){
+                    ok=false;
+                    break;
+                }
+                returns=true;
+                delta=d;
+                falls=false;
+            }
+            branches=(oi.flags & Interpreter::OPF_BRANCH) != 0;
+            if((oi.flags & Interpreter::OPF_JUMP) != 0){
+                falls=false;
+            }
+            if((oi.flags & Interpreter::OPF_TABLE) != 0){
+                // the default and every entry, with the selector gone
+                for(fith_cell k=pc+2;k<next;++k){
+                    if(!reach(at, todo, pc+bin[addr+k], d, r)){
+                        ok=false;
+                    }
+                    if(bin[addr+k] <= 0){
+                        cost=-1;
+                    }
+                }
+            }
+        }
+        else{
+            // call, which must be to a proven function
+            fith_cell callee=cell & FLAG_ADDR;
+            if(!analyse(callee)){
+                ok=false;
+                break;
+            }
+            const Info &ci=info[callee];
+            if(need < ci.proof.need-d){
+                need=ci.proof.need-d;
+            }
+            if(grow < d+ci.proof.grow){
+                grow=d+ci.proof.grow;
+            }
+            if(rgrow < r+1+ci.proof.rgrow){
+                rgrow=r+1+ci.proof.rgrow;
+            }
+            d+=ci.delta;
+
+            // each instruction runs at most once unless something loops,
+            // so the calls' costs add up
+            if(cost >= 0){
+                cost=(ci.proof.cost < 0 || cost+1+ci.proof.cost > COST_MAX) ? -1 : cost+1+ci.proof.cost;
+            }
+        }
+
+        if(grow < d){
+            grow=d;
+        }
+        if(rgrow < r){
+            rgrow=r;
+        }
+
+        // successors must agree with any depths they were already reached with
+        if(falls && !reach(at, todo, next, d, r)){
+            ok=false;
+        }
+        if(branches){
+            if(!reach(at, todo, pc+bin[addr+pc+1], d, r)){
+                ok=false;
+            }
+            if(bin[addr+pc+1] <= 0){
+                // backward, i.e. a loop
+                cost=-1;
+            }
+        }
+    }
+
+    if(!ok){
+        fn.status=FAILED;
+        return false;
+    }
+
+    // a function that never returns has no net effect on its callers
+    fn.status=PROVEN;
+    fn.delta=returns ? delta : 0;
+    fn.proof.addr=addr;
+    fn.proof.need=need;
+    fn.proof.grow=grow;
+    fn.proof.rgrow=rgrow;
+    fn.proof.cost=cost;
+    return true;
+}
+
+} // namespace fith
@@ -0,0 +1,99 @@
+/** -*- C++ -*- */
+
+/*
+    Copyright (C) 2018 William Brodie-Tyrrell
+    william@brodie-tyrrell.org
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _FITHVERIFY_H_
+#define _FITHVERIFY_H_
+
+#include <map>
+#include <set>
+#include <vector>
+#include "fithi.h"
+
+namespace fith {
+
+/**
+ * Load-time verifier for a saved binary.
+ *
+ * Splits the code space into functions (the same way as the GC does),
+ * then abstract-interprets the stack depths of each one.  A function is
+ * proven if every path through it has a fixed data/return stack depth at
+ * each instruction, all of its branches and operands stay inside it and
+ * everything it calls is also proven; recursion, EXECUTE and self-modifying
+ * code are never proven.  The results are handed to the Interpreter, which
+ * then runs proven entry-points without stack and IP checks.
+ */
+class Verifier {
+public:
+
+    typedef std::map<fith_cell, fith_cell> extent_map;
+
+    /**
+     * @param bin code space, first cell is the number of cells in use
+     */
+    explicit Verifier(const fith_cell *_bin);
+
+    /**
+     * Find and analyse all the functions in the binary.
+     * @param entry program entry-point, which is always a function start
+     * @return number of functions proven
+     */
+    std::size_t verify(fith_cell entry);
+
+    /// the proofs, sorted by address, for Interpreter::setProofs
+    const Interpreter::Proof *proofs() const;
+    /// number of proofs
+    std::size_t count() const;
+
+    /// extent of every function found by verify(), proven or not
+    const extent_map &functions() const { return ext; }
+
+    /**
+     * Compute the size of each function, assuming each start-address
+     * begins a whole function that ends at the next one (or at here).
+     * @return false if the starts are not all within [1, here)
+     */
+    static bool extents(const std::set<fith_cell> &starts, fith_cell here, extent_map &ext);
+
+private:
+
+    enum STATUS { BUSY, PROVEN, FAILED };
+
+    /// costs above this are as good as unbounded
+    static const fith_cell COST_MAX=0x100000;
+
+    /// what we know about one function
+    struct Info {
+        STATUS status;
+        Interpreter::Proof proof;
+        fith_cell delta;    ///< net data-stack effect
+    };
+
+    typedef std::map<fith_cell, Info> info_map;
+
+    /// prove one function, and everything it calls
+    bool analyse(fith_cell addr);
+
+    const fith_cell *bin;
+    extent_map ext;
+    info_map info;
+    std::vector<Interpreter::Proof> result;
+};
+
+} // namespace fith
+
+#endif // _FITHVERIFY_H_
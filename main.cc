@@ -2,41 +2,182 @@
 
 #include "fithi.h"
 #include "fithfile.h"
+#include "fithverify.h"
+#ifdef FITH_JIT
+#include "fithjit.h"
+#endif
 #include <cstdlib>
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <sstream>
 #include <stdexcept>
+#include <vector>
+#include <cstdio>
+#include <sys/time.h>
+#include <unistd.h>
 
 using namespace fith;
 using namespace std;
 
+const size_t STKSZ=128;
+#ifdef FITH_MINIMAL
+// program and handler table come from the runtime generated by fithgen
+extern const fith_cell fithtext[];
+extern const size_t fithtextsz;
+extern fith_cell fithdata[];
+extern const size_t fithdatasz;
+extern const fith_cell fithmain;
+#else
 const size_t BINSZ=65536;
 const size_t HEAPSZ=128;
-const size_t STKSZ=128;
 fith_cell bin[BINSZ];
+Interpreter::Decoded decoded[BINSZ];
 fith_cell heap[HEAPSZ];
+#endif
+#ifdef FITH_NATIVE
+// proven words of the binary, translated by fithaot
+extern const Interpreter::NativeTable fithnative;
+#endif
 fith_cell dstk[STKSZ], cstk[STKSZ];
 size_t dsp=0, csp=0;
 
 #ifdef FULLFITH
 
 const string BOOTSTRAP_5TH="bootstrap.5th";
+/// the state bootstrap.5th leaves behind, so we needn't interpret it every time
+const string BOOTSTRAP_SNAP="bootstrap.fith";
+
+/// CRC of a string, zero-padded to whole words
+static unsigned text_crc(const string &text)
+{
+    vector<unsigned> words((text.length()+3)/4, 0);
+    if(!words.empty()){
+        memcpy(&words[0], text.data(), text.length());
+    }
+    CRC32STM c;
+    c.insert(text.length());
+    c.insert(words.empty() ? NULL : &words[0], words.size());
+    return c.remainder();
+}
+
+/**
+ * What a snapshot was made from: the bootstrap source, and the state the
+ * interpreter itself set up before running it -- the binary format, the
+ * heap it reserves, the code it assembled and the dictionary, whose
+ * values carry each builtin's opcode number and flags.
+ */
+static string snapshot_key(const string &text, const Interpreter &interp)
+{
+    ostringstream dict;
+    interp.snapshot(dict);
+
+    ostringstream oss;
+    oss << hex << text_crc(text) << " " << Interpreter::BINVERSION
+        << " " << unsigned(Interpreter::HEAPUSED) << " " << interp.crc()
+        << " " << text_crc(dict.str());
+    return oss.str();
+}
+
+/**
+ * Restore the snapshot, if there is one made from key.
+ * @return true if it was; else nothing has changed
+ */
+static bool load_snapshot(Interpreter &interp, const string &key)
+{
+    FithImage img;
+    try{
+        img.read(BOOTSTRAP_SNAP);
+    }
+    catch(runtime_error &e){
+        // missing, or from an older fithi
+        return false;
+    }
+
+    istringstream iss(img.snapshot);
+    string k;
+    size_t len;
+    if(!getline(iss, k) || k != key || !(iss >> len) || iss.get() != '\n'){
+        return false;
+    }
+    string banner(len, '\0');
+    if(len > 0 && !iss.read(&banner[0], len)){
+        return false;
+    }
+    if(img.text.size() > BINSZ || img.data.size() > HEAPSZ || !interp.restore(iss)){
+        return false;
+    }
+
+    memcpy(bin, &img.text[0], img.text.size()*sizeof(fith_cell));
+    memcpy(heap, &img.data[0], img.data.size()*sizeof(fith_cell));
+    interp.setDecoded(decoded);
+    cout << banner;
+    return true;
+}
+
+/**
+ * Snapshot the freshly bootstrapped interpreter, quietly giving up if
+ * we can't (e.g. a read-only directory).
+ */
+static void save_snapshot(Interpreter &interp, const string &key, const string &banner)
+{
+    ostringstream state;
+    state << key << endl << banner.length() << endl << banner;
+    interp.snapshot(state);
+
+    // written aside and renamed into place, as another fithi may be reading it
+    ostringstream tmp;
+    tmp << BOOTSTRAP_SNAP << "." << getpid();
+    ofstream ofs(tmp.str().c_str(), ios::out | ios::trunc | ios::binary);
+    if(!ofs){
+        return;
+    }
+    try{
+        FithOutFile fof(ofs, 5, Interpreter::BINVERSION, Interpreter::IOVERSION);
+        fof.writeText(bin);
+        fof.writeData(heap);
+        fof.writeEntry(interp.find("QUIT"));
+        fof.writeSnapshot(state.str());
+        fof.writeCrc();
+        ofs.close();
+        if(ofs && rename(tmp.str().c_str(), BOOTSTRAP_SNAP.c_str()) == 0){
+            return;
+        }
+    }
+    catch(range_error &e){
+    }
+    remove(tmp.str().c_str());
+}
 
 void bootstrap(Interpreter &interp)
 {
     ifstream ifs(BOOTSTRAP_5TH.c_str(), ios::in);
 
     if(ifs){
-        // create thread
+        ostringstream text;
+        text << ifs.rdbuf();
+        ifs.close();
+
+        const string key=snapshot_key(text.str(), interp);
+        if(load_snapshot(interp, key)){
+            return;
+        }
+
+        // create thread, keeping what it prints for the snapshot
+        istringstream iss(text.str());
+        ostringstream banner;
+        streambuf *out=cout.rdbuf(banner.rdbuf());
         Interpreter::Context ctx(interp.find("QUIT"), &dstk[0], &cstk[0], dsp, csp,
                                  STKSZ, STKSZ, interp,
-                                 &ifs, &cout);
+                                 &iss, &cout);
 
         Interpreter::EXEC_RESULT res=ctx.execute();
-        ifs.close();
+        cout.rdbuf(out);
+        cout << banner.str();
         if(res == Interpreter::EX_SUCCESS){
+            if(dsp == 0 && csp == 0){
+                save_snapshot(interp, key, banner.str());
+            }
         }
         else{
             cerr << "bootstrap failed" << endl;
@@ -57,6 +198,11 @@ void bootstrap(Interpreter &interp)
  */
 class IOSC : public SysCalls {
 public:
+    IOSC()
+    {
+        gettimeofday(&t_boot, NULL);
+    }
+
     virtual fith_cell syscall1(fith_cell a)
     {
         char x;
@@ -89,8 +235,45 @@ public:
         return 0;
     }
 
+    /// EMIT, TYPE and TELL, a buffer at a time
+    virtual void write(const char *buf, size_t len)
+    {
+        cout.write(buf, len);
+    }
+
+    /// for the timer function blocks
+    virtual fith_cell msboot()
+    {
+        struct timeval now, dt;
+        gettimeofday(&now, NULL);
+        timersub(&now, &t_boot, &dt);
+        return 1000*dt.tv_sec+dt.tv_usec/1000;
+    }
+
+private:
+    struct timeval t_boot;
 };
 
+#ifdef FITH_MINIMAL
+
+int main(int argc, char *argv[])
+{
+    Interpreter interp(fithtext, fithtextsz, fithdata, fithdatasz, false);
+    IOSC iosc;
+
+    interp.setSyscalls(&iosc);
+
+    Interpreter::Context ctx(fithmain, &dstk[0], &cstk[0], dsp, csp,
+                             STKSZ, STKSZ, interp);
+    Interpreter::EXEC_RESULT res=ctx.execute();
+    if(res != Interpreter::EX_SUCCESS){
+        cerr << endl << "Failed, status=" << res << endl;
+    }
+    return 0;
+}
+
+#else
+
 /**
  * Callback-handler for loading a file
  */
@@ -263,10 +446,31 @@ int main(int argc, char *argv[])
     
     // create interpreter
     Interpreter interp(bin, BINSZ, heap, HEAPSZ, bs);
+    Verifier verifier(bin);
     IOSC iosc;
+#ifdef FITH_JIT
+    // a one-shot program's entry-point is as hot as it gets
+    Jit jit(bin, 1);
+#endif
     Interpreter::EXEC_RESULT res;
 
     interp.setSyscalls(&iosc);
+    interp.setDecoded(decoded);
+
+    if(!bs){
+        // prove what we can of the loaded binary, so it can run unchecked
+        verifier.verify(entptr);
+        interp.setProofs(verifier.proofs(), verifier.count());
+#ifdef FITH_JIT
+        jit.setProofs(verifier);
+        interp.setCompiler(&jit);
+#endif
+#ifdef FITH_NATIVE
+        if(!interp.setNative(&fithnative)){
+            cerr << "native code does not match binary, interpreting" << endl;
+        }
+#endif
+    }
     
 #ifdef FULLFITH
     if(bs){
@@ -294,3 +498,5 @@ int main(int argc, char *argv[])
     }
     return 0;
 }
+
+#endif // FITH_MINIMAL
@@ -2,15 +2,24 @@
 
 #include "fithi.h"
 #include "fithfile.h"
+#include "fithverify.h"
+#ifdef FITH_JIT
+#include "fithjit.h"
+#endif
 #include <cstdlib>
+#include <cerrno>
 #include <iostream>
 #include <iomanip>
 #include <fstream>
 #include <string>
 #include <sstream>
 #include <stdexcept>
+#include <map>
+#include <vector>
 #include <sys/time.h>
 #include <sys/signal.h>
+#include <sys/select.h>
+#include <unistd.h>
 
 using namespace fith;
 using namespace std;
@@ -19,9 +28,276 @@ const size_t BINSZ=65536;
 const size_t HEAPSZ=128;
 const size_t STKSZ=128;
 fith_cell bin[BINSZ];
+Interpreter::Decoded decoded[BINSZ];
 fith_cell heap[HEAPSZ];
 fith_cell dstk[STKSZ], cstk[STKSZ];
 size_t dsp=0, csp=0;
+#ifdef FITH_NATIVE
+// proven words of the binary, translated by fithaot
+extern const Interpreter::NativeTable fithnative;
+#endif
+
+/// timer expiries not yet handed to the Scheduler; written by the SIGALRM handler
+volatile sig_atomic_t ticks=0;
+
+/// microseconds since the Unix epoch
+static long long usnow()
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec*1000000LL+now.tv_usec;
+}
+
+/**
+ * Runs event handlers in a pool of Contexts, each with its own stacks.
+ *
+ * Events are queued with a priority and a deadline, and handlers are run
+ * in slices of at most SLICE backward branches or calls (see
+ * Context::execute), so that a long-running handler can't hold up a more
+ * urgent one: every slice goes to the most urgent handler in the pool,
+ * i.e. the lowest priority number, then the earliest deadline, then the
+ * oldest.  Queued events join the pool as Contexts come free.
+ *
+ * Handlers share the heap, so one may see another's writes part-way
+ * through; each Context's stacks are its own.
+ *
+ * Keeps, per handler, the time from queueing to the first slice (wait)
+ * and to completion (latency), and how often it finished late.
+ */
+class Scheduler {
+public:
+
+    /// event priorities, most urgent first
+    enum PRIORITY {
+        PRIO_GPIO,
+        PRIO_TIMER
+    };
+
+    /// Contexts in the pool, i.e. handlers in progress at once
+    static const size_t POOLSZ=4;
+    /// execution budget for each slice
+    static const size_t SLICE=1000;
+
+    Scheduler(Interpreter &interp)
+        : seq(0)
+    {
+        for(size_t i=0;i<POOLSZ;++i){
+            pool.push_back(new Slot(interp));
+        }
+    }
+
+    ~Scheduler()
+    {
+        for(size_t i=0;i<pool.size();++i){
+            delete pool[i];
+        }
+    }
+
+    /**
+     * Queue a call of entry, with param on its data stack.
+     * @param deadline microseconds from now
+     */
+    void post(fith_cell entry, fith_cell param, PRIORITY prio, long long deadline)
+    {
+        Event ev;
+        ev.entry=entry;
+        ev.param=param;
+        ev.prio=prio;
+        ev.queued=usnow();
+        ev.deadline=ev.queued+deadline;
+        ev.seq=seq++;
+        queue.push_back(ev);
+    }
+
+    /**
+     * Is a call of entry queued or in progress?  If so, count it as
+     * dropped, since the caller isn't going to post another.
+     */
+    bool pending(fith_cell entry)
+    {
+        for(size_t i=0;i<queue.size();++i){
+            if(queue[i].entry == entry){
+                ++stats[entry].dropped;
+                return true;
+            }
+        }
+        for(size_t i=0;i<pool.size();++i){
+            if(pool[i]->busy && pool[i]->ev.entry == entry){
+                ++stats[entry].dropped;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// anything to run?
+    bool busy() const
+    {
+        if(!queue.empty()){
+            return true;
+        }
+        for(size_t i=0;i<pool.size();++i){
+            if(pool[i]->busy){
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Fill free Contexts from the queue, then run one slice of the most
+     * urgent handler.
+     */
+    void step()
+    {
+        for(size_t i=0;i<pool.size() && !queue.empty();++i){
+            if(!pool[i]->busy){
+                start(*pool[i], take());
+            }
+        }
+
+        Slot *run=NULL;
+        for(size_t i=0;i<pool.size();++i){
+            if(pool[i]->busy && (run == NULL || before(pool[i]->ev, run->ev))){
+                run=pool[i];
+            }
+        }
+        if(run == NULL){
+            return;
+        }
+
+        Stats &st=stats[run->ev.entry];
+        long long now=usnow();
+        if(run->started == 0){
+            run->started=now;
+            long long wait=now-run->ev.queued;
+            st.wait+=wait;
+            if(wait > st.maxwait){
+                st.maxwait=wait;
+            }
+        }
+
+        Interpreter::EXEC_RESULT res=run->ctx.execute(SLICE);
+        ++st.slices;
+        if(res == Interpreter::EX_HALTED){
+            // out of budget; carry on next time it's the most urgent
+            return;
+        }
+
+        now=usnow();
+        long long latency=now-run->ev.queued;
+        ++st.runs;
+        st.latency+=latency;
+        if(latency > st.maxlatency){
+            st.maxlatency=latency;
+        }
+        if(now > run->ev.deadline){
+            ++st.late;
+        }
+        if(res != Interpreter::EX_SUCCESS){
+            ++st.failed;
+            cerr << endl << "handler " << run->ev.entry << " failed, status=" << res << endl;
+        }
+        run->busy=false;
+    }
+
+    /// print the per-handler statistics; times in microseconds
+    void report(ostream &os) const
+    {
+        os << setw(8) << "handler" << setw(8) << "runs" << setw(8) << "slices"
+           << setw(8) << "failed" << setw(8) << "late" << setw(8) << "dropped"
+           << setw(10) << "avg-wait" << setw(10) << "max-wait"
+           << setw(10) << "avg-lat" << setw(10) << "max-lat" << endl;
+        for(stats_map::const_iterator it=stats.begin();it != stats.end();++it){
+            const Stats &st=it->second;
+            os << setw(8) << it->first << setw(8) << st.runs << setw(8) << st.slices
+               << setw(8) << st.failed << setw(8) << st.late << setw(8) << st.dropped
+               << setw(10) << (st.runs ? st.wait/st.runs : 0) << setw(10) << st.maxwait
+               << setw(10) << (st.runs ? st.latency/st.runs : 0) << setw(10) << st.maxlatency << endl;
+        }
+    }
+
+private:
+
+    struct Event {
+        fith_cell entry;
+        fith_cell param;
+        PRIORITY prio;
+        long long queued;       ///< when it was posted
+        long long deadline;     ///< when it should be done by
+        unsigned long seq;      ///< order of posting
+    };
+
+    /// a Context from the pool and its stacks
+    struct Slot {
+        Slot(Interpreter &interp)
+            : dsp(0), csp(0), ctx(0, &dstk[0], &cstk[0], dsp, csp, STKSZ, STKSZ, interp),
+              busy(false), started(0)
+        {
+        }
+
+        fith_cell dstk[STKSZ], cstk[STKSZ];
+        size_t dsp, csp;
+        Interpreter::Context ctx;
+        bool busy;              ///< running ev
+        Event ev;
+        long long started;      ///< time of the first slice, 0 before then
+    };
+
+    struct Stats {
+        Stats()
+            : runs(0), slices(0), failed(0), late(0), dropped(0),
+              wait(0), maxwait(0), latency(0), maxlatency(0)
+        {
+        }
+
+        unsigned long runs, slices, failed, late, dropped;
+        long long wait, maxwait, latency, maxlatency;
+    };
+
+    typedef map<fith_cell, Stats> stats_map;
+
+    /// should a run before b?
+    static bool before(const Event &a, const Event &b)
+    {
+        if(a.prio != b.prio){
+            return a.prio < b.prio;
+        }
+        if(a.deadline != b.deadline){
+            return a.deadline < b.deadline;
+        }
+        return a.seq < b.seq;
+    }
+
+    /// remove and return the most urgent queued event
+    Event take()
+    {
+        size_t best=0;
+        for(size_t i=1;i<queue.size();++i){
+            if(before(queue[i], queue[best])){
+                best=i;
+            }
+        }
+        Event ev=queue[best];
+        queue.erase(queue.begin()+best);
+        return ev;
+    }
+
+    void start(Slot &slot, const Event &ev)
+    {
+        slot.ev=ev;
+        slot.busy=true;
+        slot.started=0;
+        slot.dsp=slot.csp=0;
+        slot.dstk[slot.dsp++]=ev.param;
+        slot.ctx.set_ip(ev.entry);
+    }
+
+    vector<Slot *> pool;
+    vector<Event> queue;
+    stats_map stats;
+    unsigned long seq;
+};
 
 /**
  * Syscalls implementation that does PLC stuff.
@@ -36,10 +312,11 @@ public:
 
     
     PLCSC(Interpreter &in)
-        : interp(in)
+        : sched(in)
     {
         gpio_handler=0;
         periodic_handler=0;
+        period=0;
         
         for(size_t i=0;i<INPORTS;++i)
             inputs[i]=0;
@@ -47,13 +324,6 @@ public:
             outputs[i]=0;
 
         gettimeofday(&t_boot, NULL);
-        me=this;
-    }
-
-    ~PLCSC()
-    {
-        if(me == this)
-            me=NULL;
     }
     
     virtual fith_cell syscall1(fith_cell a)
@@ -106,6 +376,7 @@ public:
         case SC3_TIMER_PERIODIC:
         {
             periodic_handler=b;
+            period=a;
 
             struct itimerval tv;
             tv.it_value.tv_sec=0;
@@ -131,6 +402,12 @@ public:
         return -1;
     }
 
+    /// log output from the handlers (EMIT, TYPE, TELL), a buffer at a time
+    virtual void write(const char *buf, size_t len)
+    {
+        cout.write(buf, len);
+    }
+
     /**
      * Input has changed! (external event, called from outside interpreter
      */
@@ -143,8 +420,8 @@ public:
         refreshView();
         
         if(gpio_handler != 0){
-            // run the on-change handler, passing port-number on stack
-            call(gpio_handler, which);
+            // queue the on-change handler, passing port-number on stack
+            sched.post(gpio_handler, which, Scheduler::PRIO_GPIO, GPIO_DEADLINE);
         }
     }
 
@@ -166,16 +443,18 @@ public:
     }
 
     /**
-     * timer event, run a thread if not already doing so
+     * timer event, queue the handler if not already doing so; it should
+     * be done before the next one
      */
     void ontimer()
     {
-        if(periodic_handler){
-            call(periodic_handler, 0);
+        if(periodic_handler && !sched.pending(periodic_handler)){
+            sched.post(periodic_handler, 0, Scheduler::PRIO_TIMER, period*1000LL);
         }
     }
 
-    static PLCSC *me;
+    /// runs the handlers
+    Scheduler sched;
 
 private:
 
@@ -197,22 +476,7 @@ private:
             os << ((i&(1<<k))?"1":"0");
         }
     }
-    
-    /**
-     * Run a thread in the interpreter.
-     */
-    void call(fith_cell entry, fith_cell param)
-    {
-        dsp=csp=0;
-        dstk[dsp++]=param; 
-        Interpreter::Context ctx(entry, &dstk[0], &cstk[0], dsp, csp,
-                                 STKSZ, STKSZ, interp);
-        Interpreter::EXEC_RESULT res=ctx.execute();        
-        if(res != Interpreter::EX_SUCCESS){
-            cerr << endl << "GPIO on-change callback failed, status=" << res << endl;
-        }
 
-    }
 
     static const size_t INPORTS=1, OUTPORTS=1;
     
@@ -225,9 +489,11 @@ private:
     static const fith_cell SC1_TIME_MSBOOT=0x2002;
     static const fith_cell SC3_TIMER_PERIODIC=0x2010;
 
-    Interpreter &interp;
-    
+    /// microseconds to run the on-change handler in
+    static const long long GPIO_DEADLINE=10000;
+
     fith_cell gpio_handler, periodic_handler;
+    fith_cell period;           ///< of the timer, milliseconds
     fith_cell inputs[INPORTS];
     fith_cell outputs[OUTPORTS];
 
@@ -235,15 +501,12 @@ private:
     static const time_t EPOCH=946684800;        ///< year 2000, 30 year offset from Unix
 };
 
-PLCSC *PLCSC::me=NULL;
-
 void ontimer(int sig)
 {
     signal(sig, ontimer);       // reinstall
 
-    if(PLCSC::me){
-        PLCSC::me->ontimer();
-    }
+    // Fith code isn't reentrant; leave it to the main loop
+    ticks=ticks+1;
 }
 
 
@@ -415,10 +678,30 @@ int main(int argc, char *argv[])
     
     // create bootstrapped interpreter
     Interpreter interp(bin, BINSZ, heap, HEAPSZ, bs);
+    Verifier verifier(bin);
     PLCSC plcsc(interp);    
+#ifdef FITH_JIT
+    Jit jit(bin);
+#endif
     Interpreter::EXEC_RESULT res;
 
     interp.setSyscalls(&plcsc);
+    interp.setDecoded(decoded);
+
+    if(!bs){
+        // prove what we can of the loaded binary, so handlers can run unchecked
+        verifier.verify(entptr);
+        interp.setProofs(verifier.proofs(), verifier.count());
+#ifdef FITH_JIT
+        jit.setProofs(verifier);
+        interp.setCompiler(&jit);
+#endif
+#ifdef FITH_NATIVE
+        if(!interp.setNative(&fithnative)){
+            cerr << "native code does not match binary, interpreting" << endl;
+        }
+#endif
+    }
     
     
     // create new thread to run boot code
@@ -430,21 +713,56 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    // wait for char IO, for state changes
+    // hold SIGALRM except while waiting, so a tick can't slip in between
+    // looking at ticks and going to sleep
+    sigset_t alrm, unblocked;
+    sigemptyset(&alrm);
+    sigaddset(&alrm, SIGALRM);
+    sigprocmask(SIG_BLOCK, &alrm, &unblocked);
+    sigdelset(&unblocked, SIGALRM);
+
+    // run handlers, waiting for char IO or timer ticks when idle
+    bool input=true;
     while(true){
-        char c;
-        cin.get(c);
+        for(;ticks > 0;--ticks){
+            plcsc.ontimer();
+        }
 
-        if(tolower(c) == 'q')
+        fd_set fds;
+        FD_ZERO(&fds);
+        if(input){
+            FD_SET(0, &fds);
+        }
+        struct timespec poll={ 0, 0 };
+        int n=pselect(1, &fds, NULL, NULL, plcsc.sched.busy() ? &poll : NULL, &unblocked);
+        if(n < 0 && errno != EINTR){
             break;
-        
-        if(isdigit(c)){
-            int bit=c-'0';
+        }
 
-            // toggle an input GPIO bit
-            plcsc.changeInput(0, plcsc.getInput(0) ^ (1<<bit));
+        if(n > 0 && FD_ISSET(0, &fds)){
+            char c;
+            if(read(0, &c, 1) <= 0){
+                // no more input; keep running the timer
+                input=false;
+            }
+            else if(tolower(c) == 'q'){
+                break;
+            }
+            else if(isdigit(c)){
+                int bit=c-'0';
+
+                // toggle an input GPIO bit
+                plcsc.changeInput(0, plcsc.getInput(0) ^ (1<<bit));
+            }
         }
+
+        plcsc.sched.step();
     }
+
+    plcsc.sched.report(cerr);
+#ifdef FITH_JIT
+    cerr << "jit: " << jit.compiled() << " functions compiled" << endl;
+#endif
     
     return 0;
 }
@@ -0,0 +1,81 @@
+#!/bin/sh
+#
+# Differential test of the execution engines.
+#
+# Each program is compiled by fithi, and must GC to a saved binary.  That
+# binary is then run by fithi -r (the reference), fithe, fithej (JIT),
+# fithen (fithaot's translation) and fithmin (fithgen's minimal runtime),
+# and every one of them must print exactly what the reference does.  If
+# there is a test/NAME.out, the reference must print that, and fithi
+# mustn't have found any unrecognised words while compiling.
+#
+# usage: test/check.sh prog.5th...   (from the top directory; see "make check")
+
+MAKE=${MAKE:-make}
+out=$(mktemp -d) || exit 1
+trap 'rm -rf $out save.fith' EXIT
+fails=0
+
+for prog in "$@"; do
+    name=$(basename $prog .5th)
+    rm -f save.fith
+    ./fithi < $prog > $out/$name.log 2>&1
+    if [ ! -f save.fith ]; then
+        echo "FAIL $name: no binary saved"
+        cat $out/$name.log
+        fails=$((fails+1))
+        continue
+    fi
+
+    if grep -q "^Unrecognised word" $out/$name.log; then
+        echo "FAIL $name: didn't compile"
+        grep "^Unrecognised word" $out/$name.log | head -5
+        fails=$((fails+1))
+        continue
+    fi
+
+    ./fithi -r save.fith > $out/$name.ref 2>&1 < /dev/null
+    if [ ! -s $out/$name.ref ]; then
+        echo "FAIL $name: no output"
+        fails=$((fails+1))
+        continue
+    fi
+    expect=$(dirname $prog)/$name.out
+    if [ -f $expect ] && ! cmp -s $expect $out/$name.ref; then
+        echo "FAIL $name: fithi's output is not $expect"
+        diff $expect $out/$name.ref | head -10
+        fails=$((fails+1))
+        continue
+    fi
+
+    if ! $MAKE -s fithen fithmin PROG=save.fith > $out/$name.make 2>&1; then
+        echo "FAIL $name: can't build fithen/fithmin"
+        cat $out/$name.make
+        fails=$((fails+1))
+        continue
+    fi
+
+    ok=1
+    for engine in fithe fithej fithen fithmin; do
+        if [ $engine = fithmin ]; then
+            ./fithmin > $out/$name.$engine 2>&1 < /dev/null
+        else
+            ./$engine -r save.fith > $out/$name.$engine 2>&1 < /dev/null
+        fi
+        if ! cmp -s $out/$name.ref $out/$name.$engine; then
+            echo "FAIL $name: $engine differs from fithi"
+            diff $out/$name.ref $out/$name.$engine | head -10
+            ok=0
+        fi
+    done
+    if [ $ok = 1 ]; then
+        echo "ok   $name"
+    else
+        fails=$((fails+1))
+    fi
+done
+
+if [ $fails != 0 ]; then
+    echo "$fails failed"
+    exit 1
+fi
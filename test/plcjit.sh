@@ -0,0 +1,27 @@
+#!/bin/sh
+#
+# fithp runs its handlers in budgeted slices; check that fithpj still
+# compiles a hot one (and so runs it natively) rather than interpreting
+# it for ever.
+#
+# usage: test/plcjit.sh   (from the top directory; see "make check")
+
+out=$(mktemp) || exit 1
+trap 'rm -f $out save.fith' EXIT
+
+rm -f save.fith
+./fithi < test/plcjit.5th > /dev/null 2>&1
+if [ ! -f save.fith ]; then
+    echo "FAIL plcjit: no binary saved"
+    exit 1
+fi
+
+# a second of ticks is well past the JIT's threshold
+(sleep 1; echo q) | ./fithpj -r save.fith > $out 2>&1
+n=$(sed -n 's/^jit: \([0-9]*\) functions compiled$/\1/p' $out)
+if [ -z "$n" ] || [ "$n" = 0 ]; then
+    echo "FAIL plcjit: fithpj compiled nothing"
+    cat $out
+    exit 1
+fi
+echo "ok   plcjit ($n functions compiled)"